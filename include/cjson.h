@@ -9,6 +9,7 @@ extern const char CJSONX_PARSE[];       /* Data: C String. */
 extern const char CJSONX_TYPE[];        /* Data: C String. */
 extern const char CJSONX_INDEX[];       /* Data: C String. */
 extern const char CJSONX_NOT_FOUND[];   /* Data: C String. */
+extern const char CJSONX_RANGE[];       /* Data: C String. */
 
 /* cjson Node Types */
 enum cjson_type {
@@ -29,17 +30,40 @@ enum cjson_type {
 /* cjson Node Structure */
 struct cjson;
 
+/* A region of memory for the nodes of documents (see cjson_arena_new). */
+struct cjson_arena;
+
+/* A table of shared strings for keys and string values (see
+ * cjson_intern_new).
+ */
+struct cjson_intern;
+
+/* An allocator for the memory of documents. The functions behave like malloc,
+ * realloc and free and are passed the context.
+ */
+struct cjson_allocator {
+  void *(*malloc)(void *context, size_t size);
+  void *(*realloc)(void *context, void *p, size_t size);
+  void (*free)(void *context, void *p);
+  void *context;
+};
+
+/* The nesting depth accepted by the parsers unless a hook sets max_depth. */
+#define CJSON_MAX_DEPTH 1024
+
 /* cjson node hooks used to manage the lifecycle of the node. */
 struct cjson_hook {
   /* If provided, this function will be called when allocating a new node. This
-   * does not control how memory is allocated for internal resources. It only
-   * affects the memory allocation for the cjson struct itself.
+   * does not control how memory is allocated for internal resources (see
+   * allocator). It only affects the memory allocation for the cjson struct
+   * itself.
    */
   struct cjson *(*cjson_malloc)(enum cjson_type type, struct cjson *parent);
 
-  /* If provided, this function will be called when freeing node. This does not
-   * control how memory is deallocated for internal resources. It only affects
-   * the memory deallocation for the cjson struct itself.
+  /* If provided, this function will be called when freeing a node that was
+   * allocated by cjson_malloc (or by the caller). This does not control how
+   * memory is deallocated for internal resources (see allocator). It only
+   * affects the memory deallocation for the cjson struct itself.
    */
   void (*cjson_free)(struct cjson *self);
 
@@ -49,10 +73,45 @@ struct cjson_hook {
    * range).
    */
   void (*valid)(struct cjson *self);
+
+  /* The parsers will not accept arrays and objects nested deeper than this.
+   * If zero, CJSON_MAX_DEPTH is used. The parsers for CJSON_ROOT keep the open
+   * containers on the heap, but the other parsers (and cjson_free and the
+   * printers) recurse for each level.
+   */
+  size_t max_depth;
+
+  /* If provided, nodes and their strings, numbers and keys are allocated from
+   * the arena (instead of by cjson_malloc) and cjson_free only releases the
+   * storage of arrays and objects. The rest is released by cjson_arena_free.
+   */
+  struct cjson_arena *arena;
+
+  /* If provided, everything else allocated for the nodes (the nodes unless
+   * cjson_malloc is provided, their strings, numbers and keys, and the
+   * parser's buffers) is allocated with it. The storage of arrays and objects
+   * is always allocated by Judy.
+   */
+  struct cjson_allocator *allocator;
+
+  /* If provided, the parsers share the keys and short string values of the
+   * nodes through the intern table instead of allocating a copy for each.
+   */
+  struct cjson_intern *intern;
 };
 
+/* Nodes allocated by cjson (other than with a hook's cjson_malloc) only have
+ * room for the member of value their type uses, and short strings, numbers
+ * and keys are stored right after the node.
+ *
+ * Breaking change (since 0.2): such a node can't be copied by value, changed
+ * to another type or passed to cjson_init. Create a node of the other type
+ * (or parse a copy) instead. Nodes allocated by a cjson_malloc hook or by the
+ * caller are full sized and can still be used that way.
+ */
 struct cjson {
   enum cjson_type type;
+  unsigned int flags;         /* Internal state of the node (e.g. which conversions are cached). */
   struct cjson *parent;       /* The parent/container node for this node (e.g. an object). */
   struct cjson_hook *hook;
 
@@ -63,7 +122,14 @@ struct cjson {
 
     unsigned int boolean;     /* 0 for false; 1 for true. */
 
-    char *number;             /* C String */
+    struct {
+      char *number;           /* C String */
+      union {
+        int64_t int64;
+        uint64_t uint64;
+        double real;
+      } number_cache;         /* The converted number (see cjson_number_get_*). */
+    };
 
     struct {
       size_t key_length;      /* The length of the longest key (not including null). */
@@ -86,10 +152,134 @@ struct cjson {
   } value;
 };
 
+/*** Errors ***/
+
+/* The kinds of parse errors reported by the cjson_root_try_* functions. */
+enum cjson_error_code {
+  CJSON_ERROR_NONE = 0,
+  CJSON_ERROR_SYNTAX,         /* An unexpected character. */
+  CJSON_ERROR_TRUNCATED,      /* The input ended inside a document. */
+  CJSON_ERROR_ENCODING,       /* Invalid UTF-8 or an invalid escape sequence. */
+  CJSON_ERROR_DUPLICATE,      /* A key repeated in the same object. */
+  CJSON_ERROR_TYPE,           /* A bare item that isn't one of the valid types. */
+  CJSON_ERROR_DEPTH,          /* Containers nested deeper than the hook's max_depth. */
+};
+
+/* The tokens the parser could have accepted where the error was found. */
+enum cjson_expect {
+  CJSON_EXPECT_VALUE        = 0x01,
+  CJSON_EXPECT_KEY          = 0x02,
+  CJSON_EXPECT_COLON        = 0x04,
+  CJSON_EXPECT_COMMA        = 0x08,
+  CJSON_EXPECT_ARRAY_END    = 0x10,
+  CJSON_EXPECT_OBJECT_END   = 0x20,
+  CJSON_EXPECT_END          = 0x40,   /* The end of the document. */
+};
+
+struct cjson_error {
+  enum cjson_error_code code;
+  long offset;                /* The byte offset just past the error. */
+  long line;                  /* The line (from 1) of the error or 0 if unknown. */
+  long column;                /* The column (from 1, in bytes) of the error or 0 if unknown. */
+  unsigned int expected;      /* The set of expected tokens (enum cjson_expect). */
+  int64_t character;          /* The offending character or code point (EOF if none). */
+  const char *reason;         /* Static C String. */
+};
+
+/* Format the error as a message in the buffer of the given size. Like
+ * snprintf, the message is truncated to fit and the length of the whole
+ * message is returned.
+ */
+int
+cjson_error_format(
+  const struct cjson_error *error,
+  char *buf,
+  size_t size
+);
+
+/*** Arena ***/
+
+/* Create an arena. If a buffer is given, the arena and the first allocations
+ * are placed in it, so small documents need no other memory for their nodes.
+ * More memory is allocated in growing chunks as needed. An arena is not
+ * thread safe.
+ *
+ * Throws:
+ *
+ * ECX_EC
+ *  If memory cannot be allocated.
+ */
+struct cjson_arena *
+cjson_arena_new(
+  void *buf,
+  size_t size
+);
+
+/* Release the arena and all memory allocated from it. The nodes allocated
+ * from it must be freed with cjson_free first (which only releases the
+ * storage of arrays and objects).
+ */
+void
+cjson_arena_free(
+  struct cjson_arena *arena
+);
+
+/*** Slab ***/
+
+/* Return the memory of freed nodes to the heap where possible. The nodes that
+ * aren't allocated by a hook's arena, allocator or cjson_malloc come from
+ * slabs that are kept for reuse once their nodes are freed. The slabs whose
+ * nodes are all free are released, apart from those holding nodes last freed
+ * by other threads that are still running. (Threads that finish with many
+ * freed nodes release the slabs as well.)
+ */
+void
+cjson_slab_trim(void);
+
+/*** Intern ***/
+
+/* Create an intern table. Keys (and string values of at most max_length bytes
+ * that don't contain a null) parsed with it point to a single copy of each
+ * distinct string, so they can be compared by pointer (see cjson_intern_find).
+ * Each copy is released when the last node using it is freed. The table can
+ * be shared by documents on several threads. If an allocator is given, the
+ * table and its copies are allocated with it (the indexes of the table are
+ * always allocated by Judy).
+ *
+ * Throws:
+ *
+ * ECX_EC
+ *  If memory cannot be allocated.
+ */
+struct cjson_intern *
+cjson_intern_new(
+  size_t max_length,
+  struct cjson_allocator *allocator
+);
+
+/* Release the caller's reference to the intern table. It is destroyed once no
+ * node uses any of its strings.
+ */
+void
+cjson_intern_free(
+  struct cjson_intern *intern
+);
+
+/* Return the interned copy of the string (or NULL if no node uses it). The
+ * keys and string values interned with it are equal to the string exactly
+ * when they are this pointer.
+ */
+const char *
+cjson_intern_find(
+  struct cjson_intern *intern,
+  const char *string
+);
+
 /*** Generic ***/
 
 /* Initialize a node to be the given type and a child of the provided parent
- * node.
+ * node. The node must be a full sized struct cjson allocated by the caller (or
+ * a cjson_malloc hook), not one allocated by cjson.
  */
 void
 cjson_init(
@@ -173,8 +363,11 @@ cjson_walk(
   void *data
 );
 
-/* Finialize and deallocate a cjson tree. If the cjson_free hook was set, then
- * that callback will be used to deallocate the node, otherwise free is used.
+/* Finialize and deallocate a cjson tree. Each node is deallocated the way it
+ * was allocated: nodes from the arena are left to it, nodes from the
+ * allocator are returned to it and the other nodes allocated by cjson are
+ * reused. The nodes allocated by the cjson_malloc hook (or by the caller) are
+ * deallocated by the cjson_free hook if it was set, otherwise free is used.
  */
 void
 cjson_free(
@@ -196,6 +389,20 @@ cjson_array_fscan(
   struct cjson *parent
 );
 
+/* Read a CJSON_ARRAY from the buffer of the given length.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the buffer does not contain an array.
+ */
+struct cjson *
+cjson_array_parse(
+  const char *buf,
+  size_t length,
+  struct cjson *parent
+);
+
 /* Render a CJSON_ARRAY to the stream.
  *
  * Throws:
@@ -304,6 +511,85 @@ cjson_array_extend(
   struct cjson *array
 );
 
+/* An iterator over the elements of an array in a stream or buffer (see
+ * cjson_array_iter_fscan).
+ */
+struct cjson_array_iter;
+
+/* Begin iterating over the elements of the array at the path in the document
+ * in the stream. The path uses the null separated segment format of cjson_get
+ * (NULL or "" for the document itself). The values leading up to the array
+ * are checked, but no nodes are built for them. The elements are returned one
+ * at a time by cjson_array_iter_next, so memory use is bounded by the largest
+ * element rather than the whole array. Nothing after the array is read.
+ *
+ * The iterator reads ahead in the stream and must be finished with
+ * cjson_array_iter_free.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the document is not valid up to the array.
+ *
+ * CJSONX_NOT_FOUND
+ *  If the document has no value at the path.
+ *
+ * CJSONX_TYPE
+ *  If the value at the path is not an array.
+ */
+struct cjson_array_iter *
+cjson_array_iter_fscan(
+  FILE *stream,
+  const char *segments,
+  struct cjson_hook *hook
+);
+
+/* Begin iterating over the elements of the array at the path in the document
+ * in the buffer of the given length. This behaves like cjson_array_iter_fscan,
+ * but reads directly from memory instead of a stream. The buffer must remain
+ * valid until the iterator is freed.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the document is not valid up to the array.
+ *
+ * CJSONX_NOT_FOUND
+ *  If the document has no value at the path.
+ *
+ * CJSONX_TYPE
+ *  If the value at the path is not an array.
+ */
+struct cjson_array_iter *
+cjson_array_iter_parse(
+  const char *buf,
+  size_t length,
+  const char *segments,
+  struct cjson_hook *hook
+);
+
+/* Return the next element or NULL if there are no more. The element has no
+ * parent and is owned by the caller (it must be freed with cjson_free).
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the next element is not valid. The iterator cannot be used after this
+ *  except to free it.
+ */
+struct cjson *
+cjson_array_iter_next(
+  struct cjson_array_iter *iter
+);
+
+/* Finish iterating. Any bytes read ahead from the stream, but not consumed,
+ * are returned to it if it is seekable.
+ */
+void
+cjson_array_iter_free(
+  struct cjson_array_iter *iter
+);
+
 /*** Boolean ***/
 
 /* Read a CJSON_BOOLEAN from the stream.
@@ -319,6 +605,20 @@ cjson_boolean_fscan(
   struct cjson *parent
 );
 
+/* Read a CJSON_BOOLEAN from the buffer of the given length.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the buffer does not contain a boolean.
+ */
+struct cjson *
+cjson_boolean_parse(
+  const char *buf,
+  size_t length,
+  struct cjson *parent
+);
+
 /* Render a CJSON_BOOLEAN to the stream.
  *
  * Throws:
@@ -347,6 +647,20 @@ cjson_null_fscan(
   struct cjson *parent
 );
 
+/* Read a CJSON_NULL from the buffer of the given length.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the buffer does not contain a null.
+ */
+struct cjson *
+cjson_null_parse(
+  const char *buf,
+  size_t length,
+  struct cjson *parent
+);
+
 /* Render a CJSON_NULL to the stream.
  *
  * Throws:
@@ -375,6 +689,20 @@ cjson_number_fscan(
   struct cjson *parent
 );
 
+/* Read a CJSON_NUMBER from the buffer of the given length.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the buffer does not contain a number.
+ */
+struct cjson *
+cjson_number_parse(
+  const char *buf,
+  size_t length,
+  struct cjson *parent
+);
+
 /* Render a CJSON_NUMBER to the stream.
  *
  * Throws:
@@ -388,6 +716,90 @@ cjson_number_fprint(
   struct cjson *node
 );
 
+/* Create a CJSON_NUMBER with the given value. */
+struct cjson *
+cjson_number_from_int64(
+  int64_t value,
+  struct cjson *parent
+);
+
+/* Create a CJSON_NUMBER with the given value. */
+struct cjson *
+cjson_number_from_uint64(
+  uint64_t value,
+  struct cjson *parent
+);
+
+/* Create a CJSON_NUMBER with the shortest text that reads back as the given
+ * value. Magnitudes from 1e-6 up to 1e21 are written in plain notation and
+ * others in exponential notation (e.g. 0.1, 1e+21 and 5e-324).
+ *
+ * Throws:
+ *
+ * CJSONX_RANGE
+ *  If the value is NaN or infinite.
+ */
+struct cjson *
+cjson_number_from_double(
+  double value,
+  struct cjson *parent
+);
+
+/* Return the value of a CJSON_NUMBER as a signed 64 bit integer. Numbers
+ * written with a fraction or exponent are accepted if their value is an
+ * integer (e.g. 1.0 or 1e3). The result is cached in the node, so the getters
+ * modify the node they read. They may still be called for the same node by
+ * several threads at once (but not while another thread changes it).
+ *
+ * Throws:
+ *
+ * CJSONX_TYPE
+ *  If the node is not a CJSON_NUMBER.
+ *
+ * CJSONX_RANGE
+ *  If the value is not an integer or is outside the range of int64_t.
+ */
+int64_t
+cjson_number_get_int64(
+  struct cjson *self
+);
+
+/* Return the value of a CJSON_NUMBER as an unsigned 64 bit integer. Numbers
+ * written with a fraction or exponent are accepted if their value is an
+ * integer. The result is cached in the node (see cjson_number_get_int64).
+ *
+ * Throws:
+ *
+ * CJSONX_TYPE
+ *  If the node is not a CJSON_NUMBER.
+ *
+ * CJSONX_RANGE
+ *  If the value is not an integer or is outside the range of uint64_t.
+ */
+uint64_t
+cjson_number_get_uint64(
+  struct cjson *self
+);
+
+/* Return the value of a CJSON_NUMBER as the nearest double. If exact is not
+ * NULL, it is set to 1 if the double is exactly the value of the number and
+ * to 0 if it was rounded. The result is cached in the node (see
+ * cjson_number_get_int64).
+ *
+ * Throws:
+ *
+ * CJSONX_TYPE
+ *  If the node is not a CJSON_NUMBER.
+ *
+ * CJSONX_RANGE
+ *  If the magnitude of the value is too large for a double.
+ */
+double
+cjson_number_get_double(
+  struct cjson *self,
+  int *exact
+);
+
 /*** Object ***/
 
 /* Read a CJSON_OBJECT from the stream.
@@ -403,6 +815,20 @@ cjson_object_fscan(
   struct cjson *parent
 );
 
+/* Read a CJSON_OBJECT from the buffer of the given length.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the buffer does not contain an object.
+ */
+struct cjson *
+cjson_object_parse(
+  const char *buf,
+  size_t length,
+  struct cjson *parent
+);
+
 /* Render a CJSON_OBJECT to the stream.
  *
  * Throws:
@@ -515,6 +941,20 @@ cjson_pair_fscan(
   struct cjson *parent
 );
 
+/* Read a CJSON_PAIR from the buffer of the given length.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the buffer does not contain a key value pair.
+ */
+struct cjson *
+cjson_pair_parse(
+  const char *buf,
+  size_t length,
+  struct cjson *parent
+);
+
 /* Render a CJSON_PAIR to the stream.
  *
  * Throws:
@@ -548,76 +988,299 @@ cjson_root_fscan(
   struct cjson_hook *hook
 );
 
-/* Render a CJSON_ROOT to the stream.
+/* Read a CJSON_ROOT from the buffer of the given length. This behaves like
+ * cjson_root_fscan, but reads directly from memory instead of a stream.
  *
  * Throws:
  *
- * CJSONX_TYPE
- *  If the node is not a CJSON_ROOT.
+ * CJSONX_PARSE
+ *  If the buffer does not contain a valid root type.
  */
-void
-cjson_root_fprint(
-  FILE *stream,
-  struct cjson *node
+struct cjson *
+cjson_root_parse(
+  const char *buf,
+  size_t length,
+  enum cjson_type valid,
+  unsigned int continuous,
+  struct cjson_hook *hook
 );
 
-/*** UTF-8 ***/
-
-/* Read a UTF-8 encoded character from the stream and return the Unicode code
- * point.
+/* Read a CJSON_ROOT from the file at the given path. The file is mapped into
+ * memory and parsed directly from the mapping (instead of being read through
+ * a stream). The mapping is released before returning. Files that report no
+ * size (e.g. pipes and /proc files) are read into memory instead.
  *
  * Throws:
  *
  * CJSONX_PARSE
- *  If the stream does not contain a valid UTF-8 encoded character.
+ *  If the file does not contain a valid root type.
+ *
+ * ECX_EC
+ *  If the file cannot be opened, read or mapped.
  */
-int64_t
-cjson_u8_fgetu(
-  FILE *stream
+struct cjson *
+cjson_root_parse_file(
+  const char *path,
+  enum cjson_type valid,
+  unsigned int continuous,
+  struct cjson_hook *hook
 );
 
-/* Render the Unicode code point to the stream.
+/* Read a CJSON_ROOT from the buffer of the given length using several
+ * threads. The buffer must contain a single document (surrounded only by
+ * whitespace). If the document is a large array or object, its elements are
+ * split into segments that are parsed in parallel and then added to it in
+ * order. Other documents are parsed as by cjson_root_parse.
+ *
+ * If threads is zero, one thread is used for each online processor. The hook
+ * (if any) is called from the parsing threads, so it must be thread safe.
  *
  * Throws:
  *
  * CJSONX_PARSE
- *  If the code point is not valid.
+ *  If the buffer does not contain a single valid root type.
  */
-void
-cjson_u8_fputu(
-  const uint32_t u,
-  FILE *stream
+struct cjson *
+cjson_root_parse_parallel(
+  const char *buf,
+  size_t length,
+  enum cjson_type valid,
+  unsigned int threads,
+  struct cjson_hook *hook
 );
 
-/*** UTF-16 Escape ***/
-
-/* Read the Unicode code point from a UTF-8 encoded stream as a UTF-16 escape
- * sequence. The leading backslash is assumed to be consumed already so a
- * surrogate pair will look like: uD834\uDD1E.
+/* Read a CJSON_ROOT from the file at the given path using several threads.
+ * The file is mapped into memory and parsed as by cjson_root_parse_parallel.
  *
  * Throws:
  *
  * CJSONX_PARSE
- *  If the stream does not contain a valid UTF-16 escape sequence.
+ *  If the file does not contain a single valid root type.
+ *
+ * ECX_EC
+ *  If the file cannot be opened or mapped.
  */
-int64_t
-cjson_u16e_fgetu(
-  FILE *stream
+struct cjson *
+cjson_root_parse_file_parallel(
+  const char *path,
+  enum cjson_type valid,
+  unsigned int threads,
+  struct cjson_hook *hook
 );
 
-/* Render the Unicode code point to a UTF-8 encoded stream as a UTF-16 escape
- * sequence.
+/* Read a CJSON_ROOT from the stream like cjson_root_fscan, but only build
+ * nodes for the values at the given paths (in the null separated segment
+ * format used by cjson_get) and the containers leading to them. The paths are
+ * relative to each document, so cjson_get finds the same values in every
+ * document. Everything else is checked while it is read, but no nodes are
+ * built for it.
+ *
+ * An array on a path keeps the elements before the last selected one as
+ * nulls so the selected elements keep their indexes. Documents that are not
+ * arrays or objects are kept whole. Duplicate keys are only detected among
+ * the selected pairs.
  *
  * Throws:
  *
  * CJSONX_PARSE
- *  If the code point is not valid.
+ *  If the stream does not contain a valid root type.
  */
-void
-cjson_u16e_fputu(
-  const uint32_t u,
-  FILE *stream
-);
+struct cjson *
+cjson_root_fscan_project(
+  FILE *stream,
+  enum cjson_type valid,
+  unsigned int continuous,
+  const char **paths,
+  size_t count,
+  struct cjson_hook *hook
+);
+
+/* Read a CJSON_ROOT from the buffer of the given length. This behaves like
+ * cjson_root_fscan_project, but reads directly from memory instead of a
+ * stream.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the buffer does not contain a valid root type.
+ */
+struct cjson *
+cjson_root_parse_project(
+  const char *buf,
+  size_t length,
+  enum cjson_type valid,
+  unsigned int continuous,
+  const char **paths,
+  size_t count,
+  struct cjson_hook *hook
+);
+
+/* Read a CJSON_ROOT from the stream like cjson_root_fscan, but report parse
+ * errors in the error instead of throwing them. No message is formatted for
+ * the error (see cjson_error_format). Returns NULL if the parse failed.
+ *
+ * Throws:
+ *
+ * ECX_EC
+ *  If memory cannot be allocated.
+ */
+struct cjson *
+cjson_root_try_fscan(
+  FILE *stream,
+  enum cjson_type valid,
+  unsigned int continuous,
+  struct cjson_hook *hook,
+  struct cjson_error *error
+);
+
+/* Read a CJSON_ROOT from the buffer of the given length like
+ * cjson_root_parse, but report parse errors in the error instead of throwing
+ * them. Returns NULL if the parse failed.
+ *
+ * Throws:
+ *
+ * ECX_EC
+ *  If memory cannot be allocated.
+ */
+struct cjson *
+cjson_root_try_parse(
+  const char *buf,
+  size_t length,
+  enum cjson_type valid,
+  unsigned int continuous,
+  struct cjson_hook *hook,
+  struct cjson_error *error
+);
+
+/* Render a CJSON_ROOT to the stream.
+ *
+ * Throws:
+ *
+ * CJSONX_TYPE
+ *  If the node is not a CJSON_ROOT.
+ */
+void
+cjson_root_fprint(
+  FILE *stream,
+  struct cjson *node
+);
+
+/* An iterator over the documents in a stream or buffer (see
+ * cjson_root_iter_fscan).
+ */
+struct cjson_root_iter;
+
+/* Begin iterating over the documents in the stream. Unlike cjson_root_fscan
+ * with continuous set, the documents are returned one at a time by
+ * cjson_root_iter_next instead of being collected in a CJSON_ROOT, so memory
+ * use is bounded by the largest document.
+ *
+ * Documents may be separated by any whitespace (e.g. newline delimited JSON)
+ * or by record separators (0x1E) as in a JSON text sequence (RFC 7464). The
+ * valid set indicates which types are valid documents. The hook (if any) is
+ * used for every node returned.
+ *
+ * The iterator reads ahead in the stream and must be finished with
+ * cjson_root_iter_free.
+ */
+struct cjson_root_iter *
+cjson_root_iter_fscan(
+  FILE *stream,
+  enum cjson_type valid,
+  struct cjson_hook *hook
+);
+
+/* Begin iterating over the documents in the buffer of the given length. This
+ * behaves like cjson_root_iter_fscan, but reads directly from memory instead
+ * of a stream. The buffer must remain valid until the iterator is freed.
+ */
+struct cjson_root_iter *
+cjson_root_iter_parse(
+  const char *buf,
+  size_t length,
+  enum cjson_type valid,
+  struct cjson_hook *hook
+);
+
+/* Return the next document or NULL if there are no more. The document has no
+ * parent and is owned by the caller (it must be freed with cjson_free).
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the next document is not valid. The iterator cannot be used after this
+ *  except to free it.
+ */
+struct cjson *
+cjson_root_iter_next(
+  struct cjson_root_iter *iter
+);
+
+/* Finish iterating. Any bytes read ahead from the stream, but not consumed,
+ * are returned to it if it is seekable.
+ */
+void
+cjson_root_iter_free(
+  struct cjson_root_iter *iter
+);
+
+/*** UTF-8 ***/
+
+/* Read a UTF-8 encoded character from the stream and return the Unicode code
+ * point.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the stream does not contain a valid UTF-8 encoded character.
+ */
+int64_t
+cjson_u8_fgetu(
+  FILE *stream
+);
+
+/* Render the Unicode code point to the stream.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the code point is not valid.
+ */
+void
+cjson_u8_fputu(
+  const uint32_t u,
+  FILE *stream
+);
+
+/*** UTF-16 Escape ***/
+
+/* Read the Unicode code point from a UTF-8 encoded stream as a UTF-16 escape
+ * sequence. The leading backslash is assumed to be consumed already so a
+ * surrogate pair will look like: uD834\uDD1E.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the stream does not contain a valid UTF-16 escape sequence.
+ */
+int64_t
+cjson_u16e_fgetu(
+  FILE *stream
+);
+
+/* Render the Unicode code point to a UTF-8 encoded stream as a UTF-16 escape
+ * sequence.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the code point is not valid.
+ */
+void
+cjson_u16e_fputu(
+  const uint32_t u,
+  FILE *stream
+);
 
 /*** JSON Encoded String ***/
 
@@ -699,6 +1362,20 @@ cjson_string_fscan(
   struct cjson *parent
 );
 
+/* Read a CJSON_STRING from the buffer of the given length.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the buffer does not contain a string.
+ */
+struct cjson *
+cjson_string_parse(
+  const char *buf,
+  size_t length,
+  struct cjson *parent
+);
+
 /* Render a CJSON_STRING to the stream.
  *
  * Throws:
@@ -712,4 +1389,430 @@ cjson_string_fprint(
   struct cjson *node
 );
 
+/*** SAX ***/
+
+/* Callbacks for the events found by cjson_sax_parse and cjson_sax_fscan. Any
+ * of them may be NULL. The data pointer given to the parser is passed to
+ * each.
+ *
+ * Keys, strings and numbers are only valid until the callback returns. Keys
+ * and strings are UTF-8 (their escape sequences are decoded) and numbers are
+ * the text of the number. All three are null terminated, but keys and
+ * strings may also contain nulls.
+ *
+ * Any callback may stop the parse early by returning a non-zero value. The
+ * parser will return the same value.
+ */
+struct cjson_sax {
+  int (*on_array_begin)(void *data);
+  int (*on_array_end)(void *data);
+  int (*on_object_begin)(void *data);
+  int (*on_object_end)(void *data);
+  int (*on_key)(void *data, const char *key, size_t length);
+  int (*on_string)(void *data, const char *bytes, size_t length);
+  int (*on_number)(void *data, const char *number, size_t length);
+  int (*on_boolean)(void *data, unsigned int boolean);
+  int (*on_null)(void *data);
+};
+
+/* Parse the bare items in the stream and call the callbacks for each event
+ * instead of building nodes. The valid and continuous arguments have the same
+ * meaning as for cjson_root_fscan. Memory use depends only on the nesting
+ * depth and the longest string in the input.
+ *
+ * Returns zero if the input was parsed or the value returned by the callback
+ * that stopped the parse.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the stream does not contain valid JSON.
+ */
+int
+cjson_sax_fscan(
+  FILE *stream,
+  enum cjson_type valid,
+  unsigned int continuous,
+  const struct cjson_sax *sax,
+  void *data
+);
+
+/* Parse the bare items in the buffer of the given length like
+ * cjson_sax_fscan.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the buffer does not contain valid JSON.
+ */
+int
+cjson_sax_parse(
+  const char *buf,
+  size_t length,
+  enum cjson_type valid,
+  unsigned int continuous,
+  const struct cjson_sax *sax,
+  void *data
+);
+
+/* A push parser (see cjson_parser_new). */
+struct cjson_parser;
+
+/* Create a parser that is given its input a buffer at a time with
+ * cjson_parser_feed instead of reading it from a stream. The input is parsed
+ * as by cjson_sax_parse and the callbacks are called as soon as each token is
+ * complete. Buffers may end anywhere (even inside a token). Only the bytes of
+ * a token that crosses two buffers are copied.
+ *
+ * The parser must be freed with cjson_parser_free.
+ */
+struct cjson_parser *
+cjson_parser_new(
+  enum cjson_type valid,
+  unsigned int continuous,
+  const struct cjson_sax *sax,
+  void *data
+);
+
+/* Parse the next buffer of the given length. The buffer is not used after
+ * this returns.
+ *
+ * Returns zero if the parser is ready for more input or the value returned
+ * by the callback that stopped the parse. Once the parse has stopped (or the
+ * input is complete), further input is ignored.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the input is not valid JSON. The parser cannot be used after this
+ *  except to free it.
+ */
+int
+cjson_parser_feed(
+  struct cjson_parser *p,
+  const char *buf,
+  size_t length
+);
+
+/* Signal the end of the input and parse anything that was waiting for more
+ * (e.g. a number at the end of the last buffer).
+ *
+ * Returns zero or the value returned by the callback that stopped the parse.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the input is not valid JSON or ends inside a value.
+ */
+int
+cjson_parser_finish(
+  struct cjson_parser *p
+);
+
+/* Free the parser and any input it was holding for an incomplete token. The
+ * parser may be freed at any point: before the input is finished, after a
+ * callback stopped the parse or after cjson_parser_feed or
+ * cjson_parser_finish threw. The data given to cjson_parser_new is not freed.
+ * If p is NULL, nothing is done.
+ */
+void
+cjson_parser_free(
+  struct cjson_parser *p
+);
+
+/*** Pipeline ***/
+
+/* Parse the newline delimited documents in the stream on several threads and
+ * hand each one to consume. The stream is read in large batches that end at
+ * line breaks, so every document must be on a single line (record separators
+ * may also be used as in cjson_root_iter_fscan). The valid set indicates which
+ * types are valid documents.
+ *
+ * If threads is zero, one thread is used for each online processor. The
+ * documents are passed to consume on the calling thread in the order they
+ * appear in the stream if ordered is set and in the order they are parsed
+ * otherwise. The consumer owns each document (it must be freed with
+ * cjson_free). The hook (if any) is called from the parsing threads, so it
+ * must be thread safe.
+ *
+ * Returns zero once the stream has been parsed. If consume returns a non-zero
+ * value, parsing stops and the value is returned.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the stream contains an invalid document. The documents before it
+ *  (when ordered) have already been consumed.
+ *
+ * ECX_EC
+ *  If the stream cannot be read or the threads cannot be started.
+ */
+int
+cjson_pipeline_fscan(
+  FILE *stream,
+  enum cjson_type valid,
+  unsigned int threads,
+  unsigned int ordered,
+  int (*consume)(void *data, struct cjson *node),
+  void *data,
+  struct cjson_hook *hook
+);
+
+/*** On-Demand ***/
+
+/* A buffer being read on demand (see cjson_od_doc_new). */
+struct cjson_od_doc;
+
+/* A value in an on-demand document. It is the position of the value's first
+ * byte in the buffer, so it is only valid as long as the buffer and document
+ * are.
+ */
+struct cjson_od {
+  struct cjson_od_doc *doc;
+  const char *at;
+};
+
+/* An iteration over the elements of an array or the pairs of an object. */
+struct cjson_od_iter {
+  struct cjson_od_doc *doc;
+  const char *at;
+  size_t count;
+};
+
+/* Begin reading the buffer on demand. Nothing is parsed up front. Values are
+ * read only when they are asked for and the values passed over on the way
+ * (e.g. the other fields of an object) are skipped by matching brackets, so
+ * they are not validated. The buffer must remain valid until the document is
+ * freed with cjson_od_doc_free.
+ */
+struct cjson_od_doc *
+cjson_od_doc_new(
+  const char *buf,
+  size_t length
+);
+
+/* Free the document. The buffer it was reading is not freed (it belongs to
+ * the caller). Every value and iterator from the document becomes invalid.
+ * Strings from cjson_od_get_string and nodes from cjson_od_get_node are
+ * copies, so they remain valid. If doc is NULL, nothing is done.
+ */
+void
+cjson_od_doc_free(
+  struct cjson_od_doc *doc
+);
+
+/* Return the root value of the document.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the document is empty.
+ */
+struct cjson_od
+cjson_od_root(
+  struct cjson_od_doc *doc
+);
+
+/* Return the type of the value from its first byte.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the value does not begin a JSON type.
+ */
+enum cjson_type
+cjson_od_type(
+  struct cjson_od *value
+);
+
+/* Find the value for the key (in JSON encoded string form as with
+ * cjson_object_get) in the object. The fields before it are skipped. Returns
+ * 1 and sets value if the key was found and 0 otherwise.
+ *
+ * Throws:
+ *
+ * CJSONX_TYPE
+ *  If the value is not a CJSON_OBJECT.
+ *
+ * CJSONX_PARSE
+ *  If the object is malformed.
+ */
+int
+cjson_od_find_field(
+  struct cjson_od *object,
+  const char *key,
+  struct cjson_od *value
+);
+
+/* Begin iterating over the array or object.
+ *
+ * Throws:
+ *
+ * CJSONX_TYPE
+ *  If the value is not a CJSON_ARRAY or CJSON_OBJECT.
+ */
+void
+cjson_od_iter(
+  struct cjson_od *container,
+  struct cjson_od_iter *iter
+);
+
+/* Set value to the next element of the array. Returns 0 when there are no
+ * more elements. Any part of the element the caller did not read is skipped.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the array is malformed.
+ */
+int
+cjson_od_array_next(
+  struct cjson_od_iter *iter,
+  struct cjson_od *value
+);
+
+/* Set key (a CJSON_STRING) and value to the next pair of the object. Returns
+ * 0 when there are no more pairs.
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the object is malformed.
+ */
+int
+cjson_od_object_next(
+  struct cjson_od_iter *iter,
+  struct cjson_od *key,
+  struct cjson_od *value
+);
+
+/* Read the number as with cjson_number_get_int64.
+ *
+ * Throws:
+ *
+ * CJSONX_TYPE
+ *  If the value is not a CJSON_NUMBER.
+ *
+ * CJSONX_PARSE
+ *  If the number is malformed.
+ *
+ * CJSONX_RANGE
+ *  If the value is not an integer or is outside the range of int64_t.
+ */
+int64_t
+cjson_od_get_int64(
+  struct cjson_od *value
+);
+
+/* Read the number as with cjson_number_get_uint64.
+ *
+ * Throws:
+ *
+ * CJSONX_TYPE
+ *  If the value is not a CJSON_NUMBER.
+ *
+ * CJSONX_PARSE
+ *  If the number is malformed.
+ *
+ * CJSONX_RANGE
+ *  If the value is not an integer or is outside the range of uint64_t.
+ */
+uint64_t
+cjson_od_get_uint64(
+  struct cjson_od *value
+);
+
+/* Read the number as with cjson_number_get_double.
+ *
+ * Throws:
+ *
+ * CJSONX_TYPE
+ *  If the value is not a CJSON_NUMBER.
+ *
+ * CJSONX_PARSE
+ *  If the number is malformed.
+ *
+ * CJSONX_RANGE
+ *  If the magnitude of the value is too large for a double.
+ */
+double
+cjson_od_get_double(
+  struct cjson_od *value,
+  int *exact
+);
+
+/* Read the boolean. Returns 1 for true and 0 for false.
+ *
+ * Throws:
+ *
+ * CJSONX_TYPE
+ *  If the value is not a CJSON_BOOLEAN.
+ *
+ * CJSONX_PARSE
+ *  If the boolean is malformed.
+ */
+unsigned int
+cjson_od_get_boolean(
+  struct cjson_od *value
+);
+
+/* Read the string as UTF-8. The string is null terminated and must be freed
+ * by the caller. If length is not NULL, it is set to the length of the string
+ * (which may contain null characters).
+ *
+ * Throws:
+ *
+ * CJSONX_TYPE
+ *  If the value is not a CJSON_STRING.
+ *
+ * CJSONX_PARSE
+ *  If the string is malformed.
+ */
+char *
+cjson_od_get_string(
+  struct cjson_od *value,
+  size_t *length
+);
+
+/* Parse the whole value into a node (e.g. to keep a subtree).
+ *
+ * Throws:
+ *
+ * CJSONX_PARSE
+ *  If the value is malformed.
+ */
+struct cjson *
+cjson_od_get_node(
+  struct cjson_od *value,
+  struct cjson *parent
+);
+
+/*** Validation ***/
+
+/* The result of cjson_validate. */
+struct cjson_validation {
+  size_t values;              /* The number of values (arrays and objects included). */
+  size_t depth;               /* The deepest nesting of arrays and objects. */
+  size_t bytes;               /* The number of bytes read (up to the error if invalid). */
+  char error[256];            /* Why the input is invalid (empty if it is valid). */
+};
+
+/* Check that the buffer of the given length contains a single document
+ * (surrounded only by whitespace) of one of the valid types. The checks are
+ * the same as those made by cjson_root_parse (including the UTF-8 and UTF-16
+ * escape checks, rejecting duplicate keys and the CJSON_MAX_DEPTH limit), but
+ * no nodes are built. Nothing is allocated unless the open objects have more
+ * keys than fit in a table on the stack (1024).
+ *
+ * Returns 1 if the document is valid and 0 otherwise. The result is filled in
+ * either way.
+ */
+int
+cjson_validate(
+  const char *buf,
+  size_t length,
+  enum cjson_type valid,
+  struct cjson_validation *result
+);
+
 #endif /* CJSON_H */
@@ -0,0 +1,147 @@
+/*** cjson allocator ***/
+
+/* Memory is allocated with the allocator from a node's hook (or from the heap
+ * when there is none). The memory a node owns is allocated from its arena
+ * instead if it has one.
+ */
+
+static
+void *
+allocator_malloc(struct cjson_allocator *allocator, size_t size)
+{
+  if (allocator == NULL) {
+    return ecx_malloc(size);
+  }
+
+  void *p = allocator->malloc(allocator->context, size);
+  if (p == NULL) {
+    ec_throw_strf(ECX_EC, "Failed to allocate %zu bytes.", size);
+  }
+
+  return p;
+}
+
+static
+void *
+allocator_realloc(struct cjson_allocator *allocator, void *p, size_t size)
+{
+  if (allocator == NULL) {
+    return ecx_realloc(p, size);
+  }
+
+  void *q = allocator->realloc(allocator->context, p, size);
+  if (q == NULL) {
+    ec_throw_strf(ECX_EC, "Failed to allocate %zu bytes.", size);
+  }
+
+  return q;
+}
+
+static
+void
+allocator_free(struct cjson_allocator *allocator, void *p)
+{
+  if (allocator == NULL) {
+    free(p);
+    return;
+  }
+
+  if (p != NULL) {
+    allocator->free(allocator->context, p);
+  }
+}
+
+/* Return the allocator of the hook (or NULL for the heap). */
+static inline
+struct cjson_allocator *
+hook_allocator(struct cjson_hook *hook)
+{
+  return hook != NULL ? hook->allocator : NULL;
+}
+
+/* The bits of a node's flags kept by the allocator (the types use the low
+ * bits).
+ */
+#define NODE_INLINE       0x80000000  /* The node's text is stored after it (see node_text). */
+#define NODE_INTERN       0x40000000  /* The node's text is in its hook's intern table. */
+#define NODE_CLASS_SHIFT  24          /* The slab class of the node (see slab_malloc). */
+#define NODE_CLASS_MASK   (0x0fu << NODE_CLASS_SHIFT)
+
+/* Where node_alloc got the node, so cjson_free releases it the same way
+ * whatever the hook has (or lacks) by then. Nodes without a source were
+ * allocated by the hook's cjson_malloc or by the caller.
+ */
+#define NODE_SOURCE_MASK  0x30000000
+#define NODE_SLAB         0x10000000  /* From slab_malloc (the class is set). */
+#define NODE_ARENA        0x20000000  /* From the hook's arena. */
+#define NODE_ALLOCATOR    0x30000000  /* From the hook's allocator. */
+
+/* The most text (including the null) stored after a node. */
+#define NODE_INLINE_MAX   24
+
+/* The size of the part of a node its type uses. Scalars without text leave
+ * the rest of the value union unallocated.
+ */
+static inline
+size_t
+node_size(enum cjson_type type)
+{
+  switch (type) {
+    case CJSON_ARRAY:
+      return offsetof(struct cjson, value) + sizeof(((struct cjson *)NULL)->value.array);
+    case CJSON_BOOLEAN:
+      return offsetof(struct cjson, value) + sizeof(((struct cjson *)NULL)->value.boolean);
+    case CJSON_NULL:
+      return offsetof(struct cjson, value);
+    case CJSON_ROOT:
+      return offsetof(struct cjson, value) + sizeof(((struct cjson *)NULL)->value.root);
+    default:
+      return sizeof(struct cjson);
+  }
+}
+
+/* Return where the node's text is stored when it is inline. */
+static inline
+char *
+node_text(struct cjson *node)
+{
+  return (char *)node + sizeof(*node);
+}
+
+/* Allocate memory owned by the node (e.g. a string's bytes). */
+static inline
+void *
+node_malloc(struct cjson *node, size_t size)
+{
+  if (node->hook != NULL &&
+      node->hook->arena != NULL) {
+    return arena_malloc(node->hook->arena, size);
+  }
+
+  return allocator_malloc(hook_allocator(node->hook), size);
+}
+
+/* Free memory owned by the node (allocated by node_malloc). */
+static inline
+void
+node_free(struct cjson *node, void *p)
+{
+  /* Interned text is shared with other nodes (even in an arena). */
+  if (node->flags & NODE_INTERN) {
+    intern_release(node->hook->intern, p);
+    return;
+  }
+
+  if (node->hook != NULL &&
+      node->hook->arena != NULL) {
+    return;
+  }
+
+  /* Inline text is released with the node. */
+  if ((node->flags & NODE_INLINE) &&
+      p == node_text(node)) {
+    return;
+  }
+
+  allocator_free(hook_allocator(node->hook), p);
+}
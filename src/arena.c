@@ -0,0 +1,104 @@
+/*** cjson arena ***/
+
+/* An arena hands out memory by bumping a cursor through a chunk and never
+ * frees it piece by piece. When a chunk is used up, a larger one is allocated
+ * (up to ARENA_CHUNK_MAX). Everything is released at once by cjson_arena_free.
+ */
+
+/* The alignment of every allocation. */
+#define ARENA_ALIGN 16
+
+/* The sizes of the chunks allocated from the heap. */
+#define ARENA_CHUNK_MIN 4096
+#define ARENA_CHUNK_MAX (1024 * 1024)
+
+#define arena_align(n) (((n) + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct arena_chunk {
+  struct arena_chunk *next;
+  size_t size;                /* The size of the chunk (including this header). */
+};
+
+struct cjson_arena {
+  uint8_t *cursor;
+  uint8_t *end;
+  struct arena_chunk *chunks; /* The chunks allocated from the heap (newest first). */
+  size_t next;                /* The size of the next chunk. */
+  unsigned int heap;          /* The arena itself was allocated from the heap. */
+};
+
+struct cjson_arena *
+cjson_arena_new(void *buf, size_t size)
+{
+  struct cjson_arena *arena = NULL;
+
+  /* Use the buffer for the arena itself when it fits. */
+  uintptr_t start = arena_align((uintptr_t)buf);
+  if (buf != NULL &&
+      start + arena_align(sizeof(*arena)) <= (uintptr_t)buf + size) {
+    arena = (struct cjson_arena *)start;
+    arena->cursor = (uint8_t *)(start + arena_align(sizeof(*arena)));
+    arena->end = (uint8_t *)buf + size;
+    arena->heap = 0;
+  }
+  else {
+    arena = ecx_malloc(sizeof(*arena));
+    arena->cursor = NULL;
+    arena->end = NULL;
+    arena->heap = 1;
+  }
+
+  arena->chunks = NULL;
+  arena->next = ARENA_CHUNK_MIN;
+
+  return arena;
+}
+
+void
+cjson_arena_free(struct cjson_arena *arena)
+{
+  if (arena == NULL) {
+    return;
+  }
+
+  while (arena->chunks != NULL) {
+    struct arena_chunk *next = arena->chunks->next;
+    free(arena->chunks);
+    arena->chunks = next;
+  }
+
+  if (arena->heap) {
+    free(arena);
+  }
+}
+
+static
+void *
+arena_malloc(struct cjson_arena *arena, size_t size)
+{
+  size = arena_align(size);
+
+  if ((size_t)(arena->end - arena->cursor) < size) {
+    size_t header = arena_align(sizeof(struct arena_chunk));
+    size_t chunk_size = arena->next;
+    if (chunk_size < header + size) {
+      chunk_size = header + size;
+    }
+
+    struct arena_chunk *chunk = ecx_malloc(chunk_size);
+    chunk->next = arena->chunks;
+    chunk->size = chunk_size;
+    arena->chunks = chunk;
+    arena->cursor = (uint8_t *)chunk + header;
+    arena->end = (uint8_t *)chunk + chunk_size;
+
+    if (arena->next < ARENA_CHUNK_MAX) {
+      arena->next *= 2;
+    }
+  }
+
+  void *p = arena->cursor;
+  arena->cursor += size;
+
+  return p;
+}
@@ -1,7 +1,8 @@
 /*** cjson array ***/
 
+static
 struct cjson *
-cjson_array_fscan(FILE *stream, struct cjson *parent)
+array_scan(struct scan *s, struct cjson *parent)
 {
   struct cjson *node = cjson_malloc(CJSON_ARRAY, parent);
   ec_with_on_x(node, (ec_unwind_f)cjson_free) {
@@ -36,67 +37,69 @@ cjson_array_fscan(FILE *stream, struct cjson *parent)
 
     void **go = go_array;
 
-    current = ecx_fgetc(stream);
+    current = scan_getc(s);
     if (current != '[') {
-      cjsonx_parse_c(stream, current, "Unable to find array to parse; Expecting '['.");
+      scanx_parse_c(s, current, "Unable to find array to parse; Expecting '['.");
     }
+    scan_enter(s, node->hook, current);
 
-    for (current = ecx_fgetc(stream); current != EOF; errno = 0, current = ecx_fgetc(stream)) {
+    for (current = scan_getc(s); current != EOF; current = scan_getc(s)) {
       goto *go[current];
 l_loop:;
     }
 
-    cjsonx_parse_c(stream, current, "Expecting more data; Incomplete array.");
+    scanx_parse_c(s, current, "Expecting more data; Incomplete array.");
 
 l_invalid:
-    cjsonx_parse_c(stream, current, "Expecting to find a JSON type to parse.");
+    scanx_parse_c(s, current, "Expecting to find a JSON type to parse.");
 
 l_whitespace:
+    scan_skip_whitespace(s);
     goto l_loop;
 
 l_array:
-    ecx_ungetc(current, stream);
-    child = cjson_array_fscan(stream, node);
+    scan_ungetc(s, current);
+    child = array_scan(s, node);
     ec_with_on_x(child, (ec_unwind_f)cjson_free) {
       cjson_array_append(node, child);
     }
     goto l_loop;
 
 l_number:
-    ecx_ungetc(current, stream);
-    child = cjson_number_fscan(stream, node);
+    scan_ungetc(s, current);
+    child = number_scan(s, node);
     ec_with_on_x(child, (ec_unwind_f)cjson_free) {
       cjson_array_append(node, child);
     }
     goto l_loop;
 
 l_object:
-    ecx_ungetc(current, stream);
-    child = cjson_object_fscan(stream, node);
+    scan_ungetc(s, current);
+    child = object_scan(s, node);
     ec_with_on_x(child, (ec_unwind_f)cjson_free) {
       cjson_array_append(node, child);
     }
     goto l_loop;
 
 l_string:
-    ecx_ungetc(current, stream);
-    child = cjson_string_fscan(stream, node);
+    scan_ungetc(s, current);
+    child = string_scan(s, node);
     ec_with_on_x(child, (ec_unwind_f)cjson_free) {
       cjson_array_append(node, child);
     }
     goto l_loop;
 
 l_boolean:
-    ecx_ungetc(current, stream);
-    child = cjson_boolean_fscan(stream, node);
+    scan_ungetc(s, current);
+    child = boolean_scan(s, node);
     ec_with_on_x(child, (ec_unwind_f)cjson_free) {
       cjson_array_append(node, child);
     }
     goto l_loop;
 
 l_null:
-    ecx_ungetc(current, stream);
-    child = cjson_null_fscan(stream, node);
+    scan_ungetc(s, current);
+    child = null_scan(s, node);
     ec_with_on_x(child, (ec_unwind_f)cjson_free) {
       cjson_array_append(node, child);
     }
@@ -104,7 +107,7 @@ l_null:
 
 l_array_continue:
     if (child == NULL) {
-      cjsonx_parse_c(stream, current, "Array value was not specified.");
+      scanx_parse_c(s, current, "Array value was not specified.");
     }
     else {
       child = NULL;
@@ -114,8 +117,9 @@ l_array_continue:
 
 l_array_finish:
     if (continued && child == NULL) {
-      cjsonx_parse_c(stream, current, "Array value was not specified.");
+      scanx_parse_c(s, current, "Array value was not specified.");
     }
+    scan_leave(s);
 
     if (node->hook &&
         node->hook->valid) {
@@ -126,6 +130,28 @@ l_array_finish:
   return node;
 }
 
+struct cjson *
+cjson_array_fscan(FILE *stream, struct cjson *parent)
+{
+  struct cjson *node = NULL;
+  uint8_t block[SCAN_BLOCK];
+  struct scan scan, *s = &scan;
+  scan_fopen(s, stream, block, sizeof(block), 0);
+  ec_with(s, (ec_unwind_f)scan_fclose) {
+    node = array_scan(s, parent);
+  }
+
+  return node;
+}
+
+struct cjson *
+cjson_array_parse(const char *buf, size_t length, struct cjson *parent)
+{
+  struct scan scan, *s = &scan;
+  scan_mopen(s, buf, length);
+  return array_scan(s, parent);
+}
+
 void
 cjson_array_fprint(FILE *stream, struct cjson *node)
 {
@@ -1,31 +1,43 @@
 /*** cjson boolean ***/
 
+/* Read 'true' or 'false'. Return 1 for true and 0 for false. */
+static
+unsigned int
+boolean_scan_token(struct scan *s)
+{
+  unsigned int boolean = 0;
+
+  int current = scan_getc(s);
+  if (current == 't') {
+    if ((current = scan_getc(s)) != 'r') { scanx_parse_c(s, current, "Parsing 'true': Expecting 'r'.") };
+    if ((current = scan_getc(s)) != 'u') { scanx_parse_c(s, current, "Parsing 'true': Expecting 'u'.") };
+    if ((current = scan_getc(s)) != 'e') { scanx_parse_c(s, current, "Parsing 'true': Expecting 'e'.") };
+    boolean = 1;
+  }
+  else if (current == 'f') {
+    if ((current = scan_getc(s)) != 'a') { scanx_parse_c(s, current, "Parsing 'false': Expecting 'a'.") };
+    if ((current = scan_getc(s)) != 'l') { scanx_parse_c(s, current, "Parsing 'false': Expecting 'l'.") };
+    if ((current = scan_getc(s)) != 's') { scanx_parse_c(s, current, "Parsing 'false': Expecting 's'.") };
+    if ((current = scan_getc(s)) != 'e') { scanx_parse_c(s, current, "Parsing 'false': Expecting 'e'.") };
+    boolean = 0;
+  }
+  else if (current == EOF) {
+    scanx_parse_more(s, "Failed to find boolean to parse.");
+  }
+  else {
+    scanx_parse_c(s, current, "Expecting either 't' or 'f' to begin parsing 'true' or 'false'.");
+  }
+
+  return boolean;
+}
+
+static
 struct cjson *
-cjson_boolean_fscan(FILE *stream, struct cjson *parent)
+boolean_scan(struct scan *s, struct cjson *parent)
 {
   struct cjson *node = cjson_malloc(CJSON_BOOLEAN, parent);
   ec_with_on_x(node, (ec_unwind_f)cjson_free) {
-    int current = ecx_fgetc(stream);
-    if (current == 't') {
-      if ((current = ecx_fgetc(stream)) != 'r') { cjsonx_parse_c(stream, current, "Parsing 'true': Expecting 'r'.") };
-      if ((current = ecx_fgetc(stream)) != 'u') { cjsonx_parse_c(stream, current, "Parsing 'true': Expecting 'u'.") };
-      if ((current = ecx_fgetc(stream)) != 'e') { cjsonx_parse_c(stream, current, "Parsing 'true': Expecting 'e'.") };
-      node->value.boolean = 1;
-    }
-    else if (current == 'f') {
-      if ((current = ecx_fgetc(stream)) != 'a') { cjsonx_parse_c(stream, current, "Parsing 'false': Expecting 'a'.") };
-      if ((current = ecx_fgetc(stream)) != 'l') { cjsonx_parse_c(stream, current, "Parsing 'false': Expecting 'l'.") };
-      if ((current = ecx_fgetc(stream)) != 's') { cjsonx_parse_c(stream, current, "Parsing 'false': Expecting 's'.") };
-      if ((current = ecx_fgetc(stream)) != 'e') { cjsonx_parse_c(stream, current, "Parsing 'false': Expecting 'e'.") };
-      node->value.boolean = 0;
-    }
-    else if (current == EOF) {
-      ec_throw_str_static(CJSONX_PARSE, "Expecting more data; Failed to find boolean to parse.");
-    }
-    else {
-l_invalid:
-      cjsonx_parse_c(stream, current, "Expecting either 't' or 'f' to begin parsing 'true' or 'false'.");
-    }
+    node->value.boolean = boolean_scan_token(s);
 
     if (node->hook &&
         node->hook->valid) {
@@ -36,6 +48,28 @@ l_invalid:
   return node;
 }
 
+struct cjson *
+cjson_boolean_fscan(FILE *stream, struct cjson *parent)
+{
+  struct cjson *node = NULL;
+  uint8_t block[SCAN_BLOCK];
+  struct scan scan, *s = &scan;
+  scan_fopen(s, stream, block, sizeof(block), 0);
+  ec_with(s, (ec_unwind_f)scan_fclose) {
+    node = boolean_scan(s, parent);
+  }
+
+  return node;
+}
+
+struct cjson *
+cjson_boolean_parse(const char *buf, size_t length, struct cjson *parent)
+{
+  struct scan scan, *s = &scan;
+  scan_mopen(s, buf, length);
+  return boolean_scan(s, parent);
+}
+
 void
 cjson_boolean_fprint(FILE *stream, struct cjson *node)
 {
@@ -0,0 +1,534 @@
+/*** cjson builder ***/
+
+/* The builder parses documents with a single loop over an explicit stack of
+ * the open containers instead of recursing through the node parsers. As with
+ * the node parsers, a node is only added to its container once it is complete,
+ * so the hooks see the same calls. Everything that isn't in the tree yet (the
+ * open containers, the pairs waiting for values, the last node read and the
+ * token buffer) is held by the builder and freed by build_free, so no cleanup
+ * is registered for each node. The nesting depth is limited by the hook's
+ * max_depth (see scan_max_depth), not by the C stack.
+ */
+
+/* The depth of the stack that doesn't need to be allocated. */
+#define BUILD_STACK 64
+
+struct build_frame {
+  struct cjson *node;         /* The open array or object. */
+  struct cjson *pair;         /* The pair waiting for its value (objects only). */
+};
+
+struct build {
+  struct build_frame *stack;
+  size_t depth;               /* The number of open containers. */
+  size_t size;                /* The capacity of the stack. */
+  size_t max_depth;           /* The most containers that may be open. */
+  struct build_frame storage[BUILD_STACK];
+
+  struct cjson *node;         /* The node waiting to be added to its container. */
+  struct scan_buffer buffer;  /* The current string, key or number. */
+  unsigned int expected;      /* The tokens accepted in the current state (enum cjson_expect). */
+};
+
+static
+void
+build_init(struct build *x, struct cjson_hook *hook)
+{
+  x->stack = x->storage;
+  x->depth = 0;
+  x->size = BUILD_STACK;
+  x->max_depth = scan_max_depth(hook);
+
+  x->node = NULL;
+  x->buffer = (struct scan_buffer)SCAN_BUFFER_INIT(hook_allocator(hook));
+  x->expected = 0;
+}
+
+static
+void
+build_free(struct build *x)
+{
+  while (x->depth != 0) {
+    x->depth--;
+    cjson_free(x->stack[x->depth].pair);
+    cjson_free(x->stack[x->depth].node);
+  }
+
+  if (x->stack != x->storage) {
+    allocator_free(x->buffer.allocator, x->stack);
+  }
+  x->stack = x->storage;
+  x->size = BUILD_STACK;
+
+  cjson_free(x->node);
+  x->node = NULL;
+
+  scan_buffer_free(&x->buffer);
+}
+
+/* Make room to push another container (opened by c). */
+static inline
+void
+build_grow(struct build *x, struct scan *s, int c)
+{
+  if (x->depth == x->max_depth) {
+    scan_depth_error(s, x->max_depth, c);
+  }
+
+  if (x->depth == x->size) {
+    struct build_frame *stack = allocator_malloc(x->buffer.allocator, x->size * 2 * sizeof(*stack));
+    memcpy(stack, x->stack, x->depth * sizeof(*stack));
+    if (x->stack != x->storage) {
+      allocator_free(x->buffer.allocator, x->stack);
+    }
+    x->stack = stack;
+    x->size *= 2;
+  }
+}
+
+#define build_go(g,e) \
+  go = (g); \
+  x->expected = (e); \
+
+/* Bare items (those not in a container) must be one of the valid types. */
+#define build_valid(s,c,t,m) \
+  if (x->depth == 0 && (valid & (t)) == 0) { \
+    if ((s)->error != NULL) { \
+      scan_error((s), CJSON_ERROR_TYPE, (c), m); \
+    } \
+    ec_throw_str_static(CJSONX_PARSE, m); \
+  } \
+
+#define build_hook_valid(n) \
+  if ((n)->hook && \
+      (n)->hook->valid) { \
+    (n)->hook->valid(n); \
+  } \
+
+/* Parse the documents in the scan and add them to the root. */
+static
+void
+build_scan(struct build *x, struct scan *s, enum cjson_type valid, unsigned int continuous, struct cjson *root)
+{
+  int current = 0;
+  struct cjson *parent = root;    /* The parent of the next value. */
+  struct build_frame *top = NULL;
+
+  static void *go_value[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    ['['] = &&l_array,
+
+    ['-']       = &&l_number,
+    [48 ... 57] = &&l_number,
+
+    ['{'] = &&l_object,
+
+    ['"'] = &&l_string,
+
+    ['t'] = &&l_boolean,
+    ['f'] = &&l_boolean,
+    ['n'] = &&l_null,
+  };
+
+  static void *go_root_next[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_root_next,
+    ['\n'] = &&l_root_next,
+  };
+
+  static void *go_array_first[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    ['['] = &&l_array,
+
+    ['-']       = &&l_number,
+    [48 ... 57] = &&l_number,
+
+    ['{'] = &&l_object,
+
+    ['"'] = &&l_string,
+
+    ['t'] = &&l_boolean,
+    ['f'] = &&l_boolean,
+    ['n'] = &&l_null,
+
+    [']'] = &&l_array_end,
+  };
+
+  static void *go_array_next[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    [','] = &&l_array_next,
+    [']'] = &&l_array_end,
+  };
+
+  static void *go_object_first[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    ['"'] = &&l_key,
+    ['}'] = &&l_object_end,
+  };
+
+  static void *go_object_key[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    ['"'] = &&l_key,
+  };
+
+  static void *go_object_colon[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    [':'] = &&l_object_colon,
+  };
+
+  static void *go_object_next[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    [','] = &&l_object_next,
+    ['}'] = &&l_object_end,
+  };
+
+  void **go = NULL;
+  build_go(go_value, CJSON_EXPECT_VALUE);
+
+  current = scan_getc(s);
+  for (; current != EOF; current = scan_getc(s)) {
+    goto *go[current];
+l_loop:;
+  }
+
+  if (x->depth != 0) {
+    if (x->stack[x->depth - 1].node->type == CJSON_ARRAY) {
+      scanx_parse_more(s, "Incomplete array.");
+    }
+    scanx_parse_more(s, "Incomplete object.");
+  }
+
+  goto l_finish;
+
+l_invalid:
+  scanx_parse_c(s, current, "Expecting to find a JSON type to parse.");
+
+l_whitespace:
+  /* Line breaks separate documents, so they are only skipped inside them. */
+  if (go != go_root_next) {
+    scan_skip_whitespace(s);
+  }
+  goto l_loop;
+
+l_array:
+  build_valid(s, current, CJSON_ARRAY, "Found an array, but it is not a valid type for a bare item.");
+  build_grow(x, s, current);
+  top = &x->stack[x->depth];
+  top->node = cjson_malloc(CJSON_ARRAY, parent);
+  top->pair = NULL;
+  x->depth++;
+  parent = top->node;
+  build_go(go_array_first, CJSON_EXPECT_VALUE | CJSON_EXPECT_ARRAY_END);
+  goto l_loop;
+
+l_array_next:
+  build_go(go_value, CJSON_EXPECT_VALUE);
+  goto l_loop;
+
+l_array_end:
+  x->depth--;
+  x->node = x->stack[x->depth].node;
+  build_hook_valid(x->node);
+  goto l_value_end;
+
+l_object:
+  build_valid(s, current, CJSON_OBJECT, "Found an object, but it is not a valid type for a bare item.");
+  build_grow(x, s, current);
+  top = &x->stack[x->depth];
+  top->node = cjson_malloc(CJSON_OBJECT, parent);
+  top->pair = NULL;
+  x->depth++;
+  build_go(go_object_first, CJSON_EXPECT_KEY | CJSON_EXPECT_OBJECT_END);
+  goto l_loop;
+
+l_key:
+  x->expected = 0;
+  scan_ungetc(s, current);
+  x->buffer.length = 0;
+  jestr_scanb(s, &x->buffer, 0);
+
+  top = &x->stack[x->depth - 1];
+  if (cjson_object_get(top->node, x->buffer.bytes) != NULL) {
+    if (s->error != NULL) {
+      scan_error(s, CJSON_ERROR_DUPLICATE, '"', "Invalid duplicate key.");
+    }
+    ec_throw_strf(CJSONX_PARSE, "Invalid duplicate key at %ld: \"%s\".", scan_tell(s), x->buffer.bytes);
+  }
+
+  scan_buffer_node_into(&x->buffer, CJSON_PAIR, top->node, &top->pair);
+  parent = top->pair;
+  build_go(go_object_colon, CJSON_EXPECT_COLON);
+  goto l_loop;
+
+l_object_colon:
+  build_go(go_value, CJSON_EXPECT_VALUE);
+  goto l_loop;
+
+l_object_next:
+  build_go(go_object_key, CJSON_EXPECT_KEY);
+  goto l_loop;
+
+l_object_end:
+  x->depth--;
+  x->node = x->stack[x->depth].node;
+  build_hook_valid(x->node);
+  goto l_value_end;
+
+l_string:
+  build_valid(s, current, CJSON_STRING, "Found a string, but it is not a valid type for a bare item.");
+  x->expected = 0;
+  scan_ungetc(s, current);
+  x->buffer.length = 0;
+  jestr_scanb(s, &x->buffer, 1);
+  scan_buffer_node_into(&x->buffer, CJSON_STRING, parent, &x->node);
+  build_hook_valid(x->node);
+  goto l_value_end;
+
+l_number:
+  build_valid(s, current, CJSON_NUMBER, "Found a number, but it is not a valid type for a bare item.");
+  x->expected = 0;
+  scan_ungetc(s, current);
+  x->buffer.length = 0;
+  number_scanb(s, &x->buffer);
+  scan_buffer_node_into(&x->buffer, CJSON_NUMBER, parent, &x->node);
+  build_hook_valid(x->node);
+  goto l_value_end;
+
+l_boolean:
+  build_valid(s, current, CJSON_BOOLEAN, "Found a boolean, but it is not a valid type for a bare item.");
+  x->expected = 0;
+  scan_ungetc(s, current);
+  {
+    unsigned int boolean = boolean_scan_token(s);
+    x->node = cjson_malloc(CJSON_BOOLEAN, parent);
+    x->node->value.boolean = boolean;
+  }
+  build_hook_valid(x->node);
+  goto l_value_end;
+
+l_null:
+  build_valid(s, current, CJSON_NULL, "Found a null, but it is not a valid type for a bare item.");
+  x->expected = 0;
+  scan_ungetc(s, current);
+  null_scan_token(s);
+  x->node = cjson_malloc(CJSON_NULL, parent);
+  build_hook_valid(x->node);
+  goto l_value_end;
+
+l_value_end:
+  /* Add the node to its container. */
+  if (x->depth == 0) {
+    cjson_array_append(root, x->node);
+    x->node = NULL;
+    parent = root;
+    build_go(go_root_next, CJSON_EXPECT_END);
+    goto l_loop;
+  }
+
+  top = &x->stack[x->depth - 1];
+  if (top->node->type == CJSON_ARRAY) {
+    cjson_array_append(top->node, x->node);
+    x->node = NULL;
+    parent = top->node;
+    build_go(go_array_next, CJSON_EXPECT_COMMA | CJSON_EXPECT_ARRAY_END);
+    goto l_loop;
+  }
+
+  top->pair->value.pair.value = x->node;
+  x->node = NULL;
+  build_hook_valid(top->pair);
+  cjson_object_set(top->node, top->pair);
+  top->pair = NULL;
+  build_go(go_object_next, CJSON_EXPECT_COMMA | CJSON_EXPECT_OBJECT_END);
+  goto l_loop;
+
+l_root_next:
+  if (continuous != 0) {
+    build_go(go_value, CJSON_EXPECT_VALUE);
+    goto l_loop;
+  }
+  goto l_finish;
+
+l_finish:
+  build_hook_valid(root);
+}
+
+/* Parse the documents in the scan into a CJSON_ROOT. */
+static
+struct cjson *
+build_root(struct build *x, struct scan *s, enum cjson_type valid, unsigned int continuous, struct cjson_hook *hook)
+{
+  struct cjson *node = root_malloc(hook);
+
+  ec_with(x, (ec_unwind_f)build_free) {
+    ec_with_on_x(node, (ec_unwind_f)cjson_free) {
+      build_scan(x, s, valid, continuous, node);
+    }
+  }
+
+  return node;
+}
+
+/* Parse the documents in the scan into a CJSON_ROOT. If the parse fails, the
+ * error is recorded and NULL is returned.
+ */
+static
+struct cjson *
+build_try(struct scan *s, enum cjson_type valid, unsigned int continuous, struct cjson_hook *hook, struct cjson_error *error)
+{
+  error->code = CJSON_ERROR_NONE;
+  error->offset = 0;
+  error->line = 0;
+  error->column = 0;
+  error->expected = 0;
+  error->character = EOF;
+  error->reason = NULL;
+  s->error = error;
+
+  struct cjson * volatile node = NULL;
+
+  struct build state, *x = &state;
+  build_init(x, hook);
+  ec_try {
+    node = build_root(x, s, valid, continuous, hook);
+  } ec_catch_a(CJSONX_PARSE, (const char *){NULL}) {
+    /* The error is reported from the scan, so the message is dropped (into
+     * a compound literal rather than an unused variable).
+     */
+    if (error->code == CJSON_ERROR_NONE) {
+      error->code = CJSON_ERROR_SYNTAX;
+      error->offset = scan_tell(s);
+      error->reason = "Failed to parse the document.";
+    }
+    error->expected = x->expected;
+  }
+
+  return node;
+}
+
+struct cjson *
+cjson_root_try_fscan(FILE *stream, enum cjson_type valid, unsigned int continuous, struct cjson_hook *hook, struct cjson_error *error)
+{
+  struct cjson *node = NULL;
+  uint8_t block[SCAN_BLOCK];
+  struct scan scan, *s = &scan;
+  scan_fopen(s, stream, block, sizeof(block), continuous);
+  ec_with(s, (ec_unwind_f)scan_fclose) {
+    node = build_try(s, valid, continuous, hook, error);
+  }
+
+  return node;
+}
+
+struct cjson *
+cjson_root_try_parse(const char *buf, size_t length, enum cjson_type valid, unsigned int continuous, struct cjson_hook *hook, struct cjson_error *error)
+{
+  struct scan scan, *s = &scan;
+  scan_mopen(s, buf, length);
+  return build_try(s, valid, continuous, hook, error);
+}
+
+int
+cjson_error_format(const struct cjson_error *error, char *buf, size_t size)
+{
+  static const char *codes[] = {
+    [CJSON_ERROR_NONE]      = "No error",
+    [CJSON_ERROR_SYNTAX]    = "Invalid character",
+    [CJSON_ERROR_TRUNCATED] = "Expecting more data",
+    [CJSON_ERROR_ENCODING]  = "Invalid character encoding",
+    [CJSON_ERROR_DUPLICATE] = "Invalid duplicate key",
+    [CJSON_ERROR_TYPE]      = "Invalid type for a bare item",
+    [CJSON_ERROR_DEPTH]     = "Exceeded the maximum depth",
+  };
+
+  static const char *tokens[] = {
+    "a value", "a key", "':'", "','", "']'", "'}'", "the end of the document",
+  };
+
+  size_t length = 0;
+
+#define error_append(...) \
+  length += snprintf(buf + (length < size ? length : size), length < size ? size - length : 0, __VA_ARGS__); \
+
+  error_append("%s at %ld", codes[error->code], error->offset);
+
+  if (error->line != 0) {
+    error_append(" (line %ld, column %ld)", error->line, error->column);
+  }
+
+  if (error->code == CJSON_ERROR_SYNTAX || error->code == CJSON_ERROR_DUPLICATE || error->code == CJSON_ERROR_TYPE || error->code == CJSON_ERROR_DEPTH) {
+    if (error->character >= ' ' && error->character < 0x7F) {
+      error_append(": %" PRIx64 " '%c'", (uint64_t)error->character, (int)error->character);
+    }
+    else {
+      error_append(": %" PRIx64, (uint64_t)error->character);
+    }
+  }
+  else if (error->code == CJSON_ERROR_ENCODING) {
+    error_append(": %" PRIx64, (uint64_t)error->character);
+  }
+
+  if (error->reason != NULL) {
+    error_append(": %s", error->reason);
+  }
+
+  /* List the expected tokens (e.g. " Expecting ',' or ']'."). */
+  unsigned int expected = error->expected;
+  const char *separator = " Expecting ";
+  for (size_t i = 0; i < sizeof(tokens) / sizeof(tokens[0]); i++) {
+    if (expected & (1u << i)) {
+      expected &= ~(1u << i);
+      error_append("%s%s%s", separator, tokens[i], expected == 0 ? "." : "");
+      separator = (expected & (expected - 1)) == 0 ? " or " : ", ";
+    }
+  }
+
+#undef error_append
+
+  return length;
+}
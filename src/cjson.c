@@ -4,9 +4,20 @@
 #include <ecx_stdio.h>
 #include <ecx_stdlib.h>
 #include <errno.h>
-#include <regex.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <type.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #include <cjson.h>
 
@@ -16,6 +27,7 @@ const char CJSONX_PARSE[] = "cjson:parse";
 const char CJSONX_TYPE[] = "cjson:type";
 const char CJSONX_INDEX[] = "cjson:index";
 const char CJSONX_NOT_FOUND[] = "cjson:not found";
+const char CJSONX_RANGE[] = "cjson:range";
 
 #define xstr(s) str(s)
 #define str(s) #s
@@ -36,12 +48,20 @@ const char CJSONX_NOT_FOUND[] = "cjson:not found";
 #define cjsonx_parse_u(s,u,m,...) \
   ec_throw_strf(CJSONX_PARSE, "Invalid character at %ld: %" PRIx64 ": " m, ftell(s), (u), ##__VA_ARGS__); \
 
+static void intern_release(struct cjson_intern *intern, char *bytes);
+
+#include "arena.c"
+#include "allocator.c"
+#include "intern.c"
+#include "slab.c"
+
 /*** cjson creation ***/
 
 void
 cjson_init(struct cjson *node, enum cjson_type type, struct cjson *parent)
 {
   node->type = type;
+  node->flags = 0;
   node->parent = parent;
 
   if (parent != NULL && parent->hook != NULL) {
@@ -81,22 +101,55 @@ cjson_init(struct cjson *node, enum cjson_type type, struct cjson *parent)
   }
 }
 
+/* Allocate size bytes (see node_size) for a node of the type with the hook
+ * and initialize it.
+ */
 static
 struct cjson *
-cjson_malloc(enum cjson_type type, struct cjson *parent)
+node_alloc(enum cjson_type type, struct cjson *parent, struct cjson_hook *hook, size_t size)
 {
   struct cjson *node = NULL;
+  unsigned int flags = 0;
 
-  if (parent != NULL &&
-      parent->hook != NULL &&
-      parent->hook->cjson_malloc != NULL) {
-      node = parent->hook->cjson_malloc(type, parent);
+  if (hook != NULL &&
+      hook->arena != NULL) {
+    node = arena_malloc(hook->arena, size);
+    flags = NODE_ARENA;
+  }
+  else if (hook != NULL &&
+      hook->cjson_malloc != NULL) {
+    node = hook->cjson_malloc(type, parent);
+  }
+  else if (hook_allocator(hook) != NULL) {
+    node = allocator_malloc(hook->allocator, size);
+    flags = NODE_ALLOCATOR;
   }
   else {
-    node = ecx_malloc(sizeof(*node));
+    unsigned int class = slab_class(size);
+    node = slab_malloc(class);
+    flags = NODE_SLAB | class << NODE_CLASS_SHIFT;
   }
 
   cjson_init(node, type, parent);
+  node->flags = flags;
+
+  return node;
+}
+
+static
+struct cjson *
+cjson_malloc(enum cjson_type type, struct cjson *parent)
+{
+  return node_alloc(type, parent, parent != NULL ? parent->hook : NULL, node_size(type));
+}
+
+/* Allocate a CJSON_ROOT for nodes using the hook. */
+static
+struct cjson *
+root_malloc(struct cjson_hook *hook)
+{
+  struct cjson *node = node_alloc(CJSON_ROOT, NULL, hook, node_size(CJSON_ROOT));
+  node->hook = hook;
 
   return node;
 }
@@ -129,7 +182,7 @@ cjson_free(struct cjson *node)
     case CJSON_NULL:
       break;
     case CJSON_NUMBER:
-      free(node->value.number);
+      node_free(node, node->value.number);
       break;
     case CJSON_OBJECT:
       {
@@ -149,7 +202,7 @@ cjson_free(struct cjson *node)
       }
       break;
     case CJSON_PAIR:
-      free(node->value.pair.key);
+      node_free(node, node->value.pair.key);
       cjson_free(node->value.pair.value);
       break;
     case CJSON_ROOT:
@@ -168,16 +221,29 @@ cjson_free(struct cjson *node)
       }
       break;
     case CJSON_STRING:
-      free(node->value.string.bytes);
+      node_free(node, node->value.string.bytes);
       break;
   }
 
-  if (node->hook != NULL &&
-      node->hook->cjson_free != NULL) {
-      node->hook->cjson_free(node);
-  }
-  else {
-    free(node);
+  switch (node->flags & NODE_SOURCE_MASK) {
+    case NODE_ARENA:
+      /* Nodes in an arena are released with it. */
+      break;
+    case NODE_ALLOCATOR:
+      allocator_free(node->hook->allocator, node);
+      break;
+    case NODE_SLAB:
+      slab_free(node);
+      break;
+    default:
+      if (node->hook != NULL &&
+          node->hook->cjson_free != NULL) {
+        node->hook->cjson_free(node);
+      }
+      else {
+        free(node);
+      }
+      break;
   }
 }
 
@@ -394,12 +460,33 @@ cjson_walk(struct cjson *self, int (*call)(void *data, struct cjson *node), void
 
 /*** cjson data handlers. ***/
 
+#include "index.c"
+#include "scan.c"
+#include "ryu.c"
+
+static struct cjson *array_scan(struct scan *s, struct cjson *parent);
+static struct cjson *boolean_scan(struct scan *s, struct cjson *parent);
+static struct cjson *null_scan(struct scan *s, struct cjson *parent);
+static struct cjson *number_scan(struct scan *s, struct cjson *parent);
+static struct cjson *object_scan(struct scan *s, struct cjson *parent);
+static struct cjson *pair_scan(struct scan *s, struct cjson *parent);
+static struct cjson *string_scan(struct scan *s, struct cjson *parent);
+
+static size_t u8_encode(const uint32_t u, uint8_t bytes[4]);
+static size_t u8_valid(const uint8_t *p, const uint8_t *end);
+static int64_t u8_scanu(struct scan *s);
+static int64_t u16e_scanu(struct scan *s);
+static int64_t jestr_scanu(struct scan *s);
+static void jestr_scanb(struct scan *s, struct scan_buffer *out, unsigned int decode);
+static char *jestr_scan(struct scan *s);
+
 #include "array.c"
 #include "boolean.c"
 #include "null.c"
 #include "number.c"
 #include "object.c"
 #include "pair.c"
+#include "build.c"
 #include "root.c"
 
 #include "u8.c"
@@ -407,29 +494,10 @@ cjson_walk(struct cjson *self, int (*call)(void *data, struct cjson *node), void
 #include "jestr.c"
 #include "string.c"
 
-/*** cjson library initialization. ***/
-
-static void __attribute__ ((constructor))
-libcjson_init(void)
-{
-  int status = 0;
-
-  /* Compile number regex. */
-  if (number_regex == NULL) {
-    status = regcomp(&number_regex_storage, number_pattern, REG_EXTENDED);
-    if (status != 0) {
-      ec_throw_str_static(ECX_EC, "Failed to compile number regex.");
-    }
-
-    number_regex = &number_regex_storage;
-  }
-}
-
-static void __attribute__ ((destructor))
-libcjson_fini(void)
-{
-  if (number_regex != NULL) {
-    regfree(number_regex);
-    number_regex = NULL;
-  }
-}
+#include "sax.c"
+#include "pipeline.c"
+#include "parallel.c"
+#include "od.c"
+#include "project.c"
+#include "stream.c"
+#include "validate.c"
@@ -0,0 +1,383 @@
+/*** cjson structural index ***/
+
+/* The structural index is a first pass over the input of a memory scan. It
+ * classifies the input 64 bytes at a time and marks the position of every
+ * token that is outside of a string (the structural characters '{', '}', '[',
+ * ']', ':' and ',', the first byte of any other value and the quotes that
+ * open strings) along with the quotes that close strings. Quotes that are
+ * escaped by a backslash do not open or close strings.
+ *
+ * Since every byte between two marked positions is either whitespace or part
+ * of a string, the index finds the next token (or the end of a string)
+ * without stepping over each byte. The on-demand reader skips whole values
+ * with it, the parallel parser finds where to split the input and the
+ * validator skips whitespace with it. The parsers that build nodes don't use
+ * it: they read every byte anyway, and skip whitespace with
+ * scan_span_whitespace (which costs less than classifying the input again).
+ *
+ * The index is built lazily one window at a time so its size does not depend
+ * on the size of the input.
+ */
+
+#define INDEX_WINDOW 65536
+
+struct index {
+  const uint8_t *start;       /* The start of the indexed window. */
+  const uint8_t *end;         /* The end of the indexed window. */
+  const uint8_t *limit;       /* The end of the input. */
+
+  uint64_t in_string;         /* All ones if the window ended inside a string. */
+  uint64_t odd_backslash;     /* One if the window ended with an odd run of backslashes. */
+  uint64_t scalar;            /* One if the window ended inside a scalar value. */
+
+  void (*build)(struct index *x, const uint8_t *end);
+
+  uint64_t bits[INDEX_WINDOW / 64];
+};
+
+/* The character classes found in a block of 64 bytes. Bit n of each mask
+ * corresponds to byte n of the block.
+ */
+struct index_block {
+  uint64_t quote;
+  uint64_t backslash;
+  uint64_t whitespace;
+  uint64_t structural;
+};
+
+static inline
+uint64_t
+index_prefix_xor(uint64_t bits)
+{
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+/* Return the bytes escaped by a backslash: those that follow a run of
+ * backslashes with an odd length. Runs may continue from the previous block.
+ */
+static inline
+uint64_t
+index_escaped(uint64_t backslash, uint64_t *odd_backslash)
+{
+  const uint64_t even = 0x5555555555555555ULL;
+  const uint64_t odd = ~even;
+
+  uint64_t starts = backslash & ~(backslash << 1);
+  uint64_t even_start_mask = even ^ *odd_backslash;
+  uint64_t even_starts = starts & even_start_mask;
+  uint64_t odd_starts = starts & ~even_start_mask;
+
+  uint64_t even_carries = backslash + even_starts;
+  uint64_t odd_carries = backslash + odd_starts;
+  uint64_t overflow = odd_carries < backslash;
+
+  odd_carries |= *odd_backslash;
+  *odd_backslash = overflow;
+
+  uint64_t even_carry_ends = even_carries & ~backslash;
+  uint64_t odd_carry_ends = odd_carries & ~backslash;
+
+  return (even_carry_ends & odd) | (odd_carry_ends & even);
+}
+
+/* Mark the tokens of the block at the given word of the window. */
+static inline
+void
+index_mark(struct index *x, size_t word, struct index_block *b)
+{
+  uint64_t escaped = index_escaped(b->backslash, &x->odd_backslash);
+  uint64_t quote = b->quote & ~escaped;
+
+  /* Bits are set from an opening quote up to (not including) its closing quote. */
+  uint64_t string = index_prefix_xor(quote) ^ x->in_string;
+  x->in_string = (uint64_t)((int64_t)string >> 63);
+
+  uint64_t scalar = ~(b->structural | b->whitespace | quote) & ~string;
+  uint64_t scalar_start = scalar & ~((scalar << 1) | x->scalar);
+  x->scalar = scalar >> 63;
+
+  x->bits[word] = quote | ((b->structural | scalar_start) & ~string);
+}
+
+static
+void
+index_classify_scalar(const uint8_t *p, struct index_block *b)
+{
+  static const uint8_t classes[256] = {
+    ['"']  = 0x1,
+    ['\\'] = 0x2,
+
+    [' ']  = 0x4,
+    ['\t'] = 0x4,
+    ['\r'] = 0x4,
+    ['\n'] = 0x4,
+
+    ['{'] = 0x8,
+    ['}'] = 0x8,
+    ['['] = 0x8,
+    [']'] = 0x8,
+    [':'] = 0x8,
+    [','] = 0x8,
+  };
+
+  b->quote = 0;
+  b->backslash = 0;
+  b->whitespace = 0;
+  b->structural = 0;
+
+  for (size_t i = 0; i < 64; i++) {
+    uint64_t bit = 1ULL << i;
+    uint8_t c = classes[p[i]];
+
+    if (c & 0x1) { b->quote |= bit; }
+    if (c & 0x2) { b->backslash |= bit; }
+    if (c & 0x4) { b->whitespace |= bit; }
+    if (c & 0x8) { b->structural |= bit; }
+  }
+}
+
+/* Generate a window builder for the given block classifier. The final partial
+ * block of the input is padded with whitespace.
+ */
+#define INDEX_BUILD(name, classify, ...) \
+  __VA_ARGS__ \
+  static \
+  void \
+  name(struct index *x, const uint8_t *end) \
+  { \
+    struct index_block b; \
+    uint8_t pad[64]; \
+    size_t word = 0; \
+    const uint8_t *p = x->start; \
+    for (; p + 64 <= end; p += 64, word++) { \
+      classify(p, &b); \
+      index_mark(x, word, &b); \
+    } \
+    if (p < end) { \
+      memset(pad, ' ', sizeof(pad)); \
+      memcpy(pad, p, end - p); \
+      classify(pad, &b); \
+      index_mark(x, word, &b); \
+    } \
+  } \
+
+/* Generate a counter of the quotes that are not escaped for the given block
+ * classifier. Only the parity of the count is returned. The final partial
+ * block is padded with whitespace.
+ */
+#define INDEX_QUOTES(name, classify, ...) \
+  __VA_ARGS__ \
+  static \
+  unsigned int \
+  name(const uint8_t *p, const uint8_t *end) \
+  { \
+    struct index_block b; \
+    uint8_t pad[64]; \
+    uint64_t odd_backslash = 0; \
+    unsigned int parity = 0; \
+    for (; p + 64 <= end; p += 64) { \
+      classify(p, &b); \
+      parity ^= __builtin_popcountll(b.quote & ~index_escaped(b.backslash, &odd_backslash)); \
+    } \
+    if (p < end) { \
+      memset(pad, ' ', sizeof(pad)); \
+      memcpy(pad, p, end - p); \
+      classify(pad, &b); \
+      parity ^= __builtin_popcountll(b.quote & ~index_escaped(b.backslash, &odd_backslash)); \
+    } \
+    return parity & 1; \
+  } \
+
+INDEX_BUILD(index_build_scalar, index_classify_scalar, __attribute__ ((unused)))
+INDEX_QUOTES(index_quotes_scalar, index_classify_scalar, __attribute__ ((unused)))
+
+#if defined(__x86_64__)
+
+static inline
+void
+index_classify_sse2(const uint8_t *p, struct index_block *b)
+{
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+
+  b->quote = 0;
+  b->backslash = 0;
+  b->whitespace = 0;
+  b->structural = 0;
+
+  for (size_t i = 0; i < 64; i += 16) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(p + i));
+
+    __m128i ws = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(in, _mm_set1_epi8('\t'))),
+      _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(in, _mm_set1_epi8('\n'))));
+
+    __m128i op = _mm_or_si128(
+      _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('{')), _mm_cmpeq_epi8(in, _mm_set1_epi8('}'))),
+        _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('[')), _mm_cmpeq_epi8(in, _mm_set1_epi8(']')))),
+      _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8(':')), _mm_cmpeq_epi8(in, _mm_set1_epi8(','))));
+
+    b->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(in, quote)) << i;
+    b->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(in, backslash)) << i;
+    b->whitespace |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << i;
+    b->structural |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << i;
+  }
+}
+
+INDEX_BUILD(index_build_sse2, index_classify_sse2)
+INDEX_QUOTES(index_quotes_sse2, index_classify_sse2)
+
+__attribute__ ((target ("avx2")))
+static inline
+void
+index_classify_avx2(const uint8_t *p, struct index_block *b)
+{
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+
+  b->quote = 0;
+  b->backslash = 0;
+  b->whitespace = 0;
+  b->structural = 0;
+
+  for (size_t i = 0; i < 64; i += 32) {
+    __m256i in = _mm256_loadu_si256((const __m256i *)(p + i));
+
+    __m256i ws = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('\t'))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('\n'))));
+
+    __m256i op = _mm256_or_si256(
+      _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('}'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('[')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8(']')))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8(','))));
+
+    b->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(in, quote)) << i;
+    b->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(in, backslash)) << i;
+    b->whitespace |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << i;
+    b->structural |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << i;
+  }
+}
+
+INDEX_BUILD(index_build_avx2, index_classify_avx2, __attribute__ ((target ("avx2"))))
+INDEX_QUOTES(index_quotes_avx2, index_classify_avx2, __attribute__ ((target ("avx2"))))
+
+#endif
+
+/* Begin indexing the input of a memory scan. */
+static
+void
+index_init(struct index *x, const uint8_t *base, const uint8_t *limit)
+{
+  x->start = base;
+  x->end = base;
+  x->limit = limit;
+  x->in_string = 0;
+  x->odd_backslash = 0;
+  x->scalar = 0;
+
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    x->build = index_build_avx2;
+  }
+  else {
+    x->build = index_build_sse2;
+  }
+#else
+  x->build = index_build_scalar;
+#endif
+}
+
+/* Return the parity of the quotes in [p, end) that are not escaped by a
+ * backslash. The byte before p must not be a backslash.
+ */
+static
+unsigned int
+index_quotes(const uint8_t *p, const uint8_t *end)
+{
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return index_quotes_avx2(p, end);
+  }
+  return index_quotes_sse2(p, end);
+#else
+  return index_quotes_scalar(p, end);
+#endif
+}
+
+/* Index the window following the current one. */
+static
+void
+index_advance(struct index *x)
+{
+  x->start = x->end;
+  x->end = x->start + INDEX_WINDOW;
+  if (x->end > x->limit || x->end < x->start) {
+    x->end = x->limit;
+  }
+
+  x->build(x, x->end);
+}
+
+/* Return the position of the first token at or after p. If there are no more
+ * tokens, the end of the input is returned.
+ */
+static
+const uint8_t *
+index_next(struct index *x, const uint8_t *p)
+{
+  while (p < x->limit) {
+    while (p >= x->end) {
+      index_advance(x);
+    }
+
+    size_t offset = p - x->start;
+    size_t word = offset / 64;
+    size_t words = (x->end - x->start + 63) / 64;
+    uint64_t bits = x->bits[word] & (~0ULL << (offset % 64));
+
+    for (;;) {
+      if (bits != 0) {
+        const uint8_t *found = x->start + word * 64 + __builtin_ctzll(bits);
+        return found < x->limit ? found : x->limit;
+      }
+
+      word++;
+      if (word == words) {
+        break;
+      }
+      bits = x->bits[word];
+    }
+
+    p = x->end;
+  }
+
+  return x->limit;
+}
+
+/* Return the position of the first token at or after p like index_next, but
+ * p may also come before the current window. The index is then started again
+ * from p, so such a p must not be inside a string.
+ */
+static
+const uint8_t *
+index_find(struct index *x, const uint8_t *p)
+{
+  if (p < x->start) {
+    x->start = p;
+    x->end = p;
+    x->in_string = 0;
+    x->odd_backslash = 0;
+    x->scalar = 0;
+  }
+
+  return index_next(x, p);
+}
@@ -0,0 +1,170 @@
+/*** cjson intern ***/
+
+/* An intern table keeps one copy of each string put in it. Each copy counts
+ * the nodes using it and is removed when the last of them is freed. The table
+ * counts its owner plus every use of its strings, so it outlives
+ * cjson_intern_free while any node still points into it.
+ */
+
+/* The number of independently locked parts of a table. Each string belongs to
+ * the shard picked by its hash, so threads interning different strings rarely
+ * wait for each other.
+ */
+#define INTERN_SHARDS 16
+
+struct intern_string {
+  size_t count;               /* The number of nodes using the string. */
+  char bytes[];
+};
+
+struct intern_shard {
+  pthread_mutex_t lock;
+  void *table;                /* JudySL (Map C String => struct intern_string *) */
+};
+
+struct cjson_intern {
+  struct intern_shard shards[INTERN_SHARDS];
+  struct cjson_allocator *allocator;
+  size_t references;          /* The owner plus each use of a string (updated atomically). */
+  size_t max_length;          /* The longest string value interned. */
+};
+
+struct cjson_intern *
+cjson_intern_new(size_t max_length, struct cjson_allocator *allocator)
+{
+  struct cjson_intern *intern = allocator_malloc(allocator, sizeof(*intern));
+  for (size_t i = 0; i < INTERN_SHARDS; i++) {
+    pthread_mutex_init(&intern->shards[i].lock, NULL);
+    intern->shards[i].table = NULL;
+  }
+  intern->allocator = allocator;
+  intern->references = 1;
+  intern->max_length = max_length;
+
+  return intern;
+}
+
+/* Return the shard of the string (of length bytes). */
+static inline
+struct intern_shard *
+intern_shard(struct cjson_intern *intern, const char *bytes, size_t length)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ (uint8_t)bytes[i]) * 0x100000001b3ULL;
+  }
+
+  return &intern->shards[(hash >> 32) % INTERN_SHARDS];
+}
+
+/* Drop a reference to the table and destroy it with the last one. */
+static
+void
+intern_unref(struct cjson_intern *intern)
+{
+  if (__atomic_sub_fetch(&intern->references, 1, __ATOMIC_ACQ_REL) != 0) {
+    return;
+  }
+
+  for (size_t i = 0; i < INTERN_SHARDS; i++) {
+    int status = 0;
+    JSLFA(status, intern->shards[i].table);
+    pthread_mutex_destroy(&intern->shards[i].lock);
+  }
+  allocator_free(intern->allocator, intern);
+}
+
+void
+cjson_intern_free(struct cjson_intern *intern)
+{
+  if (intern == NULL) {
+    return;
+  }
+
+  intern_unref(intern);
+}
+
+const char *
+cjson_intern_find(struct cjson_intern *intern, const char *string)
+{
+  struct intern_shard *shard = intern_shard(intern, string, strlen(string));
+  struct intern_string **entry = NULL;
+  const char *bytes = NULL;
+
+  pthread_mutex_lock(&shard->lock);
+  JSLG(entry, shard->table, (const uint8_t *)string);
+  if (entry != NULL) {
+    bytes = (*entry)->bytes;
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  return bytes;
+}
+
+/* Return the copy of the string (of length bytes) in the table, adding it if
+ * needed. The caller uses it until intern_release.
+ */
+static
+char *
+intern_take(struct cjson_intern *intern, const char *bytes, size_t length)
+{
+  struct intern_shard *shard = intern_shard(intern, bytes, length);
+  struct intern_string **entry = NULL;
+  struct intern_string *string = NULL;
+
+  pthread_mutex_lock(&shard->lock);
+  JSLG(entry, shard->table, (const uint8_t *)bytes);
+  if (entry != NULL) {
+    string = *entry;
+    string->count++;
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  if (string == NULL) {
+    /* Allocate the copy without the lock held (as allocating may throw), so
+     * another thread may add the string first.
+     */
+    struct intern_string *copy = allocator_malloc(intern->allocator, sizeof(*copy) + length + 1);
+    copy->count = 0;
+    memcpy(copy->bytes, bytes, length);
+    copy->bytes[length] = '\0';
+
+    pthread_mutex_lock(&shard->lock);
+    JSLI(entry, shard->table, (const uint8_t *)bytes);
+    if (*entry == NULL) {
+      *entry = copy;
+      copy = NULL;
+    }
+    string = *entry;
+    string->count++;
+    pthread_mutex_unlock(&shard->lock);
+
+    allocator_free(intern->allocator, copy);
+  }
+
+  __atomic_add_fetch(&intern->references, 1, __ATOMIC_RELAXED);
+
+  return string->bytes;
+}
+
+/* Stop using a copy returned by intern_take. */
+static
+void
+intern_release(struct cjson_intern *intern, char *bytes)
+{
+  struct intern_string *string = (struct intern_string *)(bytes - offsetof(struct intern_string, bytes));
+  struct intern_shard *shard = intern_shard(intern, bytes, strlen(bytes));
+
+  pthread_mutex_lock(&shard->lock);
+  if (--string->count != 0) {
+    string = NULL;
+  }
+  else {
+    int status = 0;
+    JSLD(status, shard->table, (const uint8_t *)bytes);
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  allocator_free(intern->allocator, string);
+  intern_unref(intern);
+}
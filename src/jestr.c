@@ -1,8 +1,12 @@
 /*** JSON Encoded String IO ***/
 
-/* Write the unicode code point to a JSON encoded string stream. */
-void
-cjson_jestr_fputu(const uint32_t u, FILE *stream)
+/* Encode the unicode code point in its normalized JSON encoded string form.
+ * Return the number of bytes used or zero if the code point is not a valid
+ * character.
+ */
+static
+size_t
+jestr_encode(const uint32_t u, uint8_t bytes[6])
 {
   static const char simple_escape[] = {
     [0 ... 127] = '\0',
@@ -16,24 +20,47 @@ cjson_jestr_fputu(const uint32_t u, FILE *stream)
     ['\t'] = 't',
   };
 
+  static const char hex[] = "0123456789abcdef";
+
   if (u <= 0x7F) {
     if (simple_escape[u] != '\0') {
-      ecx_fputc('\\', stream);
-      ecx_fputc(simple_escape[u], stream);
-      return;
+      bytes[0] = '\\';
+      bytes[1] = simple_escape[u];
+      return 2;
     }
     else if (u <= 0x1F) {
-      cjson_u16e_fputu(u, stream);
-      return;
+      bytes[0] = '\\';
+      bytes[1] = 'u';
+      bytes[2] = '0';
+      bytes[3] = '0';
+      bytes[4] = hex[u >> 4];
+      bytes[5] = hex[u & 0xF];
+      return 6;
     }
   }
 
-  cjson_u8_fputu(u, stream);
+  return u8_encode(u, bytes);
 }
 
-/* Read the unicode code point from a JSON encoded string stream. */
+/* Write the unicode code point to a JSON encoded string stream. */
+void
+cjson_jestr_fputu(const uint32_t u, FILE *stream)
+{
+  uint8_t bytes[6];
+
+  size_t length = jestr_encode(u, bytes);
+  if (length == 0) {
+    uint64_t u32 = u;
+    cjsonx_parse_u(stream, u32, "Invalid unicode character.");
+  }
+
+  ecx_fwrite(bytes, 1, length, stream);
+}
+
+/* Read the unicode code point from a JSON encoded string scan. */
+static
 int64_t
-cjson_jestr_fgetu(FILE *stream)
+jestr_scanu(struct scan *s)
 {
   char *message = NULL;
 
@@ -63,8 +90,8 @@ cjson_jestr_fgetu(FILE *stream)
 
   void **go = go_jestr;
 
-  int current = ecx_fgetc(stream);
-  for (; current != EOF; errno = 0, current = ecx_fgetc(stream)) {
+  int current = scan_getc(s);
+  for (; current != EOF; current = scan_getc(s)) {
     goto *go[current];
 l_loop:;
   }
@@ -74,17 +101,17 @@ l_loop:;
   }
 
 l_invalid:
-  cjsonx_parse_c(stream, current, "Expecting a UTF-8 character.");
+  scanx_parse_e(s, current, "Expecting a UTF-8 character.");
 
 l_char:
   return current;
 
 l_utf8:
-  ecx_ungetc(current, stream);
-  return cjson_u8_fgetu(stream);
+  scan_ungetc(s, current);
+  return u8_scanu(s);
 
 l_invalid_escape:
-  cjsonx_parse_c(stream, current, "Expecting an escape sequence.");
+  scanx_parse_e(s, current, "Expecting an escape sequence.");
 
 l_escape:
   go = go_jestr_escape;
@@ -115,46 +142,113 @@ l_escape_t:
   return '\t';
 
 l_u16e:
-  ecx_ungetc(current, stream);
+  scan_ungetc(s, current);
   {
-    int64_t val = cjson_u16e_fgetu(stream);
+    int64_t val = u16e_scanu(s);
     if (val == EOF) {
-      cjsonx_parse_c(stream, current, "Expecting more data to finish UTF-16 escape sequence.");
+      scanx_parse_e(s, current, "Expecting more data to finish UTF-16 escape sequence.");
     }
     return val;
   }
 }
 
-char *
-cjson_jestr_fscan(FILE *stream)
+/* Read the unicode code point from a JSON encoded string stream. */
+int64_t
+cjson_jestr_fgetu(FILE *stream)
 {
-  char *jestr = NULL;
-  ec_with_on_x(jestr, free) {
-    FILE * out = ecx_ccstreams_fstropen(&jestr, "w+");
-    ec_with(out, (ec_unwind_f)ecx_fclose) {
-      int64_t current = cjson_jestr_fgetu(stream);
-      if (current == EOF) {
-        cjsonx_parse_u(stream, current, "Expecting more data. Failed to find JSON escaped string to parse.");
+  int64_t u = 0;
+  struct scan scan, *s = &scan;
+  scan_fopen(s, stream, NULL, 0, 0);
+  ec_with(s, (ec_unwind_f)scan_fclose) {
+    u = jestr_scanu(s);
+  }
+
+  return u;
+}
+
+/* Read a JSON encoded string (including the quotes) into the buffer. If
+ * decode is set the characters are written as UTF-8, otherwise they are
+ * written in their normalized JSON encoded string form.
+ *
+ * Runs of characters that need neither unescaping nor validation beyond
+ * what scan_span_string and u8_valid do are copied as is. Only escape
+ * sequences and characters that aren't complete in the scan's region are
+ * decoded one at a time.
+ */
+static
+void
+jestr_scanb(struct scan *s, struct scan_buffer *out, unsigned int decode)
+{
+  int current = scan_getc(s);
+  if (current == EOF) {
+    scanx_parse_c(s, current, "Expecting more data; Failed to find string to parse.");
+  }
+  else if (current != '"') {
+    scanx_parse_c(s, current, "Failed to find string to parse; Expecting '\"'.");
+  }
+
+  for (;;) {
+    const uint8_t *start = s->cursor;
+    const uint8_t *p = scan_span_string(start, s->end);
+    while (p != s->end && *p >= 0x80) {
+      size_t length = u8_valid(p, s->end);
+      if (length == 0) {
+        break;
       }
-      else if (current != '"') {
-        cjsonx_parse_u(stream, current, "Failed to find JSON escaped string to parse; Expecting '\"'.");
+      p = scan_span_string(p + length, s->end);
+    }
+
+    scan_buffer_append(out, start, p - start);
+    s->cursor = p;
+
+    if (p == s->end) {
+      if (scan_fill(s) == 0) {
+        scanx_parse_more(s, "Failed to find end of string.");
       }
+      continue;
+    }
 
-      int peek = ecx_getc(stream);
-      ecx_ungetc(peek, stream);
+    if (*p == '"') {
+      s->cursor++;
+      break;
+    }
 
-      current = cjson_jestr_fgetu(stream);
+    /* An escape sequence, a control character or UTF-8 that needs decoding. */
+    int64_t u = jestr_scanu(s);
+    if (u == EOF) {
+      scanx_parse_more(s, "Failed to find end of string.");
+    }
 
-      for (; current != EOF; peek = ecx_getc(stream), ecx_ungetc(peek, stream), current = cjson_jestr_fgetu(stream)) {
-        if (current == EOF) {
-          cjsonx_parse_u(stream, current, "Expecting more data; Failed to find end of JSON escaped string.");
-        }
-        if (current == '"' && peek != '\\') {
-          break;
-        }
-        cjson_jestr_fputu(current, out);
-      }
+    uint8_t bytes[6];
+    size_t length = decode ? u8_encode(u, bytes) : jestr_encode(u, bytes);
+    if (length == 0) {
+      scanx_parse_u(s, u, "Invalid unicode character.");
     }
+
+    scan_buffer_append(out, bytes, length);
+  }
+}
+
+static
+char *
+jestr_scan(struct scan *s)
+{
+  struct scan_buffer buffer = SCAN_BUFFER_INIT(NULL), *b = &buffer;
+  ec_with_on_x(b, (ec_unwind_f)scan_buffer_free) {
+    jestr_scanb(s, b, 0);
+  }
+
+  return b->bytes;
+}
+
+char *
+cjson_jestr_fscan(FILE *stream)
+{
+  char *jestr = NULL;
+  struct scan scan, *s = &scan;
+  scan_fopen(s, stream, NULL, 0, 0);
+  ec_with(s, (ec_unwind_f)scan_fclose) {
+    jestr = jestr_scan(s);
   }
 
   return jestr;
@@ -163,16 +257,16 @@ cjson_jestr_fscan(FILE *stream)
 void
 cjson_jestr_fprint(FILE *stream, char *jestr)
 {
-  FILE *in = ecx_ccstreams_fstropen(&jestr, "r");
-  ec_with(in, (ec_unwind_f)ecx_fclose) {
-    int64_t current = cjson_jestr_fgetu(in);
+  struct scan scan, *s = &scan;
+  scan_mopen(s, jestr, strlen(jestr));
 
-    ecx_fprintf(stream, "\"");
-    for (; current != EOF; current = cjson_jestr_fgetu(in)) {
-      cjson_jestr_fputu(current, stream);
-    }
-    ecx_fprintf(stream, "\"");
+  int64_t current = jestr_scanu(s);
+
+  ecx_fprintf(stream, "\"");
+  for (; current != EOF; current = jestr_scanu(s)) {
+    cjson_jestr_fputu(current, stream);
   }
+  ecx_fprintf(stream, "\"");
 }
 
 char *
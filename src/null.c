@@ -1,23 +1,31 @@
 /*** cjson boolean ***/
 
+/* Read 'null'. */
+static
+void
+null_scan_token(struct scan *s)
+{
+  int current = scan_getc(s);
+  if (current == 'n') {
+    if ((current = scan_getc(s)) != 'u') { scanx_parse_c(s, current, "Parsing 'null': Expecting 'u'.") };
+    if ((current = scan_getc(s)) != 'l') { scanx_parse_c(s, current, "Parsing 'null': Expecting 'l'.") };
+    if ((current = scan_getc(s)) != 'l') { scanx_parse_c(s, current, "Parsing 'null': Expecting 'l'.") };
+  }
+  else if (current == EOF) {
+    scanx_parse_more(s, "Failed to find null to parse.");
+  }
+  else {
+    scanx_parse_c(s, current, "Expecting 'n' to begin parsing 'null'.");
+  }
+}
+
+static
 struct cjson *
-cjson_null_fscan(FILE *stream, struct cjson *parent)
+null_scan(struct scan *s, struct cjson *parent)
 {
   struct cjson *node = cjson_malloc(CJSON_NULL, parent);
   ec_with_on_x(node, (ec_unwind_f)cjson_free) {
-    int current = ecx_fgetc(stream);
-    if (current == 'n') {
-      if ((current = ecx_fgetc(stream)) != 'u') { cjsonx_parse_c(stream, current, "Parsing 'null': Expecting 'u'.") };
-      if ((current = ecx_fgetc(stream)) != 'l') { cjsonx_parse_c(stream, current, "Parsing 'null': Expecting 'l'.") };
-      if ((current = ecx_fgetc(stream)) != 'l') { cjsonx_parse_c(stream, current, "Parsing 'null': Expecting 'l'.") };
-    }
-    else if (current == EOF) {
-      ec_throw_str_static(CJSONX_PARSE, "Expecting more data; Failed to find null to parse.");
-    }
-    else {
-l_invalid:
-      cjsonx_parse_c(stream, current, "Expecting 'n' to begin parsing 'null'.");
-    }
+    null_scan_token(s);
 
     if (node->hook &&
         node->hook->valid) {
@@ -28,6 +36,28 @@ l_invalid:
   return node;
 }
 
+struct cjson *
+cjson_null_fscan(FILE *stream, struct cjson *parent)
+{
+  struct cjson *node = NULL;
+  uint8_t block[SCAN_BLOCK];
+  struct scan scan, *s = &scan;
+  scan_fopen(s, stream, block, sizeof(block), 0);
+  ec_with(s, (ec_unwind_f)scan_fclose) {
+    node = null_scan(s, parent);
+  }
+
+  return node;
+}
+
+struct cjson *
+cjson_null_parse(const char *buf, size_t length, struct cjson *parent)
+{
+  struct scan scan, *s = &scan;
+  scan_mopen(s, buf, length);
+  return null_scan(s, parent);
+}
+
 void
 cjson_null_fprint(FILE *stream, struct cjson *node)
 {
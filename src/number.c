@@ -1,61 +1,951 @@
 /*** cjson number ***/
 
-static const char number_pattern[] = "^([-]?([0-9]|[1-9][0-9]*))([.][0-9]+)?([eE][+-]?[0-9]+)?$";
-static regex_t number_regex_storage;
-static regex_t *number_regex = NULL;
+/* The length of the numbers that are buffered on the stack. Longer numbers are
+ * spilled into a scan buffer.
+ */
+#define NUMBER_INLINE 64
 
+/* Return non-zero if the 8 bytes at p are all ASCII digits. */
+static inline
+int
+number_digits8(const uint8_t *p)
+{
+  uint64_t v = 0;
+  memcpy(&v, p, sizeof(v));
+
+  return (((v & 0xF0F0F0F0F0F0F0F0ULL) |
+           (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL);
+}
+
+/* Read a number into the buffer. The number is validated against the JSON
+ * grammar as it is read and must be followed by whitespace, ',', ']', '}' or
+ * the end of the input.
+ */
+static
+void
+number_scanb(struct scan *s, struct scan_buffer *b)
+{
+  char digits[NUMBER_INLINE];
+  size_t count = 0;
+
+  static void *go_start[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['-']         = &&l_minus,
+    ['0']         = &&l_zero,
+    ['1' ... '9'] = &&l_int,
+  };
+
+  static void *go_minus[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['0']         = &&l_zero,
+    ['1' ... '9'] = &&l_int,
+  };
+
+  static void *go_zero[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_end,
+    [' ']  = &&l_end,
+    ['\r'] = &&l_end,
+    ['\n'] = &&l_end,
+    [',']  = &&l_end,
+    [']']  = &&l_end,
+    ['}']  = &&l_end,
+
+    ['.'] = &&l_dot,
+    ['e'] = &&l_e,
+    ['E'] = &&l_e,
+  };
+
+  static void *go_int[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_end,
+    [' ']  = &&l_end,
+    ['\r'] = &&l_end,
+    ['\n'] = &&l_end,
+    [',']  = &&l_end,
+    [']']  = &&l_end,
+    ['}']  = &&l_end,
+
+    ['0' ... '9'] = &&l_int,
+    ['.'] = &&l_dot,
+    ['e'] = &&l_e,
+    ['E'] = &&l_e,
+  };
+
+  static void *go_dot[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['0' ... '9'] = &&l_frac,
+  };
+
+  static void *go_frac[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_end,
+    [' ']  = &&l_end,
+    ['\r'] = &&l_end,
+    ['\n'] = &&l_end,
+    [',']  = &&l_end,
+    [']']  = &&l_end,
+    ['}']  = &&l_end,
+
+    ['0' ... '9'] = &&l_frac,
+    ['e'] = &&l_e,
+    ['E'] = &&l_e,
+  };
+
+  static void *go_e[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['+']         = &&l_e_sign,
+    ['-']         = &&l_e_sign,
+    ['0' ... '9'] = &&l_exp,
+  };
+
+  static void *go_e_sign[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['0' ... '9'] = &&l_exp,
+  };
+
+  static void *go_exp[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_end,
+    [' ']  = &&l_end,
+    ['\r'] = &&l_end,
+    ['\n'] = &&l_end,
+    [',']  = &&l_end,
+    [']']  = &&l_end,
+    ['}']  = &&l_end,
+
+    ['0' ... '9'] = &&l_exp,
+  };
+
+  void **go = go_start;
+
+  int current = scan_getc(s);
+  for (; current != EOF; current = scan_getc(s)) {
+    goto *go[current];
+l_loop:;
+  }
+
+  goto l_end;
+
+l_invalid:
+  if (go == go_start) {
+    scanx_parse_c(s, current, "Failed to find number to parse.");
+  }
+  scanx_parse_c(s, current, "Failed to parse number; Format is invalid.");
+
+l_minus:
+  go = go_minus;
+  goto l_append;
+
+l_zero:
+  go = go_zero;
+  goto l_append;
+
+l_int:
+  go = go_int;
+  goto l_digits;
+
+l_dot:
+  go = go_dot;
+  goto l_append;
+
+l_frac:
+  go = go_frac;
+  goto l_digits;
+
+l_e:
+  go = go_e;
+  goto l_append;
+
+l_e_sign:
+  go = go_e_sign;
+  goto l_append;
+
+l_exp:
+  go = go_exp;
+  goto l_digits;
+
+l_digits:
+  if (count == sizeof(digits)) {
+    scan_buffer_append(b, digits, count);
+    count = 0;
+  }
+  digits[count++] = current;
+
+  /* Copy runs of digits 8 at a time. */
+  while (s->end - s->cursor >= 8 && number_digits8(s->cursor)) {
+    if (count + 8 > sizeof(digits)) {
+      scan_buffer_append(b, digits, count);
+      count = 0;
+    }
+    memcpy(digits + count, s->cursor, 8);
+    count += 8;
+    s->cursor += 8;
+  }
+  goto l_loop;
+
+l_append:
+  if (count == sizeof(digits)) {
+    scan_buffer_append(b, digits, count);
+    count = 0;
+  }
+  digits[count++] = current;
+  goto l_loop;
+
+l_end:
+  scan_ungetc(s, current);
+
+  if (go == go_start) {
+    scanx_parse_c(s, current, "Failed to find number to parse.");
+  }
+  else if (go != go_zero &&
+           go != go_int &&
+           go != go_frac &&
+           go != go_exp) {
+    scanx_parse_c(s, current, "Failed to parse number; Expecting more digits.");
+  }
+
+  scan_buffer_append(b, digits, count);
+}
+
+static
 struct cjson *
-cjson_number_fscan(FILE *stream, struct cjson *parent)
+number_scan(struct scan *s, struct cjson *parent)
 {
-  struct cjson *node = cjson_malloc(CJSON_NUMBER, parent);
+  struct cjson *node = NULL;
+  struct scan_buffer buffer = SCAN_BUFFER_INIT(hook_allocator(parent != NULL ? parent->hook : NULL)), *b = &buffer;
+  ec_with(b, (ec_unwind_f)scan_buffer_free) {
+    number_scanb(s, b);
+    node = scan_buffer_node(b, CJSON_NUMBER, parent);
+  }
+
   ec_with_on_x(node, (ec_unwind_f)cjson_free) {
-    char *number = NULL;
-    ec_with_on_x(number, free) {
-      int current = ecx_fgetc(stream);
-      FILE *out = ecx_ccstreams_fstropen(&number, "w+");
-      ec_with(out, (ec_unwind_f)ecx_fclose) {
-        /* Scan and buffer up the number. */
-        for (; current != EOF; errno = 0, current = ecx_fgetc(stream)) {
-          if (current == ' '  ||
-              current == '\n' ||
-              current == '\r' ||
-              current == '\t' ||
-              current == ','  ||
-              current == ']'  ||
-              current == '}') {
-            ecx_ungetc(current, stream);
-            break;
-          }
-          ecx_fputc(current, out);
-        }
+    if (node->hook &&
+        node->hook->valid) {
+      node->hook->valid(node);
+    }
+  }
+
+  return node;
+}
+
+struct cjson *
+cjson_number_fscan(FILE *stream, struct cjson *parent)
+{
+  struct cjson *node = NULL;
+  uint8_t block[SCAN_BLOCK];
+  struct scan scan, *s = &scan;
+  scan_fopen(s, stream, block, sizeof(block), 0);
+  ec_with(s, (ec_unwind_f)scan_fclose) {
+    node = number_scan(s, parent);
+  }
+
+  return node;
+}
+
+struct cjson *
+cjson_number_parse(const char *buf, size_t length, struct cjson *parent)
+{
+  struct scan scan, *s = &scan;
+  scan_mopen(s, buf, length);
+  return number_scan(s, parent);
+}
+
+void
+cjson_number_fprint(FILE *stream, struct cjson *node)
+{
+  cjsonx_type(node, CJSON_NUMBER);
+
+  ecx_fprintf(stream, "%s", node->value.number);
+}
+
+/* Which conversions of a number are cached (stored in the node's flags).
+ * Failed conversions are cached too.
+ *
+ * The getters cache into nodes their callers only read, so threads sharing a
+ * document (e.g. from cjson_pipeline) may convert the same number at once.
+ * The flags are only read and set atomically. The first conversion to claim
+ * number_cache (with NUMBER_CACHED) writes it and then publishes its flag;
+ * the union is never written again. Later conversions of the other kind are
+ * computed each time (a double is cheap to compute from a cached integer).
+ */
+#define NUMBER_INT64        0x01  /* number_cache.int64 holds the value. */
+#define NUMBER_UINT64       0x02  /* number_cache.uint64 holds the value (above INT64_MAX). */
+#define NUMBER_REAL         0x04  /* number_cache.real holds the nearest double. */
+#define NUMBER_EXACT        0x08  /* The nearest double is exactly the value. */
+#define NUMBER_INEXACT      0x10  /* The nearest double is not exactly the value. */
+#define NUMBER_NOT_INTEGER  0x20  /* The value is not a 64 bit integer. */
+#define NUMBER_NOT_REAL     0x40  /* The value is outside the range of double. */
+#define NUMBER_CACHED       0x80  /* number_cache is claimed by a conversion. */
+
+static inline
+unsigned int
+number_flags(struct cjson *self)
+{
+  return __atomic_load_n(&self->flags, __ATOMIC_ACQUIRE);
+}
+
+/* Set the flags (after writing whatever they describe). */
+static inline
+void
+number_publish(struct cjson *self, unsigned int flags)
+{
+  __atomic_fetch_or(&self->flags, flags, __ATOMIC_RELEASE);
+}
+
+/* Return non-zero if the caller is the first to claim number_cache. */
+static inline
+int
+number_claim(struct cjson *self)
+{
+  return (__atomic_fetch_or(&self->flags, NUMBER_CACHED, __ATOMIC_ACQ_REL) & NUMBER_CACHED) == 0;
+}
+
+/* A number split into its sign, significant digits and decimal exponent. The
+ * value is significand * 10^exponent unless truncated is set, in which case
+ * there were more non-zero digits than fit in the significand.
+ */
+struct number_parts {
+  unsigned int negative;
+  unsigned int truncated;
+  uint64_t significand;
+  int64_t exponent;
+};
+
+/* Split a number that has already been validated by number_scanb. */
+static
+void
+number_split(const char *number, struct number_parts *parts)
+{
+  const char *p = number;
+
+  parts->negative = 0;
+  parts->truncated = 0;
+  parts->significand = 0;
+  parts->exponent = 0;
+
+  if (*p == '-') {
+    parts->negative = 1;
+    p++;
+  }
+
+  for (unsigned int fraction = 0; (*p >= '0' && *p <= '9') || *p == '.'; p++) {
+    if (*p == '.') {
+      fraction = 1;
+      continue;
+    }
+
+    uint64_t next = 0;
+    if (!__builtin_mul_overflow(parts->significand, 10, &next) &&
+        !__builtin_add_overflow(next, (uint64_t)(*p - '0'), &next)) {
+      parts->significand = next;
+      parts->exponent -= fraction;
+    }
+    else {
+      parts->truncated |= *p != '0';
+      parts->exponent += !fraction;
+    }
+  }
+
+  if (*p == 'e' || *p == 'E') {
+    int64_t sign = 1;
+    int64_t exponent = 0;
+
+    p++;
+    if (*p == '-' || *p == '+') {
+      sign = *p == '-' ? -1 : 1;
+      p++;
+    }
+
+    /* Anything larger is out of range for every conversion anyway. */
+    for (; *p >= '0' && *p <= '9'; p++) {
+      if (exponent < 1000000) {
+        exponent = exponent * 10 + (*p - '0');
       }
+    }
+
+    parts->exponent += sign * exponent;
+  }
+
+  if (parts->significand == 0) {
+    parts->exponent = 0;
+  }
+  else if (!parts->truncated) {
+    while (parts->significand % 10 == 0) {
+      parts->significand /= 10;
+      parts->exponent++;
+    }
+  }
+}
+
+/* Convert the number to an integer. Return NUMBER_INT64 or NUMBER_UINT64 with
+ * the bits of the value set, or NUMBER_NOT_INTEGER.
+ */
+static
+unsigned int
+number_integer(const char *number, uint64_t *bits)
+{
+  struct number_parts parts;
+  number_split(number, &parts);
+
+  uint64_t magnitude = parts.significand;
+  unsigned int integer = !parts.truncated && parts.exponent >= 0;
+
+  for (int64_t i = 0; integer && i < parts.exponent; i++) {
+    integer = !__builtin_mul_overflow(magnitude, 10, &magnitude);
+  }
+
+  if (integer && parts.negative) {
+    integer = magnitude <= (uint64_t)INT64_MAX + 1;
+  }
+
+  if (!integer) {
+    return NUMBER_NOT_INTEGER;
+  }
+
+  if (parts.negative) {
+    *bits = 0 - magnitude;
+    return NUMBER_INT64;
+  }
+
+  *bits = magnitude;
+  return magnitude > INT64_MAX ? NUMBER_UINT64 : NUMBER_INT64;
+}
+
+/* Return the integer (NUMBER_INT64 or NUMBER_UINT64 with the bits of the
+ * value set) from the cache or by converting (and caching) it, or throw.
+ */
+static
+unsigned int
+number_integer_cached(struct cjson *self, uint64_t *bits)
+{
+  unsigned int flags = number_flags(self);
+
+  if (flags & NUMBER_INT64) {
+    *bits = (uint64_t)self->value.number_cache.int64;
+    return NUMBER_INT64;
+  }
+  if (flags & NUMBER_UINT64) {
+    *bits = self->value.number_cache.uint64;
+    return NUMBER_UINT64;
+  }
+
+  unsigned int found = NUMBER_NOT_INTEGER;
+  if ((flags & NUMBER_NOT_INTEGER) == 0) {
+    found = number_integer(self->value.number, bits);
+  }
+
+  if (found == NUMBER_NOT_INTEGER) {
+    number_publish(self, NUMBER_NOT_INTEGER);
+    ec_throw_strf(CJSONX_RANGE, "Number is not a 64 bit integer: '%s'.", self->value.number);
+  }
+
+  if (number_claim(self)) {
+    if (found == NUMBER_INT64) {
+      self->value.number_cache.int64 = (int64_t)*bits;
+    }
+    else {
+      self->value.number_cache.uint64 = *bits;
+    }
+    number_publish(self, found);
+  }
+
+  return found;
+}
+
+int64_t
+cjson_number_get_int64(struct cjson *self)
+{
+  cjsonx_type(self, CJSON_NUMBER);
+
+  uint64_t bits = 0;
+  if (number_integer_cached(self, &bits) == NUMBER_UINT64) {
+    ec_throw_strf(CJSONX_RANGE, "Number is outside the range of int64_t: '%s'.", self->value.number);
+  }
 
-      if (strnlen(number, 1) == 0) {
-        cjsonx_parse_c(stream, current, "Failed to find number to parse.");
+  return (int64_t)bits;
+}
+
+uint64_t
+cjson_number_get_uint64(struct cjson *self)
+{
+  cjsonx_type(self, CJSON_NUMBER);
+
+  uint64_t bits = 0;
+  if (number_integer_cached(self, &bits) == NUMBER_INT64 &&
+      (int64_t)bits < 0) {
+    ec_throw_strf(CJSONX_RANGE, "Number is outside the range of uint64_t: '%s'.", self->value.number);
+  }
+
+  return bits;
+}
+
+/* Return the "C" locale, so converting doubles doesn't depend on the
+ * caller's LC_NUMERIC (e.g. a decimal comma).
+ */
+static locale_t number_c_locale;
+static pthread_once_t number_c_locale_once = PTHREAD_ONCE_INIT;
+
+static
+void
+number_c_locale_init(void)
+{
+  number_c_locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+}
+
+static
+locale_t
+number_locale(void)
+{
+  pthread_once(&number_c_locale_once, number_c_locale_init);
+  if (number_c_locale == (locale_t)0) {
+    ec_throw_str_static(ECX_EC, "Failed to create the C locale.");
+  }
+
+  return number_c_locale;
+}
+
+/* Return non-zero if the double is exactly the value of the number. Every
+ * double has a finite decimal expansion of at most 767 significant digits, so
+ * printing it with more precision than that and comparing the digits is
+ * exact.
+ */
+static
+int
+number_exact(const char *number, double real)
+{
+  char expansion[800 + 16];
+  char digits[800 + 16];
+  size_t count = 0;
+  int64_t exponent = 0;
+
+  /* The significant digits and exponent of the number (d.ddd x 10^exponent). */
+  const char *p = number;
+  int64_t point = 0;
+  unsigned int fraction = 0;
+  for (p += *p == '-'; (*p >= '0' && *p <= '9') || *p == '.'; p++) {
+    if (*p == '.') {
+      fraction = 1;
+    }
+    else if (count == 0 && *p == '0') {
+      point -= fraction;
+    }
+    else if (count < sizeof(digits)) {
+      digits[count++] = *p;
+      point += !fraction;
+    }
+    else if (*p != '0') {
+      return 0;
+    }
+    else {
+      point += !fraction;
+    }
+  }
+
+  if (*p == 'e' || *p == 'E') {
+    int64_t sign = 1;
+
+    p++;
+    if (*p == '-' || *p == '+') {
+      sign = *p == '-' ? -1 : 1;
+      p++;
+    }
+
+    /* Saturate far beyond the exponents of doubles (so adding point can't
+     * overflow).
+     */
+    for (; *p >= '0' && *p <= '9'; p++) {
+      if (exponent < 1000000) {
+        exponent = exponent * 10 + (*p - '0');
       }
+    }
+    exponent *= sign;
+  }
+
+  while (count > 0 && digits[count - 1] == '0') {
+    count--;
+  }
+
+  if (count == 0) {
+    return real == 0;
+  }
+
+  exponent += point - 1;
+
+  locale_t previous = uselocale(number_locale());
+  snprintf(expansion, sizeof(expansion), "%.800e", fabs(real));
+  uselocale(previous);
+
+  /* The expansion is d.ddd...e[+-]x with trailing zeros. */
+  char *e = strchr(expansion, 'e');
+  int64_t real_exponent = strtoll(e + 1, NULL, 10);
+  char *last = e - 1;
+  while (*last == '0') {
+    last--;
+  }
+  if (*last == '.') {
+    last--;
+  }
+
+  size_t real_count = 0;
+  for (char *q = expansion; q <= last; q++) {
+    if (*q != '.') {
+      expansion[real_count++] = *q;
+    }
+  }
+
+  return real_exponent == exponent &&
+         real_count == count &&
+         memcmp(expansion, digits, count) == 0;
+}
+
+/* Convert the number to the nearest double. Return NUMBER_REAL (with
+ * NUMBER_EXACT if the fast path shows it is exact) with real set, or
+ * NUMBER_NOT_REAL.
+ */
+static
+unsigned int
+number_real(const char *number, double *real)
+{
+  static const double powers[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21,
+    1e22,
+  };
+
+  struct number_parts parts;
+  number_split(number, &parts);
+
+  unsigned int exact = 0;
+
+  /* Clinger's fast path: the significand and power of ten are both exact
+   * doubles, so a single multiplication or division is correctly rounded.
+   */
+  if (!parts.truncated &&
+      parts.significand <= (1ULL << 53) &&
+      parts.exponent >= -22 &&
+      parts.exponent <= 22) {
+    if (parts.exponent < 0) {
+      *real = (double)parts.significand / powers[-parts.exponent];
+    }
+    else {
+      *real = (double)parts.significand * powers[parts.exponent];
+
+      uint64_t integer = 0;
+      exact = parts.exponent <= 19 &&
+              !__builtin_mul_overflow(parts.significand, (uint64_t)powers[parts.exponent], &integer) &&
+              integer <= (1ULL << 53);
+    }
+
+    if (parts.negative) {
+      *real = -*real;
+    }
+  }
+  else {
+    errno = 0;
+    *real = strtod_l(number, NULL, number_locale());
+    if (errno == ERANGE && isinf(*real)) {
+      errno = 0;
+      return NUMBER_NOT_REAL;
+    }
+    errno = 0;
+  }
+
+  return NUMBER_REAL | (exact ? NUMBER_EXACT : 0);
+}
+
+/* Return the nearest double to the cached integer (of the flags) and whether
+ * it is exact. A conversion from an integer is correctly rounded, and exact
+ * when the significant bits of the integer fit in a double.
+ */
+static
+double
+number_integer_real(struct cjson *self, unsigned int flags, int *exact)
+{
+  uint64_t magnitude = 0;
+  double real = 0;
+
+  if (flags & NUMBER_UINT64) {
+    magnitude = self->value.number_cache.uint64;
+    real = (double)magnitude;
+  }
+  else {
+    int64_t value = self->value.number_cache.int64;
+    magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    real = (double)value;
+  }
+
+  /* The integer has lost the sign of a negative zero. */
+  if (magnitude == 0 &&
+      self->value.number[0] == '-') {
+    real = -0.0;
+  }
+
+  if (magnitude != 0) {
+    magnitude >>= __builtin_ctzll(magnitude);
+  }
+  *exact = magnitude < (1ULL << 53);
+
+  return real;
+}
+
+double
+cjson_number_get_double(struct cjson *self, int *exact)
+{
+  cjsonx_type(self, CJSON_NUMBER);
+
+  unsigned int flags = number_flags(self);
+
+  if (flags & (NUMBER_INT64 | NUMBER_UINT64)) {
+    int integer_exact = 0;
+    double real = number_integer_real(self, flags, &integer_exact);
+    if (exact != NULL) {
+      *exact = integer_exact;
+    }
+    return real;
+  }
 
-      /* Verify that the format is valid. */
-      int status = regexec(number_regex, number, 0, NULL, 0);
-      if (status != 0) {
-        ec_throw_strf(CJSONX_PARSE, "Failed to parse number; Format is invalid: '%s'.", number);
+  double real = 0;
+  unsigned int found = NUMBER_NOT_REAL;
+
+  if (flags & NUMBER_REAL) {
+    real = self->value.number_cache.real;
+    found = NUMBER_REAL;
+  }
+  else if ((flags & NUMBER_NOT_REAL) == 0) {
+    found = number_real(self->value.number, &real);
+
+    if (found == NUMBER_REAL || found == (NUMBER_REAL | NUMBER_EXACT)) {
+      if (number_claim(self)) {
+        self->value.number_cache.real = real;
+        number_publish(self, found);
       }
+      else {
+        number_publish(self, found & NUMBER_EXACT);
+      }
+    }
+  }
+
+  if (found == NUMBER_NOT_REAL) {
+    number_publish(self, NUMBER_NOT_REAL);
+    ec_throw_strf(CJSONX_RANGE, "Number is outside the range of double: '%s'.", self->value.number);
+  }
 
-      node->value.number = number;
+  if (exact != NULL) {
+    flags = number_flags(self) | found;
+    if ((flags & (NUMBER_EXACT | NUMBER_INEXACT)) == 0) {
+      flags = number_exact(self->value.number, real) ? NUMBER_EXACT : NUMBER_INEXACT;
+      number_publish(self, flags);
     }
 
+    *exact = (flags & NUMBER_EXACT) != 0;
+  }
+
+  return real;
+}
+
+static const char number_digit_pairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+/* Write the decimal digits of value so that they end just before end. Return
+ * the position of the first digit.
+ */
+static inline
+char *
+number_format_digits(uint64_t value, char *end)
+{
+  while (value >= 100) {
+    end -= 2;
+    memcpy(end, number_digit_pairs + 2 * (value % 100), 2);
+    value /= 100;
+  }
+
+  if (value >= 10) {
+    end -= 2;
+    memcpy(end, number_digit_pairs + 2 * value, 2);
+  }
+  else {
+    *--end = '0' + value;
+  }
+
+  return end;
+}
+
+/* Format the finite double as the shortest number that reads back as the same
+ * double. Like JavaScript, plain notation is used for magnitudes from 1e-6 up
+ * to 1e21 and exponential notation otherwise. Return the length.
+ */
+static
+size_t
+number_format_double(double value, char out[32])
+{
+  char *p = out;
+
+  if (signbit(value)) {
+    *p++ = '-';
+    value = -value;
+  }
+
+  if (value == 0) {
+    *p++ = '0';
+    return p - out;
+  }
+
+  uint64_t digits = 0;
+  int32_t exponent = 0;
+  ryu_shortest(value, &digits, &exponent);
+
+  char buffer[20];
+  char *end = buffer + sizeof(buffer);
+  char *start = number_format_digits(digits, end);
+  int32_t count = end - start;
+
+  /* The number of digits before the decimal point. */
+  int32_t point = exponent + count;
+
+  if (count <= point && point <= 21) {
+    memcpy(p, start, count);
+    p += count;
+    memset(p, '0', point - count);
+    p += point - count;
+  }
+  else if (0 < point && point <= 21) {
+    memcpy(p, start, point);
+    p += point;
+    *p++ = '.';
+    memcpy(p, start + point, count - point);
+    p += count - point;
+  }
+  else if (-6 < point && point <= 0) {
+    *p++ = '0';
+    *p++ = '.';
+    memset(p, '0', -point);
+    p += -point;
+    memcpy(p, start, count);
+    p += count;
+  }
+  else {
+    *p++ = start[0];
+    if (count > 1) {
+      *p++ = '.';
+      memcpy(p, start + 1, count - 1);
+      p += count - 1;
+    }
+
+    *p++ = 'e';
+    *p++ = point - 1 < 0 ? '-' : '+';
+
+    char exponent_buffer[4];
+    char *exponent_end = exponent_buffer + sizeof(exponent_buffer);
+    char *exponent_start = number_format_digits(point - 1 < 0 ? 1 - point : point - 1, exponent_end);
+    memcpy(p, exponent_start, exponent_end - exponent_start);
+    p += exponent_end - exponent_start;
+  }
+
+  return p - out;
+}
+
+/* Create a CJSON_NUMBER with a copy of the text. */
+static
+struct cjson *
+number_new(const char *text, size_t length, struct cjson *parent)
+{
+  struct cjson *node = cjson_malloc(CJSON_NUMBER, parent);
+  ec_with_on_x(node, (ec_unwind_f)cjson_free) {
+    node->value.number = node_malloc(node, length + 1);
+    memcpy(node->value.number, text, length);
+    node->value.number[length] = '\0';
+  }
+
+  return node;
+}
+
+/* Run the node's validation hook (once its cache is set). */
+static
+void
+number_valid(struct cjson *node)
+{
+  ec_with_on_x(node, (ec_unwind_f)cjson_free) {
     if (node->hook &&
         node->hook->valid) {
       node->hook->valid(node);
     }
   }
+}
+
+struct cjson *
+cjson_number_from_int64(int64_t value, struct cjson *parent)
+{
+  char buffer[24];
+  char *end = buffer + sizeof(buffer);
+  uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+
+  char *start = number_format_digits(magnitude, end);
+  if (value < 0) {
+    *--start = '-';
+  }
+
+  struct cjson *node = number_new(start, end - start, parent);
+  node->value.number_cache.int64 = value;
+  node->flags |= NUMBER_CACHED | NUMBER_INT64;
+  number_valid(node);
 
   return node;
 }
 
-void
-cjson_number_fprint(FILE *stream, struct cjson *node)
+struct cjson *
+cjson_number_from_uint64(uint64_t value, struct cjson *parent)
 {
-  cjsonx_type(node, CJSON_NUMBER);
+  char buffer[24];
+  char *end = buffer + sizeof(buffer);
+  char *start = number_format_digits(value, end);
 
-  ecx_fprintf(stream, "%s", node->value.number);
+  struct cjson *node = number_new(start, end - start, parent);
+  if (value > INT64_MAX) {
+    node->value.number_cache.uint64 = value;
+    node->flags |= NUMBER_CACHED | NUMBER_UINT64;
+  }
+  else {
+    node->value.number_cache.int64 = value;
+    node->flags |= NUMBER_CACHED | NUMBER_INT64;
+  }
+  number_valid(node);
+
+  return node;
+}
+
+struct cjson *
+cjson_number_from_double(double value, struct cjson *parent)
+{
+  if (!isfinite(value)) {
+    ec_throw_strf(CJSONX_RANGE, "JSON numbers must be finite: %f.", value);
+  }
+
+  char buffer[32];
+  size_t length = number_format_double(value, buffer);
+
+  struct cjson *node = number_new(buffer, length, parent);
+  node->value.number_cache.real = value;
+  node->flags |= NUMBER_CACHED | NUMBER_REAL;
+  number_valid(node);
+
+  return node;
 }
@@ -1,7 +1,8 @@
 /*** cjson array ***/
 
+static
 struct cjson *
-cjson_object_fscan(FILE *stream, struct cjson *parent)
+object_scan(struct scan *s, struct cjson *parent)
 {
   struct cjson *node = cjson_malloc(CJSON_OBJECT, parent);
   ec_with_on_x(node, (ec_unwind_f)cjson_free) {
@@ -25,31 +26,33 @@ cjson_object_fscan(FILE *stream, struct cjson *parent)
 
     void **go = go_object;
 
-    current = ecx_fgetc(stream);
+    current = scan_getc(s);
     if (current != '{') {
-      cjsonx_parse_c(stream, current, "Unable to find object to parse; Expecting '{'.");
+      scanx_parse_c(s, current, "Unable to find object to parse; Expecting '{'.");
     }
+    scan_enter(s, node->hook, current);
 
-    for (current = ecx_fgetc(stream); current != EOF; errno = 0, current = ecx_fgetc(stream)) {
+    for (current = scan_getc(s); current != EOF; current = scan_getc(s)) {
       goto *go[current];
 l_loop:;
     }
 
-    cjsonx_parse_c(stream, current, "Expecting more data; Incomplete object.");
+    scanx_parse_c(s, current, "Expecting more data; Incomplete object.");
 
 l_invalid:
-    cjsonx_parse_c(stream, current, "Expecting to find a JSON key/value pair to parse.");
+    scanx_parse_c(s, current, "Expecting to find a JSON key/value pair to parse.");
 
 l_whitespace:
+    scan_skip_whitespace(s);
     goto l_loop;
 
 l_pair:
-    ecx_ungetc(current, stream);
-    pair = cjson_pair_fscan(stream, node);
+    scan_ungetc(s, current);
+    pair = pair_scan(s, node);
     ec_with_on_x(pair, (ec_unwind_f)cjson_free) {
       struct cjson *old = cjson_object_set(node, pair);
       if (old != NULL) {
-        ec_throw_strf(CJSONX_PARSE, "Invalid duplicate key at %ld: \"%s\".", ftell(stream), old->value.pair.key);
+        ec_throw_strf(CJSONX_PARSE, "Invalid duplicate key at %ld: \"%s\".", scan_tell(s), old->value.pair.key);
       }
     }
     goto l_loop;
@@ -68,6 +71,7 @@ l_object_finish:
     if (continued && pair == NULL) {
       goto l_invalid;
     }
+    scan_leave(s);
 
     if (node->hook &&
         node->hook->valid) {
@@ -78,6 +82,28 @@ l_object_finish:
   return node;
 }
 
+struct cjson *
+cjson_object_fscan(FILE *stream, struct cjson *parent)
+{
+  struct cjson *node = NULL;
+  uint8_t block[SCAN_BLOCK];
+  struct scan scan, *s = &scan;
+  scan_fopen(s, stream, block, sizeof(block), 0);
+  ec_with(s, (ec_unwind_f)scan_fclose) {
+    node = object_scan(s, parent);
+  }
+
+  return node;
+}
+
+struct cjson *
+cjson_object_parse(const char *buf, size_t length, struct cjson *parent)
+{
+  struct scan scan, *s = &scan;
+  scan_mopen(s, buf, length);
+  return object_scan(s, parent);
+}
+
 void
 cjson_object_fprint(FILE *stream, struct cjson *node)
 {
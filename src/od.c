@@ -0,0 +1,392 @@
+/*** cjson on-demand ***/
+
+/* The on-demand API reads values directly from the buffer when they are
+ * asked for instead of building nodes for the whole document. A value is
+ * simply the position of its first byte. Values that are passed over (e.g.
+ * the other fields of an object) are skipped by matching brackets with the
+ * structural index, so they are neither parsed nor validated.
+ */
+
+struct cjson_od_doc {
+  const uint8_t *base;
+  const uint8_t *end;
+  struct index index;
+};
+
+struct cjson_od_doc *
+cjson_od_doc_new(const char *buf, size_t length)
+{
+  struct cjson_od_doc *doc = ecx_malloc(sizeof(*doc));
+  doc->base = (const uint8_t *)buf;
+  doc->end = doc->base + length;
+  index_init(&doc->index, doc->base, doc->end);
+
+  return doc;
+}
+
+void
+cjson_od_doc_free(struct cjson_od_doc *doc)
+{
+  free(doc);
+}
+
+/* Return the first token at or after p (which must not be inside a string). */
+static
+const uint8_t *
+od_next(struct cjson_od_doc *doc, const uint8_t *p)
+{
+  const uint8_t *token = index_find(&doc->index, p);
+  if (token == doc->end) {
+    ec_throw_strf(CJSONX_PARSE, "Expecting more data at %ld; Incomplete document.", (long)(token - doc->base));
+  }
+
+  return token;
+}
+
+/* Return the position just past the value at p. */
+static
+const uint8_t *
+od_skip(struct cjson_od_doc *doc, const uint8_t *p)
+{
+  size_t depth = 0;
+
+  do {
+    p = od_next(doc, p);
+    switch (*p) {
+      case '[':
+      case '{':
+        depth++;
+        break;
+
+      case ']':
+      case '}':
+        if (depth == 0) {
+          ec_throw_strf(CJSONX_PARSE, "Invalid character at %ld: %x '%c': Expecting to find a JSON type to parse.", (long)(p - doc->base), *p, *p);
+        }
+        depth--;
+        break;
+
+      case '"':
+        /* The next token is the closing quote. */
+        p = index_next(&doc->index, p + 1);
+        if (p == doc->end) {
+          ec_throw_strf(CJSONX_PARSE, "Expecting more data at %ld; Failed to find end of string.", (long)(p - doc->base));
+        }
+        break;
+
+      case ',':
+      case ':':
+        break;
+
+      default:
+        /* A number or literal ends where the next token begins. */
+        while (p + 1 != doc->end &&
+               !scan_isspace(p[1]) &&
+               p[1] != ',' && p[1] != ']' && p[1] != '}' && p[1] != ':') {
+          p++;
+        }
+        break;
+    }
+
+    p++;
+  } while (depth != 0);
+
+  return p;
+}
+
+/* Begin scanning the value. */
+static
+void
+od_scan(struct scan *s, struct cjson_od *value)
+{
+  scan_mopen(s, value->doc->base, value->doc->end - value->doc->base);
+  s->cursor = (const uint8_t *)value->at;
+}
+
+struct cjson_od
+cjson_od_root(struct cjson_od_doc *doc)
+{
+  struct cjson_od value = {
+    .doc = doc,
+    .at = (const char *)od_next(doc, doc->base),
+  };
+
+  return value;
+}
+
+enum cjson_type
+cjson_od_type(struct cjson_od *value)
+{
+  static const uint8_t types[256] = {
+    ['[']         = CJSON_ARRAY,
+    ['t']         = CJSON_BOOLEAN,
+    ['f']         = CJSON_BOOLEAN,
+    ['n']         = CJSON_NULL,
+    ['-']         = CJSON_NUMBER,
+    ['0' ... '9'] = CJSON_NUMBER,
+    ['{']         = CJSON_OBJECT,
+    ['"']         = CJSON_STRING,
+  };
+
+  uint8_t current = *(const uint8_t *)value->at;
+  if (types[current] == 0) {
+    ec_throw_strf(CJSONX_PARSE, "Invalid character at %ld: %x '%c': Expecting to find a JSON type to parse.", (long)((const uint8_t *)value->at - value->doc->base), current, current);
+  }
+
+  return types[current];
+}
+
+/* Throw CJSONX_TYPE unless the value is of the given type. */
+static
+void
+od_require(struct cjson_od *value, enum cjson_type type)
+{
+  enum cjson_type actual = cjson_od_type(value);
+  if (actual != type) {
+    ec_throw_strf(CJSONX_TYPE, "Invalid value type: 0x%2x. Requires 0x%2x.", actual, type);
+  }
+}
+
+/* Return true if the key (a string token at p) matches the JSON encoded
+ * string (jestr).
+ */
+static
+int
+od_key_equal(struct cjson_od_doc *doc, const uint8_t *p, const uint8_t *close, const char *key)
+{
+  size_t length = strlen(key);
+
+  /* Keys without escapes are already in their normalized form. */
+  if (memchr(p + 1, '\\', close - (p + 1)) == NULL) {
+    return (size_t)(close - (p + 1)) == length && memcmp(p + 1, key, length) == 0;
+  }
+
+  int equal = 0;
+  struct scan_buffer buffer = SCAN_BUFFER_INIT(NULL), *b = &buffer;
+  ec_with(b, (ec_unwind_f)scan_buffer_free) {
+    struct scan scan, *s = &scan;
+    scan_mopen(s, doc->base, doc->end - doc->base);
+    s->cursor = p;
+    jestr_scanb(s, b, 0);
+    equal = b->length == length && memcmp(b->bytes, key, length) == 0;
+  }
+
+  return equal;
+}
+
+int
+cjson_od_find_field(struct cjson_od *object, const char *key, struct cjson_od *value)
+{
+  od_require(object, CJSON_OBJECT);
+
+  struct cjson_od_doc *doc = object->doc;
+  const uint8_t *p = od_next(doc, (const uint8_t *)object->at + 1);
+  if (*p == '}') {
+    return 0;
+  }
+
+  for (;;) {
+    if (*p != '"') {
+      ec_throw_strf(CJSONX_PARSE, "Invalid character at %ld: %x '%c': Expecting to find a JSON key/value pair to parse.", (long)(p - doc->base), *p, *p);
+    }
+
+    const uint8_t *close = index_next(&doc->index, p + 1);
+    if (close == doc->end) {
+      ec_throw_strf(CJSONX_PARSE, "Expecting more data at %ld; Failed to find end of string.", (long)(close - doc->base));
+    }
+
+    const uint8_t *colon = od_next(doc, close + 1);
+    if (*colon != ':') {
+      ec_throw_strf(CJSONX_PARSE, "Invalid character at %ld: %x '%c': Expecting ':'.", (long)(colon - doc->base), *colon, *colon);
+    }
+
+    const uint8_t *at = od_next(doc, colon + 1);
+    if (od_key_equal(doc, p, close, key)) {
+      value->doc = doc;
+      value->at = (const char *)at;
+      return 1;
+    }
+
+    p = od_next(doc, od_skip(doc, at));
+    if (*p == '}') {
+      return 0;
+    }
+    if (*p != ',') {
+      ec_throw_strf(CJSONX_PARSE, "Invalid character at %ld: %x '%c': Expecting ',' or '}'.", (long)(p - doc->base), *p, *p);
+    }
+    p = od_next(doc, p + 1);
+  }
+}
+
+void
+cjson_od_iter(struct cjson_od *container, struct cjson_od_iter *iter)
+{
+  enum cjson_type type = cjson_od_type(container);
+  if (type != CJSON_ARRAY && type != CJSON_OBJECT) {
+    ec_throw_strf(CJSONX_TYPE, "Invalid value type: 0x%2x. Requires CJSON_ARRAY 0x%2x or CJSON_OBJECT 0x%2x.", type, CJSON_ARRAY, CJSON_OBJECT);
+  }
+
+  iter->doc = container->doc;
+  iter->at = container->at + 1;
+  iter->count = 0;
+}
+
+/* Return the next element in the iteration or NULL if there are no more. */
+static
+const uint8_t *
+od_iter_next(struct cjson_od_iter *iter, uint8_t close)
+{
+  struct cjson_od_doc *doc = iter->doc;
+  const uint8_t *p = od_next(doc, (const uint8_t *)iter->at);
+
+  if (*p == close) {
+    iter->at = (const char *)p;
+    return NULL;
+  }
+
+  if (iter->count != 0) {
+    if (*p != ',') {
+      ec_throw_strf(CJSONX_PARSE, "Invalid character at %ld: %x '%c': Expecting ',' or '%c'.", (long)(p - doc->base), *p, *p, close);
+    }
+    p = od_next(doc, p + 1);
+  }
+
+  iter->count++;
+
+  return p;
+}
+
+int
+cjson_od_array_next(struct cjson_od_iter *iter, struct cjson_od *value)
+{
+  const uint8_t *p = od_iter_next(iter, ']');
+  if (p == NULL) {
+    return 0;
+  }
+
+  value->doc = iter->doc;
+  value->at = (const char *)p;
+  iter->at = (const char *)od_skip(iter->doc, p);
+
+  return 1;
+}
+
+int
+cjson_od_object_next(struct cjson_od_iter *iter, struct cjson_od *key, struct cjson_od *value)
+{
+  struct cjson_od_doc *doc = iter->doc;
+  const uint8_t *p = od_iter_next(iter, '}');
+  if (p == NULL) {
+    return 0;
+  }
+
+  if (*p != '"') {
+    ec_throw_strf(CJSONX_PARSE, "Invalid character at %ld: %x '%c': Expecting to find a JSON key/value pair to parse.", (long)(p - doc->base), *p, *p);
+  }
+
+  const uint8_t *colon = od_next(doc, od_skip(doc, p));
+  if (*colon != ':') {
+    ec_throw_strf(CJSONX_PARSE, "Invalid character at %ld: %x '%c': Expecting ':'.", (long)(colon - doc->base), *colon, *colon);
+  }
+
+  const uint8_t *at = od_next(doc, colon + 1);
+
+  key->doc = doc;
+  key->at = (const char *)p;
+  value->doc = doc;
+  value->at = (const char *)at;
+  iter->at = (const char *)od_skip(doc, at);
+
+  return 1;
+}
+
+/* Read the number at the value into a node on the stack and convert it. */
+#define od_number(v,f,...) \
+  od_require((v), CJSON_NUMBER); \
+  struct cjson node; \
+  cjson_init(&node, CJSON_NUMBER, NULL); \
+  struct scan_buffer buffer = SCAN_BUFFER_INIT(NULL), *b = &buffer; \
+  ec_with(b, (ec_unwind_f)scan_buffer_free) { \
+    struct scan scan, *s = &scan; \
+    od_scan(s, (v)); \
+    number_scanb(s, b); \
+    node.value.number = b->bytes; \
+    result = f(&node, ##__VA_ARGS__); \
+  } \
+
+int64_t
+cjson_od_get_int64(struct cjson_od *value)
+{
+  int64_t result = 0;
+  od_number(value, cjson_number_get_int64);
+  return result;
+}
+
+uint64_t
+cjson_od_get_uint64(struct cjson_od *value)
+{
+  uint64_t result = 0;
+  od_number(value, cjson_number_get_uint64);
+  return result;
+}
+
+double
+cjson_od_get_double(struct cjson_od *value, int *exact)
+{
+  double result = 0;
+  od_number(value, cjson_number_get_double, exact);
+  return result;
+}
+
+unsigned int
+cjson_od_get_boolean(struct cjson_od *value)
+{
+  od_require(value, CJSON_BOOLEAN);
+
+  struct scan scan, *s = &scan;
+  od_scan(s, value);
+  return boolean_scan_token(s);
+}
+
+char *
+cjson_od_get_string(struct cjson_od *value, size_t *length)
+{
+  od_require(value, CJSON_STRING);
+
+  struct scan_buffer buffer = SCAN_BUFFER_INIT(NULL), *b = &buffer;
+  ec_with_on_x(b, (ec_unwind_f)scan_buffer_free) {
+    struct scan scan, *s = &scan;
+    od_scan(s, value);
+    jestr_scanb(s, b, 1);
+  }
+
+  if (length != NULL) {
+    *length = b->length;
+  }
+
+  return b->bytes;
+}
+
+struct cjson *
+cjson_od_get_node(struct cjson_od *value, struct cjson *parent)
+{
+  struct scan scan, *s = &scan;
+  od_scan(s, value);
+  s->index = &value->doc->index;
+  index_find(s->index, s->cursor);
+
+  switch (cjson_od_type(value)) {
+    case CJSON_ARRAY:
+      return array_scan(s, parent);
+    case CJSON_BOOLEAN:
+      return boolean_scan(s, parent);
+    case CJSON_NULL:
+      return null_scan(s, parent);
+    case CJSON_NUMBER:
+      return number_scan(s, parent);
+    case CJSON_OBJECT:
+      return object_scan(s, parent);
+    default:
+      return string_scan(s, parent);
+  }
+}
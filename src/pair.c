@@ -1,13 +1,21 @@
 /*** cjson string ***/
 
+static
 struct cjson *
-cjson_pair_fscan(FILE *stream, struct cjson *parent)
+pair_scan(struct scan *s, struct cjson *parent)
 {
-  struct cjson *node = cjson_malloc(CJSON_PAIR, parent);
+  struct cjson *node = NULL;
+
+  /* Read in the key. */
+  struct scan_buffer buffer = SCAN_BUFFER_INIT(hook_allocator(parent != NULL ? parent->hook : NULL)), *b = &buffer;
+  ec_with(b, (ec_unwind_f)scan_buffer_free) {
+    jestr_scanb(s, b, 0);
+    node = scan_buffer_node(b, CJSON_PAIR, parent);
+  }
+
   ec_with_on_x(node, (ec_unwind_f)cjson_free) {
     int current = 0;
-    char *key = NULL;
-    size_t length = 0;
+    char *key = node->value.pair.key;
     struct cjson *value = NULL;
 
     static void *go_pair_key[] = {
@@ -45,22 +53,19 @@ cjson_pair_fscan(FILE *stream, struct cjson *parent)
 
     void **go = go_pair_key;
 
-    /* Read in the key. */
-    key = cjson_jestr_fscan(stream);
-    length = strlen(key);
-
-    current = ecx_fgetc(stream);
-    for (; current != EOF; errno = 0, current = ecx_fgetc(stream)) {
+    current = scan_getc(s);
+    for (; current != EOF; current = scan_getc(s)) {
       goto *go[current];
 l_loop:;
     }
 
-    cjsonx_parse_c(stream, current, "Expecting more data; Incomplete pair (missing data for '%s').", key);
+    scanx_parse_c(s, current, "Expecting more data; Incomplete pair (missing data for '%s').", key);
 
 l_invalid:
-    cjsonx_parse_c(stream, current, "Expecting to find a JSON type to parse for pair data.");
+    scanx_parse_c(s, current, "Expecting to find a JSON type to parse for pair data.");
 
 l_whitespace:
+    scan_skip_whitespace(s);
     goto l_loop;
 
 l_value:
@@ -68,37 +73,36 @@ l_value:
     goto l_loop;
 
 l_array:
-    ecx_ungetc(current, stream);
-    value = cjson_array_fscan(stream, node);
+    scan_ungetc(s, current);
+    value = array_scan(s, node);
     goto l_pair_finish;
 
 l_number:
-    ecx_ungetc(current, stream);
-    value = cjson_number_fscan(stream, node);
+    scan_ungetc(s, current);
+    value = number_scan(s, node);
     goto l_pair_finish;
 
 l_object:
-    ecx_ungetc(current, stream);
-    value = cjson_object_fscan(stream, node);
+    scan_ungetc(s, current);
+    value = object_scan(s, node);
     goto l_pair_finish;
 
 l_string:
-    ecx_ungetc(current, stream);
-    value = cjson_string_fscan(stream, node);
+    scan_ungetc(s, current);
+    value = string_scan(s, node);
     goto l_pair_finish;
 
 l_boolean:
-    ecx_ungetc(current, stream);
-    value = cjson_boolean_fscan(stream, node);
+    scan_ungetc(s, current);
+    value = boolean_scan(s, node);
     goto l_pair_finish;
 
 l_null:
-    ecx_ungetc(current, stream);
-    value = cjson_null_fscan(stream, node);
+    scan_ungetc(s, current);
+    value = null_scan(s, node);
     goto l_pair_finish;
 
 l_pair_finish:
-    node->value.pair.key = key;
     node->value.pair.value = value;
 
     if (node->hook &&
@@ -110,6 +114,28 @@ l_pair_finish:
   return node;
 }
 
+struct cjson *
+cjson_pair_fscan(FILE *stream, struct cjson *parent)
+{
+  struct cjson *node = NULL;
+  uint8_t block[SCAN_BLOCK];
+  struct scan scan, *s = &scan;
+  scan_fopen(s, stream, block, sizeof(block), 0);
+  ec_with(s, (ec_unwind_f)scan_fclose) {
+    node = pair_scan(s, parent);
+  }
+
+  return node;
+}
+
+struct cjson *
+cjson_pair_parse(const char *buf, size_t length, struct cjson *parent)
+{
+  struct scan scan, *s = &scan;
+  scan_mopen(s, buf, length);
+  return pair_scan(s, parent);
+}
+
 void
 cjson_pair_fprint(FILE *stream, struct cjson *node)
 {
@@ -0,0 +1,546 @@
+/*** cjson parallel parser ***/
+
+/* The parallel parser splits a single large array or object into segments of
+ * its elements (or pairs) and parses the segments on several threads.
+ *
+ * The input is cut into chunks of roughly equal size. In a first pass, each
+ * chunk counts the quotes that are not escaped. The parity of the quotes in
+ * the preceding chunks tells whether a chunk starts inside a string. In a
+ * second pass, each chunk (now knowing its string state) follows the nesting
+ * depth and notes the first comma at each depth. The sum of the depths of the
+ * preceding chunks then picks the first comma in each chunk that separates
+ * two elements of the outermost container. The segments between those commas
+ * are parsed independently and their elements are added to the container in
+ * order.
+ *
+ * Each segment is parsed strictly (as a list of complete values separated by
+ * commas), so invalid input is still found even if it confused the split.
+ */
+
+/* The smallest chunk worth parsing on its own thread. */
+#define PARALLEL_CHUNK (1024 * 1024)
+
+/* The number of chunks for each thread. */
+#define PARALLEL_SPLIT 4
+
+/* The longest error message kept from a segment. */
+#define PARALLEL_ERROR 512
+
+struct parallel_chunk {
+  const uint8_t *start;
+  const uint8_t *end;
+
+  unsigned int quotes;        /* The parity of the quotes that are not escaped. */
+  unsigned int in_string;     /* The chunk starts inside a string. */
+  long depth;                 /* The change in depth over the chunk. */
+
+  const uint8_t **commas;     /* The first comma at depth 0, -1, -2, ... (or NULL). */
+  size_t lowest;              /* The number of depths in commas. */
+
+  const uint8_t *from;        /* The segment to parse (or NULL). */
+  const uint8_t *to;
+
+  struct cjson **items;       /* The values (or pairs) parsed from the segment. */
+  size_t count;
+  size_t capacity;
+
+  unsigned int failed;
+  char error[PARALLEL_ERROR];
+};
+
+struct parallel {
+  const uint8_t *base;
+  size_t length;
+  struct cjson *node;         /* The outermost array or object. */
+
+  struct parallel_chunk *chunks;
+  size_t total;
+  size_t segments;            /* The number of chunks with a segment. */
+
+  void (*run)(struct parallel *p, struct parallel_chunk *c);
+  size_t next;                /* The next chunk to run. */
+};
+
+static
+void
+parallel_quotes(struct parallel *p, struct parallel_chunk *c)
+{
+  c->quotes = index_quotes(c->start, c->end);
+}
+
+static
+void
+parallel_depth(struct parallel *p, struct parallel_chunk *c)
+{
+  struct index index;
+  index_init(&index, c->start, c->end);
+  index.in_string = c->in_string ? ~0ULL : 0;
+
+  long depth = 0;
+  const uint8_t *cursor = c->start;
+  while ((cursor = index_next(&index, cursor)) < c->end) {
+    switch (*cursor) {
+      case '[':
+      case '{':
+        depth++;
+        break;
+
+      case ']':
+      case '}':
+        depth--;
+        break;
+
+      case ',':
+        if (depth <= 0 && (size_t)-depth >= c->lowest) {
+          /* Without the memory, the chunk is simply not split. */
+          size_t lowest = -depth + 1;
+          const uint8_t **commas = realloc(c->commas, lowest * sizeof(*c->commas));
+          if (commas == NULL) {
+            break;
+          }
+          for (size_t i = c->lowest; i < lowest; i++) {
+            commas[i] = NULL;
+          }
+          c->commas = commas;
+          c->lowest = lowest;
+        }
+        if (depth <= 0 && c->commas[-depth] == NULL) {
+          c->commas[-depth] = cursor;
+        }
+        break;
+    }
+
+    cursor++;
+  }
+
+  c->depth = depth;
+}
+
+static
+void
+parallel_append(struct parallel_chunk *c, struct cjson *item)
+{
+  if (c->count == c->capacity) {
+    size_t capacity = c->capacity == 0 ? 1024 : c->capacity * 2;
+    c->items = ecx_realloc(c->items, capacity * sizeof(*c->items));
+    c->capacity = capacity;
+  }
+
+  c->items[c->count++] = item;
+}
+
+/* Parse the values (or pairs) separated by commas in the segment. */
+static
+void
+parallel_scan_items(struct scan *s, struct parallel *p, struct parallel_chunk *c)
+{
+  int current = 0;
+  struct cjson *child = NULL;
+
+  static void *go_value[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    ['['] = &&l_array,
+
+    ['-']       = &&l_number,
+    [48 ... 57] = &&l_number,
+
+    ['{'] = &&l_object,
+
+    ['"'] = &&l_string,
+
+    ['t'] = &&l_boolean,
+    ['f'] = &&l_boolean,
+    ['n'] = &&l_null,
+  };
+
+  static void *go_pair[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    ['"'] = &&l_pair,
+  };
+
+  static void *go_next[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    [','] = &&l_next,
+  };
+
+  void **go_item = p->node->type == CJSON_ARRAY ? go_value : go_pair;
+  void **go = go_item;
+
+  current = scan_getc(s);
+  for (; current != EOF; current = scan_getc(s)) {
+    goto *go[current];
+l_loop:;
+  }
+
+  /* Only a container without any segments to split may be empty. */
+  if (go == go_item && (c->count != 0 || p->segments != 1)) {
+    ec_throw_strf(CJSONX_PARSE, "Expecting more data at %ld; Value was not specified.", scan_tell(s));
+  }
+
+  return;
+
+l_invalid:
+  scanx_parse_c(s, current, "Expecting to find a JSON type to parse.");
+
+l_whitespace:
+  scan_skip_whitespace(s);
+  goto l_loop;
+
+l_array:
+  scan_ungetc(s, current);
+  child = array_scan(s, p->node);
+  goto l_append;
+
+l_number:
+  scan_ungetc(s, current);
+  child = number_scan(s, p->node);
+  goto l_append;
+
+l_object:
+  scan_ungetc(s, current);
+  child = object_scan(s, p->node);
+  goto l_append;
+
+l_string:
+  scan_ungetc(s, current);
+  child = string_scan(s, p->node);
+  goto l_append;
+
+l_boolean:
+  scan_ungetc(s, current);
+  child = boolean_scan(s, p->node);
+  goto l_append;
+
+l_null:
+  scan_ungetc(s, current);
+  child = null_scan(s, p->node);
+  goto l_append;
+
+l_pair:
+  scan_ungetc(s, current);
+  child = pair_scan(s, p->node);
+  goto l_append;
+
+l_append:
+  ec_with_on_x(child, (ec_unwind_f)cjson_free) {
+    parallel_append(c, child);
+  }
+  go = go_next;
+  goto l_loop;
+
+l_next:
+  go = go_item;
+  goto l_loop;
+}
+
+static
+void
+parallel_segment(struct parallel *p, struct parallel_chunk *c)
+{
+  const char *msg = NULL;
+
+  if (c->from == NULL) {
+    return;
+  }
+
+  /* Positions are reported relative to the whole input. */
+  struct index index;
+  struct scan scan, *s = &scan;
+  scan_mopen(s, p->base, p->length);
+  s->cursor = c->from;
+  s->end = c->to;
+  index_init(&index, c->from, c->to);
+  s->index = &index;
+
+  /* The items are inside the outermost container. */
+  s->depth = 1;
+
+  ec_try {
+    parallel_scan_items(s, p, c);
+  } ec_catch_a(CJSONX_PARSE, msg) {
+    c->failed = 1;
+    snprintf(c->error, sizeof(c->error), "%s", msg);
+  } ec_catch {
+    c->failed = 1;
+    snprintf(c->error, sizeof(c->error), "Failed to parse the segment at %ld.", (long)(c->from - p->base));
+  }
+}
+
+static
+void *
+parallel_work(void *arg)
+{
+  struct parallel *p = arg;
+
+  for (;;) {
+    size_t i = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED);
+    if (i >= p->total) {
+      break;
+    }
+
+    p->run(p, &p->chunks[i]);
+  }
+
+  return NULL;
+}
+
+/* Run the function on every chunk. The calling thread works alongside the
+ * others, so the chunks are finished even if no threads can be started.
+ */
+static
+void
+parallel_run(struct parallel *p, size_t threads, void (*run)(struct parallel *p, struct parallel_chunk *c))
+{
+  pthread_t workers[threads];
+  size_t started = 0;
+
+  p->run = run;
+  p->next = 0;
+
+  for (size_t i = 1; i < threads; i++) {
+    if (pthread_create(&workers[started], NULL, parallel_work, p) == 0) {
+      started++;
+    }
+  }
+
+  parallel_work(p);
+
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(workers[i], NULL);
+  }
+}
+
+static
+void
+parallel_free(struct parallel *p)
+{
+  for (size_t i = 0; i < p->total; i++) {
+    struct parallel_chunk *c = &p->chunks[i];
+    for (size_t j = 0; j < c->count; j++) {
+      cjson_free(c->items[j]);
+    }
+    free(c->items);
+    free(c->commas);
+  }
+
+  free(p->chunks);
+}
+
+/* Cut the input into chunks. A chunk never starts just after a backslash, so
+ * no run of backslashes crosses two chunks.
+ */
+static
+void
+parallel_chunk(struct parallel *p, size_t total)
+{
+  p->chunks = ecx_calloc(total, sizeof(*p->chunks));
+  p->total = total;
+
+  const uint8_t *start = p->base;
+  const uint8_t *end = p->base + p->length;
+  for (size_t i = 0; i < total; i++) {
+    const uint8_t *next = end;
+    if (i + 1 < total) {
+      next = p->base + p->length / total * (i + 1);
+      while (next < end && next[-1] == '\\') {
+        next++;
+      }
+      if (next < start) {
+        next = start;
+      }
+    }
+
+    p->chunks[i].start = start;
+    p->chunks[i].end = next;
+    start = next;
+  }
+}
+
+/* Parse the outermost container (between open and close) into node. */
+static
+void
+parallel_scan(struct parallel *p, size_t threads, const uint8_t *open, const uint8_t *close)
+{
+  unsigned int in_string = 0;
+  long depth = 0;
+
+  parallel_run(p, threads, parallel_quotes);
+  for (size_t i = 0; i < p->total; i++) {
+    p->chunks[i].in_string = in_string;
+    in_string ^= p->chunks[i].quotes;
+  }
+
+  parallel_run(p, threads, parallel_depth);
+
+  /* The first chunk starts at the open bracket. */
+  struct parallel_chunk *previous = &p->chunks[0];
+  previous->from = open + 1;
+  p->segments = 1;
+  for (size_t i = 0; i < p->total; i++) {
+    struct parallel_chunk *c = &p->chunks[i];
+    if (i != 0 && depth >= 1 && (size_t)(depth - 1) < c->lowest && c->commas[depth - 1] != NULL) {
+      const uint8_t *comma = c->commas[depth - 1];
+      if (comma > open && comma < close) {
+        previous->to = comma;
+        c->from = comma + 1;
+        previous = c;
+        p->segments++;
+      }
+    }
+    depth += c->depth;
+  }
+  previous->to = close;
+
+  parallel_run(p, threads, parallel_segment);
+
+  for (size_t i = 0; i < p->total; i++) {
+    if (p->chunks[i].failed) {
+      ec_throw_strf(CJSONX_PARSE, "%s", p->chunks[i].error);
+    }
+  }
+
+  /* Add the elements in the order they appear in the input. */
+  for (size_t i = 0; i < p->total; i++) {
+    struct parallel_chunk *c = &p->chunks[i];
+    for (size_t j = 0; j < c->count; j++) {
+      struct cjson *item = c->items[j];
+      if (p->node->type == CJSON_ARRAY) {
+        cjson_array_append(p->node, item);
+      }
+      else {
+        struct cjson *old = cjson_object_set(p->node, item);
+        if (old != NULL) {
+          c->items[j] = old;
+          ec_throw_strf(CJSONX_PARSE, "Invalid duplicate key: \"%s\".", old->value.pair.key);
+        }
+      }
+      c->items[j] = NULL;
+    }
+  }
+}
+
+static
+struct cjson *
+parallel_root_scan(struct scan *s, enum cjson_type valid, size_t threads, struct cjson_hook *hook)
+{
+  struct cjson *root = root_malloc(hook);
+  ec_with_on_x(root, (ec_unwind_f)cjson_free) {
+    struct cjson *node = NULL;
+
+    if (threads == 0) {
+      long online = sysconf(_SC_NPROCESSORS_ONLN);
+      threads = online > 0 ? online : 1;
+    }
+
+    size_t length = s->end - s->base;
+    size_t total = threads * PARALLEL_SPLIT;
+    if (total > length / PARALLEL_CHUNK) {
+      total = length / PARALLEL_CHUNK;
+    }
+    if (threads > total) {
+      threads = total;
+    }
+
+    const uint8_t *open = scan_span_whitespace(s->base, s->end);
+    const uint8_t *close = s->end;
+    while (close > open && scan_isspace(close[-1])) {
+      close--;
+    }
+    close--;
+
+    /* An arena is not thread safe, so its documents are parsed on this thread. */
+    unsigned int split = total > 1 && close > open &&
+      (hook == NULL || hook->arena == NULL) &&
+      ((*open == '[' && *close == ']' && (valid & CJSON_ARRAY) != 0) ||
+       (*open == '{' && *close == '}' && (valid & CJSON_OBJECT) != 0));
+
+    if (!split) {
+      node = root_scan_item(s, valid, root);
+      if (node != NULL) {
+        ec_with_on_x(node, (ec_unwind_f)cjson_free) {
+          scan_skip_whitespace(s);
+          if (s->cursor != s->end) {
+            scanx_parse_c(s, *s->cursor, "Expecting a single document.");
+          }
+        }
+      }
+    }
+    else {
+      node = cjson_malloc(*open == '[' ? CJSON_ARRAY : CJSON_OBJECT, root);
+      ec_with_on_x(node, (ec_unwind_f)cjson_free) {
+        struct parallel parallel = {
+          .base = s->base,
+          .length = length,
+          .node = node,
+          .chunks = NULL,
+          .total = 0,
+        }, *p = &parallel;
+        ec_with(p, (ec_unwind_f)parallel_free) {
+          parallel_chunk(p, total);
+          parallel_scan(p, threads, open, close);
+        }
+
+        if (node->hook &&
+            node->hook->valid) {
+          node->hook->valid(node);
+        }
+      }
+    }
+
+    if (node != NULL) {
+      ec_with_on_x(node, (ec_unwind_f)cjson_free) {
+        cjson_array_append(root, node);
+      }
+    }
+
+    if (root->hook &&
+        root->hook->valid) {
+      root->hook->valid(root);
+    }
+  }
+
+  return root;
+}
+
+struct cjson *
+cjson_root_parse_parallel(const char *buf, size_t length, enum cjson_type valid, unsigned int threads, struct cjson_hook *hook)
+{
+  struct index index;
+  struct scan scan, *s = &scan;
+  scan_mopen(s, buf, length);
+  scan_index(s, &index);
+  return parallel_root_scan(s, valid, threads, hook);
+}
+
+struct cjson *
+cjson_root_parse_file_parallel(const char *path, enum cjson_type valid, unsigned int threads, struct cjson_hook *hook)
+{
+  struct cjson *node = NULL;
+  struct index index;
+  struct scan scan, *s = &scan;
+  scan_mmap(s, path);
+  scan_index(s, &index);
+  ec_with(s, (ec_unwind_f)scan_munmap) {
+    node = parallel_root_scan(s, valid, threads, hook);
+  }
+
+  return node;
+}
@@ -0,0 +1,535 @@
+/*** cjson pipeline ***/
+
+/* The pipeline parses newline delimited documents on several threads. A
+ * reader thread cuts the stream into batches at line breaks, worker threads
+ * parse the batches into documents and the calling thread hands the documents
+ * to the consumer.
+ *
+ * There are a fixed number of batches which cycle from the reader to the
+ * workers to the consumer and back again. A slow consumer (or slow workers)
+ * therefore stalls the reader instead of buffering more of the stream.
+ */
+
+/* The initial size of a batch. Batches grow to fit the longest line. */
+#define PIPELINE_BATCH (1024 * 1024)
+
+/* The number of batches for each worker. */
+#define PIPELINE_DEPTH 4
+
+/* The longest error message kept from a worker. */
+#define PIPELINE_ERROR 512
+
+struct pipeline_batch {
+  size_t sequence;            /* The position of the batch in the stream. */
+  long offset;                /* The position of the first byte in the stream. */
+
+  char *bytes;
+  size_t length;
+  size_t size;
+
+  struct cjson **nodes;       /* The documents parsed from the bytes. */
+  size_t count;
+  size_t capacity;
+
+  unsigned int failed;        /* Parsing stopped early at an invalid document. */
+  char error[PIPELINE_ERROR]; /* Why parsing stopped early. */
+};
+
+/* A queue of batches. A queue is never full since it can hold every batch. */
+struct pipeline_queue {
+  struct pipeline_batch **items;
+  size_t size;
+  size_t head;
+  size_t count;
+  unsigned int closed;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t ready;
+};
+
+struct pipeline {
+  FILE *stream;
+  enum cjson_type valid;
+  struct cjson root;          /* Holds the hook for the documents (never has children). */
+
+  struct pipeline_batch *batches;
+  struct pipeline_batch **pending; /* Batches waiting for their turn (by sequence). */
+  size_t total;
+
+  struct pipeline_queue free; /* Reader <- Consumer */
+  struct pipeline_queue work; /* Reader -> Workers */
+  struct pipeline_queue done; /* Workers -> Consumer */
+
+  pthread_t reader;
+  unsigned int reading;       /* The reader thread was started. */
+  pthread_t *workers;
+  size_t started;             /* The number of worker threads started. */
+  size_t running;             /* The number of worker threads still running. */
+  pthread_mutex_t mutex;
+
+  unsigned int stop;          /* Stop reading and parsing. */
+  int read_error;             /* The errno of a failed read (or zero). */
+  unsigned int failed;        /* A batch contained an invalid document. */
+  char error[PIPELINE_ERROR]; /* The first parse error. */
+};
+
+static
+void
+pipeline_queue_init(struct pipeline_queue *q, size_t size)
+{
+  q->items = ecx_malloc(size * sizeof(*q->items));
+  q->size = size;
+  q->head = 0;
+  q->count = 0;
+  q->closed = 0;
+
+  pthread_mutex_init(&q->mutex, NULL);
+  pthread_cond_init(&q->ready, NULL);
+}
+
+static
+void
+pipeline_queue_destroy(struct pipeline_queue *q)
+{
+  pthread_cond_destroy(&q->ready);
+  pthread_mutex_destroy(&q->mutex);
+  free(q->items);
+}
+
+static
+void
+pipeline_queue_push(struct pipeline_queue *q, struct pipeline_batch *b)
+{
+  pthread_mutex_lock(&q->mutex);
+  q->items[(q->head + q->count) % q->size] = b;
+  q->count++;
+  pthread_cond_signal(&q->ready);
+  pthread_mutex_unlock(&q->mutex);
+}
+
+/* Return the next batch. Wait for one if the queue is empty. Return NULL if
+ * the queue is empty and closed.
+ */
+static
+struct pipeline_batch *
+pipeline_queue_pop(struct pipeline_queue *q)
+{
+  struct pipeline_batch *b = NULL;
+
+  pthread_mutex_lock(&q->mutex);
+  while (q->count == 0 && !q->closed) {
+    pthread_cond_wait(&q->ready, &q->mutex);
+  }
+
+  if (q->count != 0) {
+    b = q->items[q->head];
+    q->head = (q->head + 1) % q->size;
+    q->count--;
+  }
+  pthread_mutex_unlock(&q->mutex);
+
+  return b;
+}
+
+static
+void
+pipeline_queue_close(struct pipeline_queue *q)
+{
+  pthread_mutex_lock(&q->mutex);
+  q->closed = 1;
+  pthread_cond_broadcast(&q->ready);
+  pthread_mutex_unlock(&q->mutex);
+}
+
+static
+void
+pipeline_batch_clear(struct pipeline_batch *b)
+{
+  for (size_t i = 0; i < b->count; i++) {
+    cjson_free(b->nodes[i]);
+  }
+  b->count = 0;
+  b->failed = 0;
+}
+
+static
+void
+pipeline_batch_append(struct pipeline_batch *b, struct cjson *node)
+{
+  if (b->count == b->capacity) {
+    size_t capacity = b->capacity == 0 ? 64 : b->capacity * 2;
+    b->nodes = ecx_realloc(b->nodes, capacity * sizeof(*b->nodes));
+    b->capacity = capacity;
+  }
+
+  b->nodes[b->count++] = node;
+}
+
+/* Make room for at least length bytes in the batch. Return zero if the memory
+ * could not be allocated.
+ */
+static
+int
+pipeline_batch_reserve(struct pipeline_batch *b, size_t length)
+{
+  if (length <= b->size) {
+    return 1;
+  }
+
+  size_t size = b->size == 0 ? PIPELINE_BATCH : b->size * 2;
+  while (size < length) {
+    size *= 2;
+  }
+
+  char *bytes = realloc(b->bytes, size);
+  if (bytes == NULL) {
+    return 0;
+  }
+
+  b->bytes = bytes;
+  b->size = size;
+
+  return 1;
+}
+
+/* Cut the stream into batches that end at line breaks. The bytes after the
+ * last line break in a batch are carried over to the next one.
+ */
+static
+void *
+pipeline_read(void *arg)
+{
+  struct pipeline *p = arg;
+  struct pipeline_batch *b = NULL;
+  char *carry = NULL;
+  size_t carry_length = 0;
+  size_t carry_size = 0;
+  size_t sequence = 0;
+  long offset = 0;
+  unsigned int eof = 0;
+
+  while (!eof &&
+         !__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE) &&
+         (b = pipeline_queue_pop(&p->free)) != NULL) {
+    if (!pipeline_batch_reserve(b, carry_length + 1)) {
+      goto l_error;
+    }
+    memcpy(b->bytes, carry, carry_length);
+    b->length = carry_length;
+
+    /* Read until a line break is found (or the stream ends). */
+    size_t cut = 0;
+    size_t searched = 0;
+    for (;;) {
+      if (!pipeline_batch_reserve(b, b->length + 1)) {
+        goto l_error;
+      }
+
+      size_t count = fread(b->bytes + b->length, 1, b->size - b->length, p->stream);
+      if (count == 0) {
+        if (ferror(p->stream)) {
+          p->read_error = errno != 0 ? errno : EIO;
+          goto l_error;
+        }
+
+        eof = 1;
+        cut = b->length;
+        break;
+      }
+      b->length += count;
+
+      for (size_t i = b->length; i > searched; i--) {
+        if (b->bytes[i - 1] == '\n') {
+          cut = i;
+          break;
+        }
+      }
+      if (cut != 0) {
+        break;
+      }
+      searched = b->length;
+    }
+
+    carry_length = b->length - cut;
+    if (carry_length > carry_size) {
+      char *bytes = realloc(carry, carry_length);
+      if (bytes == NULL) {
+        goto l_error;
+      }
+      carry = bytes;
+      carry_size = carry_length;
+    }
+    memcpy(carry, b->bytes + cut, carry_length);
+    b->length = cut;
+
+    if (b->length == 0) {
+      pipeline_queue_push(&p->free, b);
+      continue;
+    }
+
+    b->sequence = sequence++;
+    b->offset = offset;
+    offset += b->length;
+    pipeline_queue_push(&p->work, b);
+  }
+
+  goto l_finish;
+
+l_error:
+  if (p->read_error == 0) {
+    p->read_error = ENOMEM;
+  }
+  pipeline_queue_push(&p->free, b);
+
+l_finish:
+  free(carry);
+  pipeline_queue_close(&p->work);
+
+  return NULL;
+}
+
+/* Parse the documents in the batch. Stop at the first invalid document. */
+static
+void
+pipeline_parse(struct pipeline *p, struct pipeline_batch *b)
+{
+  const char *msg = NULL;
+  struct scan scan, *s = &scan;
+  scan_mopen(s, b->bytes, b->length);
+
+  ec_try {
+    struct cjson *node = NULL;
+    while ((node = root_scan_item(s, p->valid, &p->root)) != NULL) {
+      ec_with_on_x(node, (ec_unwind_f)cjson_free) {
+        pipeline_batch_append(b, node);
+      }
+    }
+  } ec_catch_a(CJSONX_PARSE, msg) {
+    b->failed = 1;
+    snprintf(b->error, sizeof(b->error), "In the batch at %ld: %s", b->offset, msg);
+  } ec_catch {
+    b->failed = 1;
+    snprintf(b->error, sizeof(b->error), "In the batch at %ld: Failed to parse the batch.", b->offset);
+  }
+}
+
+static
+void *
+pipeline_work(void *arg)
+{
+  struct pipeline *p = arg;
+  struct pipeline_batch *b = NULL;
+
+  while ((b = pipeline_queue_pop(&p->work)) != NULL) {
+    if (!__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) {
+      pipeline_parse(p, b);
+    }
+    pipeline_queue_push(&p->done, b);
+  }
+
+  pthread_mutex_lock(&p->mutex);
+  p->running--;
+  if (p->running == 0) {
+    pipeline_queue_close(&p->done);
+  }
+  pthread_mutex_unlock(&p->mutex);
+
+  return NULL;
+}
+
+/* Stop reading and parsing. Batches already in the pipeline are discarded. */
+static
+void
+pipeline_halt(struct pipeline *p)
+{
+  __atomic_store_n(&p->stop, 1, __ATOMIC_RELEASE);
+  pipeline_queue_close(&p->free);
+}
+
+static
+void
+pipeline_init(struct pipeline *p, FILE *stream, enum cjson_type valid, size_t threads, struct cjson_hook *hook)
+{
+  p->stream = stream;
+  p->valid = valid;
+  cjson_init(&p->root, CJSON_ROOT, NULL);
+  p->root.hook = hook;
+
+  p->total = threads * PIPELINE_DEPTH;
+  p->batches = ecx_calloc(p->total, sizeof(*p->batches));
+  p->pending = ecx_calloc(p->total, sizeof(*p->pending));
+  p->workers = ecx_calloc(threads, sizeof(*p->workers));
+
+  p->reading = 0;
+  p->started = 0;
+  p->running = 0;
+  pthread_mutex_init(&p->mutex, NULL);
+
+  p->stop = 0;
+  p->read_error = 0;
+  p->failed = 0;
+
+  pipeline_queue_init(&p->free, p->total);
+  pipeline_queue_init(&p->work, p->total);
+  pipeline_queue_init(&p->done, p->total);
+
+  for (size_t i = 0; i < p->total; i++) {
+    pipeline_queue_push(&p->free, &p->batches[i]);
+  }
+}
+
+/* Stop the threads, wait for them to finish and release the pipeline. */
+static
+void
+pipeline_free(struct pipeline *p)
+{
+  struct pipeline_batch *b = NULL;
+
+  pipeline_halt(p);
+  if (!p->reading) {
+    pipeline_queue_close(&p->work);
+  }
+  if (p->started == 0) {
+    pipeline_queue_close(&p->done);
+  }
+
+  while ((b = pipeline_queue_pop(&p->done)) != NULL) {
+    pipeline_batch_clear(b);
+  }
+
+  if (p->reading) {
+    pthread_join(p->reader, NULL);
+  }
+  for (size_t i = 0; i < p->started; i++) {
+    pthread_join(p->workers[i], NULL);
+  }
+
+  for (size_t i = 0; i < p->total; i++) {
+    if (p->pending[i] != NULL) {
+      pipeline_batch_clear(p->pending[i]);
+    }
+    free(p->batches[i].bytes);
+    free(p->batches[i].nodes);
+  }
+
+  pipeline_queue_destroy(&p->done);
+  pipeline_queue_destroy(&p->work);
+  pipeline_queue_destroy(&p->free);
+  pthread_mutex_destroy(&p->mutex);
+
+  free(p->workers);
+  free(p->pending);
+  free(p->batches);
+}
+
+static
+void
+pipeline_start(struct pipeline *p, size_t threads)
+{
+  int error = 0;
+
+  for (size_t i = 0; i < threads; i++) {
+    pthread_mutex_lock(&p->mutex);
+    p->running++;
+    pthread_mutex_unlock(&p->mutex);
+
+    error = pthread_create(&p->workers[i], NULL, pipeline_work, p);
+    if (error != 0) {
+      pthread_mutex_lock(&p->mutex);
+      p->running--;
+      pthread_mutex_unlock(&p->mutex);
+      ec_throw_strf(ECX_EC, "Failed to start a worker thread: %s.", strerror(error));
+    }
+    p->started++;
+  }
+
+  error = pthread_create(&p->reader, NULL, pipeline_read, p);
+  if (error != 0) {
+    ec_throw_strf(ECX_EC, "Failed to start the reader thread: %s.", strerror(error));
+  }
+  p->reading = 1;
+}
+
+/* Hand the documents in the batch to the consumer and return the batch to the
+ * reader. Once the consumer or a parse error stops the pipeline, the
+ * remaining documents are discarded.
+ */
+static
+int
+pipeline_deliver(struct pipeline *p, struct pipeline_batch *b, int (*consume)(void *data, struct cjson *node), void *data, int status)
+{
+  ec_with(b, (ec_unwind_f)pipeline_batch_clear) {
+    for (size_t i = 0; i < b->count && status == 0 && !p->failed; i++) {
+      struct cjson *node = b->nodes[i];
+      b->nodes[i] = NULL;
+      status = consume(data, node);
+    }
+
+    if (b->failed && status == 0 && !p->failed) {
+      p->failed = 1;
+      memcpy(p->error, b->error, sizeof(p->error));
+    }
+
+    if (status != 0 || p->failed) {
+      pipeline_halt(p);
+    }
+  }
+
+  pipeline_queue_push(&p->free, b);
+
+  return status;
+}
+
+static
+int
+pipeline_consume(struct pipeline *p, unsigned int ordered, int (*consume)(void *data, struct cjson *node), void *data)
+{
+  int status = 0;
+  size_t next = 0;
+  struct pipeline_batch *b = NULL;
+
+  while ((b = pipeline_queue_pop(&p->done)) != NULL) {
+    if (!ordered) {
+      status = pipeline_deliver(p, b, consume, data, status);
+      continue;
+    }
+
+    /* Every batch in the pipeline is within total of the next one. */
+    p->pending[b->sequence % p->total] = b;
+    while ((b = p->pending[next % p->total]) != NULL) {
+      p->pending[next % p->total] = NULL;
+      next++;
+      status = pipeline_deliver(p, b, consume, data, status);
+    }
+  }
+
+  return status;
+}
+
+int
+cjson_pipeline_fscan(FILE *stream, enum cjson_type valid, unsigned int threads, unsigned int ordered, int (*consume)(void *data, struct cjson *node), void *data, struct cjson_hook *hook)
+{
+  int status = 0;
+
+  if (threads == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = online > 0 ? online : 1;
+  }
+
+  struct pipeline pipeline, *p = &pipeline;
+  pipeline_init(p, stream, valid, threads, hook);
+  ec_with(p, (ec_unwind_f)pipeline_free) {
+    pipeline_start(p, threads);
+    status = pipeline_consume(p, ordered, consume, data);
+  }
+
+  if (p->failed) {
+    ec_throw_strf(CJSONX_PARSE, "%s", p->error);
+  }
+
+  if (p->read_error != 0 && status == 0) {
+    ec_throw_strf(ECX_EC, "Failed to read from the stream: %s.", strerror(p->read_error));
+  }
+
+  return status;
+}
@@ -0,0 +1,615 @@
+/*** cjson projection ***/
+
+/* A projected parse keeps only the values at a set of paths (and the
+ * containers leading to them). Everything else is read by project_skip, which
+ * checks that it is valid without building any nodes. The paths are kept as a
+ * tree with one node for each distinct segment.
+ */
+struct project {
+  char *segment;              /* JSON Escaped String (jestr). */
+  size_t length;
+  size_t index;               /* The segment as an array index (or SIZE_MAX). */
+  unsigned int whole;         /* A path ends here, so the value is kept whole. */
+  struct project *child;      /* The first segment that follows this one. */
+  struct project *next;       /* The next segment that follows the same parent. */
+};
+
+static
+void
+project_free(struct project *p)
+{
+  while (p != NULL) {
+    struct project *next = p->next;
+    project_free(p->child);
+    free(p->segment);
+    free(p);
+    p = next;
+  }
+}
+
+static
+struct project *
+project_new(const char *segment, size_t length)
+{
+  struct project *p = ecx_malloc(sizeof(*p));
+  p->segment = NULL;
+  p->length = length;
+  p->index = SIZE_MAX;
+  p->whole = 0;
+  p->child = NULL;
+  p->next = NULL;
+
+  ec_with_on_x(p, (ec_unwind_f)project_free) {
+    p->segment = ecx_malloc(length + 1);
+  }
+  memcpy(p->segment, segment, length);
+  p->segment[length] = '\0';
+
+  char extra = 0;
+  if (sscanf(p->segment, "%zu%c", &p->index, &extra) != 1) {
+    p->index = SIZE_MAX;
+  }
+
+  return p;
+}
+
+/* Return the segment following p that matches the key (or NULL). */
+static
+struct project *
+project_find(struct project *p, const char *key, size_t length)
+{
+  for (struct project *child = p->child; child != NULL; child = child->next) {
+    if (child->length == length && memcmp(child->segment, key, length) == 0) {
+      return child;
+    }
+  }
+
+  return NULL;
+}
+
+/* Return the segment following p that matches the array index (or NULL). */
+static
+struct project *
+project_index(struct project *p, size_t index)
+{
+  for (struct project *child = p->child; child != NULL; child = child->next) {
+    if (child->index == index) {
+      return child;
+    }
+  }
+
+  return NULL;
+}
+
+/* Add the null separated path segments (as used by cjson_get) below p. */
+static
+void
+project_add(struct project *p, const char *segments)
+{
+  const char *segment = segments;
+  size_t length = strlen(segment);
+  while (length != 0 && !p->whole) {
+    struct project *child = NULL;
+    char *normalized = cjson_jestr_normalize(segment);
+    ec_with(normalized, free) {
+      size_t n = strlen(normalized);
+      child = project_find(p, normalized, n);
+      if (child == NULL) {
+        child = project_new(normalized, n);
+        child->next = p->child;
+        p->child = child;
+      }
+    }
+
+    p = child;
+    segment = segment + length + 1;
+    length = strlen(segment);
+  }
+
+  p->whole = 1;
+}
+
+static
+struct project *
+project_paths(const char **paths, size_t count)
+{
+  struct project *p = project_new("", 0);
+  ec_with_on_x(p, (ec_unwind_f)project_free) {
+    for (size_t i = 0; i < count; i++) {
+      project_add(p, paths[i]);
+    }
+  }
+
+  return p;
+}
+
+/* Return the next byte that isn't whitespace. */
+static inline
+int
+project_getc(struct scan *s)
+{
+  int current = scan_getc(s);
+  if (scan_isspace(current)) {
+    scan_skip_whitespace(s);
+    current = scan_getc(s);
+  }
+
+  return current;
+}
+
+/* Read the next value without building any nodes. Strings, keys and numbers
+ * are read into the buffer, which is reused for every token. Containers are
+ * nested no deeper than the hook allows (see scan_enter).
+ */
+static
+void
+project_skip(struct scan *s, struct scan_buffer *b, struct cjson_hook *hook)
+{
+  static void *go_value[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['['] = &&l_array,
+
+    ['-']       = &&l_number,
+    [48 ... 57] = &&l_number,
+
+    ['{'] = &&l_object,
+
+    ['"'] = &&l_string,
+
+    ['t'] = &&l_boolean,
+    ['f'] = &&l_boolean,
+    ['n'] = &&l_null,
+  };
+
+  int current = project_getc(s);
+  if (current == EOF) {
+    ec_throw_strf(CJSONX_PARSE, "Expecting more data at %ld; Value was not specified.", scan_tell(s));
+  }
+  goto *go_value[current];
+
+l_invalid:
+  scanx_parse_c(s, current, "Expecting to find a JSON type to parse.");
+
+l_array:
+  scan_enter(s, hook, current);
+  current = project_getc(s);
+  if (current == ']') {
+    scan_leave(s);
+    return;
+  }
+  scan_ungetc(s, current);
+
+  for (;;) {
+    project_skip(s, b, hook);
+
+    current = project_getc(s);
+    if (current == ']') {
+      scan_leave(s);
+      return;
+    }
+    if (current != ',') {
+      scanx_parse_c(s, current, "Expecting ',' or ']'.");
+    }
+  }
+
+l_object:
+  scan_enter(s, hook, current);
+  current = project_getc(s);
+  if (current == '}') {
+    scan_leave(s);
+    return;
+  }
+
+  for (;;) {
+    if (current != '"') {
+      scanx_parse_c(s, current, "Expecting to find a JSON key/value pair to parse.");
+    }
+    scan_ungetc(s, current);
+    b->length = 0;
+    jestr_scanb(s, b, 0);
+
+    current = project_getc(s);
+    if (current != ':') {
+      scanx_parse_c(s, current, "Expecting ':'.");
+    }
+    project_skip(s, b, hook);
+
+    current = project_getc(s);
+    if (current == '}') {
+      scan_leave(s);
+      return;
+    }
+    if (current != ',') {
+      scanx_parse_c(s, current, "Expecting ',' or '}'.");
+    }
+    current = project_getc(s);
+  }
+
+l_string:
+  scan_ungetc(s, current);
+  b->length = 0;
+  jestr_scanb(s, b, 0);
+  return;
+
+l_number:
+  scan_ungetc(s, current);
+  b->length = 0;
+  number_scanb(s, b);
+  return;
+
+l_boolean:
+  scan_ungetc(s, current);
+  boolean_scan_token(s);
+  return;
+
+l_null:
+  scan_ungetc(s, current);
+  null_scan_token(s);
+  return;
+}
+
+/* Read the value that begins with current (which has been returned to the
+ * scan) into a node.
+ */
+static
+struct cjson *
+project_whole(struct scan *s, struct cjson *parent, int current)
+{
+  switch (current) {
+    case '[':
+      return array_scan(s, parent);
+    case '{':
+      return object_scan(s, parent);
+    case '"':
+      return string_scan(s, parent);
+    case 't':
+    case 'f':
+      return boolean_scan(s, parent);
+    case 'n':
+      return null_scan(s, parent);
+    case '-':
+    case '0' ... '9':
+      return number_scan(s, parent);
+  }
+
+  if (current == EOF) {
+    ec_throw_strf(CJSONX_PARSE, "Expecting more data at %ld; Value was not specified.", scan_tell(s));
+  }
+  scanx_parse_c(s, current, "Expecting to find a JSON type to parse.");
+}
+
+static struct cjson *project_array(struct scan *s, struct cjson *parent, struct project *p, struct scan_buffer *b);
+static struct cjson *project_object(struct scan *s, struct cjson *parent, struct project *p, struct scan_buffer *b);
+
+/* Read the next value keeping only the parts selected by p. Returns NULL if
+ * nothing was selected (the value isn't a container to look into).
+ */
+static
+struct cjson *
+project_value(struct scan *s, struct cjson *parent, struct project *p, struct scan_buffer *b)
+{
+  int current = project_getc(s);
+  scan_ungetc(s, current);
+
+  if (p->whole) {
+    return project_whole(s, parent, current);
+  }
+
+  if (current == '[') {
+    return project_array(s, parent, p, b);
+  }
+  else if (current == '{') {
+    return project_object(s, parent, p, b);
+  }
+
+  project_skip(s, b, parent->hook);
+  return NULL;
+}
+
+/* Elements before the last selected one are kept as null, so the selected
+ * elements keep their indexes.
+ */
+static
+struct cjson *
+project_array(struct scan *s, struct cjson *parent, struct project *p, struct scan_buffer *b)
+{
+  size_t last = 0;
+  unsigned int any = 0;
+  for (struct project *child = p->child; child != NULL; child = child->next) {
+    if (child->index != SIZE_MAX && (!any || child->index > last)) {
+      last = child->index;
+      any = 1;
+    }
+  }
+
+  struct cjson *node = cjson_malloc(CJSON_ARRAY, parent);
+  ec_with_on_x(node, (ec_unwind_f)cjson_free) {
+    /* The '[' was found by project_value. */
+    scan_getc(s);
+
+    int current = project_getc(s);
+    if (current != ']') {
+      scan_ungetc(s, current);
+
+      for (size_t index = 0;; index++) {
+        struct cjson *item = NULL;
+        struct project *selected = any && index <= last ? project_index(p, index) : NULL;
+        if (selected != NULL) {
+          item = project_value(s, node, selected, b);
+        }
+        else {
+          project_skip(s, b, node->hook);
+        }
+
+        if (item == NULL && any && index < last) {
+          item = cjson_malloc(CJSON_NULL, node);
+        }
+
+        if (item != NULL) {
+          ec_with_on_x(item, (ec_unwind_f)cjson_free) {
+            cjson_array_append(node, item);
+          }
+        }
+
+        current = project_getc(s);
+        if (current == ']') {
+          break;
+        }
+        if (current != ',') {
+          scanx_parse_c(s, current, "Expecting ',' or ']'.");
+        }
+      }
+    }
+
+    if (node->hook &&
+        node->hook->valid) {
+      node->hook->valid(node);
+    }
+  }
+
+  return node;
+}
+
+/* Read the value of the pair whose key is in the buffer and add it to the
+ * object (unless nothing in it was selected).
+ */
+static
+void
+project_pair(struct scan *s, struct cjson *object, struct project *p, struct scan_buffer *b)
+{
+  struct cjson *pair = scan_buffer_node(b, CJSON_PAIR, object);
+  ec_with_on_x(pair, (ec_unwind_f)cjson_free) {
+    pair->value.pair.value = project_value(s, pair, p, b);
+  }
+
+  if (pair->value.pair.value == NULL) {
+    cjson_free(pair);
+    return;
+  }
+
+  ec_with_on_x(pair, (ec_unwind_f)cjson_free) {
+    if (pair->hook &&
+        pair->hook->valid) {
+      pair->hook->valid(pair);
+    }
+
+    struct cjson *old = cjson_object_set(object, pair);
+    if (old != NULL) {
+      ec_throw_strf(CJSONX_PARSE, "Invalid duplicate key at %ld: \"%s\".", scan_tell(s), old->value.pair.key);
+    }
+  }
+}
+
+static
+struct cjson *
+project_object(struct scan *s, struct cjson *parent, struct project *p, struct scan_buffer *b)
+{
+  struct cjson *node = cjson_malloc(CJSON_OBJECT, parent);
+  ec_with_on_x(node, (ec_unwind_f)cjson_free) {
+    /* The '{' was found by project_value. */
+    scan_getc(s);
+
+    int current = project_getc(s);
+    for (; current != '}'; current = project_getc(s)) {
+      if (current != '"') {
+        scanx_parse_c(s, current, "Expecting to find a JSON key/value pair to parse.");
+      }
+      scan_ungetc(s, current);
+      b->length = 0;
+      jestr_scanb(s, b, 0);
+
+      struct project *selected = project_find(p, b->bytes, b->length);
+
+      current = project_getc(s);
+      if (current != ':') {
+        scanx_parse_c(s, current, "Expecting ':'.");
+      }
+
+      if (selected != NULL) {
+        project_pair(s, node, selected, b);
+      }
+      else {
+        project_skip(s, b, node->hook);
+      }
+
+      current = project_getc(s);
+      if (current == '}') {
+        break;
+      }
+      if (current != ',') {
+        scanx_parse_c(s, current, "Expecting ',' or '}'.");
+      }
+      current = project_getc(s);
+      if (current == '}') {
+        scanx_parse_c(s, current, "Expecting to find a JSON key/value pair to parse.");
+      }
+      scan_ungetc(s, current);
+    }
+
+    if (node->hook &&
+        node->hook->valid) {
+      node->hook->valid(node);
+    }
+  }
+
+  return node;
+}
+
+static
+struct cjson *
+project_root_scan(struct scan *s, enum cjson_type valid, unsigned int continuous, struct project *p, struct scan_buffer *b, struct cjson_hook *hook)
+{
+  struct cjson *node = root_malloc(hook);
+  ec_with_on_x(node, (ec_unwind_f)cjson_free) {
+    int current = 0;
+    enum cjson_type type = 0;
+    struct cjson *child = NULL;
+
+    static void *go_root[] = {
+      [0 ... 255] = &&l_invalid,
+
+      ['\t'] = &&l_whitespace,
+      [' ']  = &&l_whitespace,
+      ['\r'] = &&l_whitespace,
+      ['\n'] = &&l_whitespace,
+
+      ['['] = &&l_array,
+
+      ['-']       = &&l_number,
+      [48 ... 57] = &&l_number,
+
+      ['{'] = &&l_object,
+
+      ['"'] = &&l_string,
+
+      ['t'] = &&l_boolean,
+      ['f'] = &&l_boolean,
+      ['n'] = &&l_null,
+    };
+
+    static void *go_root_next[] = {
+      [0 ... 255] = &&l_invalid,
+
+      ['\t'] = &&l_whitespace,
+      [' ']  = &&l_whitespace,
+      ['\r'] = &&l_root_next,
+      ['\n'] = &&l_root_next,
+    };
+
+    void **go = go_root;
+
+    current = scan_getc(s);
+    for (; current != EOF; current = scan_getc(s)) {
+      goto *go[current];
+l_loop:;
+    }
+
+    goto l_root_finish;
+
+l_invalid:
+    scanx_parse_c(s, current, "Expecting to find a JSON type to parse.");
+
+l_whitespace:
+    /* Line breaks separate items, so they are only skipped between them. */
+    if (go == go_root) {
+      scan_skip_whitespace(s);
+    }
+    goto l_loop;
+
+l_array:
+    type = CJSON_ARRAY;
+    goto l_item;
+
+l_number:
+    type = CJSON_NUMBER;
+    goto l_item;
+
+l_object:
+    type = CJSON_OBJECT;
+    goto l_item;
+
+l_string:
+    type = CJSON_STRING;
+    goto l_item;
+
+l_boolean:
+    type = CJSON_BOOLEAN;
+    goto l_item;
+
+l_null:
+    type = CJSON_NULL;
+    goto l_item;
+
+l_item:
+    scan_ungetc(s, current);
+    if ((valid & type) == 0) {
+      scanx_parse_c(s, current, "Found a value, but it is not a valid type for a bare item.");
+    }
+
+    /* Documents that aren't containers have nothing to select from. */
+    if (type == CJSON_ARRAY || type == CJSON_OBJECT) {
+      child = project_value(s, node, p, b);
+    }
+    else {
+      child = project_whole(s, node, current);
+    }
+    ec_with_on_x(child, (ec_unwind_f)cjson_free) {
+      cjson_array_append(node, child);
+    }
+    go = go_root_next;
+    goto l_loop;
+
+l_root_next:
+    if (continuous != 0) {
+      go = go_root;
+      goto l_loop;
+    }
+    goto l_root_finish;
+
+l_root_finish:
+    if (node->hook &&
+        node->hook->valid) {
+      node->hook->valid(node);
+    }
+  }
+
+  return node;
+}
+
+struct cjson *
+cjson_root_fscan_project(FILE *stream, enum cjson_type valid, unsigned int continuous, const char **paths, size_t count, struct cjson_hook *hook)
+{
+  struct cjson *node = NULL;
+  struct project *p = project_paths(paths, count);
+  ec_with(p, (ec_unwind_f)project_free) {
+    struct scan_buffer buffer = SCAN_BUFFER_INIT(hook_allocator(hook)), *b = &buffer;
+    ec_with(b, (ec_unwind_f)scan_buffer_free) {
+      uint8_t block[SCAN_BLOCK];
+      struct scan scan, *s = &scan;
+      scan_fopen(s, stream, block, sizeof(block), continuous);
+      ec_with(s, (ec_unwind_f)scan_fclose) {
+        node = project_root_scan(s, valid, continuous, p, b, hook);
+      }
+    }
+  }
+
+  return node;
+}
+
+struct cjson *
+cjson_root_parse_project(const char *buf, size_t length, enum cjson_type valid, unsigned int continuous, const char **paths, size_t count, struct cjson_hook *hook)
+{
+  struct cjson *node = NULL;
+  struct project *p = project_paths(paths, count);
+  ec_with(p, (ec_unwind_f)project_free) {
+    struct scan_buffer buffer = SCAN_BUFFER_INIT(hook_allocator(hook)), *b = &buffer;
+    ec_with(b, (ec_unwind_f)scan_buffer_free) {
+      struct scan scan, *s = &scan;
+      scan_mopen(s, buf, length);
+      node = project_root_scan(s, valid, continuous, p, b, hook);
+    }
+  }
+
+  return node;
+}
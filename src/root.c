@@ -1,155 +1,225 @@
 /*** cjson root ***/
 
+static
+struct cjson *
+root_scan(struct scan *s, enum cjson_type valid, unsigned int continuous, struct cjson_hook *hook)
+{
+  struct build state, *x = &state;
+  build_init(x, hook);
+  return build_root(x, s, valid, continuous, hook);
+}
+
 struct cjson *
 cjson_root_fscan(FILE *stream, enum cjson_type valid, unsigned int continuous, struct cjson_hook *hook)
 {
   struct cjson *node = NULL;
-  if (hook != NULL &&
-      hook->cjson_malloc != NULL) {
-    node = hook->cjson_malloc(CJSON_ROOT, NULL);
+  uint8_t block[SCAN_BLOCK];
+  struct scan scan, *s = &scan;
+  scan_fopen(s, stream, block, sizeof(block), continuous);
+  ec_with(s, (ec_unwind_f)scan_fclose) {
+    node = root_scan(s, valid, continuous, hook);
   }
-  else {
-    node = cjson_malloc(CJSON_ROOT, NULL);
+
+  return node;
+}
+
+struct cjson *
+cjson_root_parse(const char *buf, size_t length, enum cjson_type valid, unsigned int continuous, struct cjson_hook *hook)
+{
+  struct scan scan, *s = &scan;
+  scan_mopen(s, buf, length);
+  return root_scan(s, valid, continuous, hook);
+}
+
+struct cjson *
+cjson_root_parse_file(const char *path, enum cjson_type valid, unsigned int continuous, struct cjson_hook *hook)
+{
+  struct cjson *node = NULL;
+  struct scan scan, *s = &scan;
+  scan_mmap(s, path);
+  ec_with(s, (ec_unwind_f)scan_munmap) {
+    node = root_scan(s, valid, continuous, hook);
   }
-  node->hook = hook;
-  ec_with_on_x(node, (ec_unwind_f)cjson_free) {
-    int current = 0;
-    struct cjson *child = NULL;
 
-    static void *go_root[] = {
-      [0 ... 255] = &&l_invalid,
+  return node;
+}
+
+/* The record separator that starts each text of a JSON text sequence
+ * (RFC 7464).
+ */
+#define ROOT_RS 0x1E
 
-      ['\t'] = &&l_whitespace,
-      [' ']  = &&l_whitespace,
-      ['\r'] = &&l_whitespace,
-      ['\n'] = &&l_whitespace,
+struct cjson_root_iter {
+  enum cjson_type valid;
+  struct cjson root;          /* Holds the hook for the documents (never has children). */
+  struct scan scan;
+  uint8_t block[SCAN_BLOCK];
+};
 
-      ['['] = &&l_array,
+/* Return the next document in the scan or NULL if there are no more. */
+static
+struct cjson *
+root_scan_item(struct scan *s, enum cjson_type valid, struct cjson *parent)
+{
+  int current = 0;
+  struct cjson *child = NULL;
 
-      ['-']       = &&l_number,
-      [48 ... 57] = &&l_number,
+  static void *go_item[] = {
+    [0 ... 255] = &&l_invalid,
 
-      ['{'] = &&l_object,
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+    [ROOT_RS] = &&l_record,
 
-      ['"'] = &&l_string,
+    ['['] = &&l_array,
 
-      ['t'] = &&l_boolean,
-      ['f'] = &&l_boolean,
-      ['n'] = &&l_null,
-    };
+    ['-']       = &&l_number,
+    [48 ... 57] = &&l_number,
 
-    static void *go_root_next[] = {
-      [0 ... 255] = &&l_invalid,
+    ['{'] = &&l_object,
 
-      ['\t'] = &&l_whitespace,
-      [' ']  = &&l_whitespace,
-      ['\r'] = &&l_root_next,
-      ['\n'] = &&l_root_next,
-    };
+    ['"'] = &&l_string,
 
-    void **go = go_root;
+    ['t'] = &&l_boolean,
+    ['f'] = &&l_boolean,
+    ['n'] = &&l_null,
+  };
 
-    current = ecx_fgetc(stream);
-    for (; current != EOF; errno = 0, current = ecx_fgetc(stream)) {
-      goto *go[current];
+  /* Each document starts outside of any container. */
+  s->depth = 0;
+
+  current = scan_getc(s);
+  for (; current != EOF; current = scan_getc(s)) {
+    goto *go_item[current];
 l_loop:;
-    }
+  }
 
-    goto l_root_finish;
+  return NULL;
 
 l_invalid:
-    cjsonx_parse_c(stream, current, "Expecting to find a JSON type to parse.");
+  scanx_parse_c(s, current, "Expecting to find a JSON type to parse.");
 
 l_whitespace:
-    goto l_loop;
+  scan_skip_whitespace(s);
+  goto l_loop;
+
+l_record:
+  /* The index does not mark a value that directly follows a separator, so
+   * it is not used to skip over them.
+   */
+  goto l_loop;
 
 l_array:
-    ecx_ungetc(current, stream);
-    if (valid & CJSON_ARRAY == 0) {
-      ec_throw_str_static(CJSONX_PARSE, "Found an array, but it is not a valid type for a bare item.");
-    }
-    child = cjson_array_fscan(stream, node);
-    ec_with_on_x(child, (ec_unwind_f)cjson_free) {
-      cjson_array_append(node, child);
-    }
-    go = go_root_next;
-    goto l_loop;
+  scan_ungetc(s, current);
+  if ((valid & CJSON_ARRAY) == 0) {
+    ec_throw_str_static(CJSONX_PARSE, "Found an array, but it is not a valid type for a bare item.");
+  }
+  child = array_scan(s, parent);
+  goto l_separator;
 
 l_number:
-    ecx_ungetc(current, stream);
-    if (valid & CJSON_NUMBER == 0) {
-      ec_throw_str_static(CJSONX_PARSE, "Found a number, but it is not a valid type for a bare item.");
-    }
-    child = cjson_number_fscan(stream, node);
-    ec_with_on_x(child, (ec_unwind_f)cjson_free) {
-      cjson_array_append(node, child);
-    }
-    go = go_root_next;
-    goto l_loop;
+  scan_ungetc(s, current);
+  if ((valid & CJSON_NUMBER) == 0) {
+    ec_throw_str_static(CJSONX_PARSE, "Found a number, but it is not a valid type for a bare item.");
+  }
+  child = number_scan(s, parent);
+  goto l_separator;
 
 l_object:
-    ecx_ungetc(current, stream);
-    if (valid & CJSON_OBJECT == 0) {
-      ec_throw_str_static(CJSONX_PARSE, "Found an object, but it is not a valid type for a bare item.");
-    }
-    child = cjson_object_fscan(stream, node);
-    ec_with_on_x(child, (ec_unwind_f)cjson_free) {
-      cjson_array_append(node, child);
-    }
-    go = go_root_next;
-    goto l_loop;
+  scan_ungetc(s, current);
+  if ((valid & CJSON_OBJECT) == 0) {
+    ec_throw_str_static(CJSONX_PARSE, "Found an object, but it is not a valid type for a bare item.");
+  }
+  child = object_scan(s, parent);
+  goto l_separator;
 
 l_string:
-    ecx_ungetc(current, stream);
-    if (valid & CJSON_STRING == 0) {
-      ec_throw_str_static(CJSONX_PARSE, "Found a string, but it is not a valid type for a bare item.");
-    }
-    child = cjson_string_fscan(stream, node);
-    ec_with_on_x(child, (ec_unwind_f)cjson_free) {
-      cjson_array_append(node, child);
-    }
-    go = go_root_next;
-    goto l_loop;
+  scan_ungetc(s, current);
+  if ((valid & CJSON_STRING) == 0) {
+    ec_throw_str_static(CJSONX_PARSE, "Found a string, but it is not a valid type for a bare item.");
+  }
+  child = string_scan(s, parent);
+  goto l_separator;
 
 l_boolean:
-    ecx_ungetc(current, stream);
-    if (valid & CJSON_BOOLEAN == 0) {
-      ec_throw_str_static(CJSONX_PARSE, "Found a boolean, but it is not a valid type for a bare item.");
-    }
-    child = cjson_boolean_fscan(stream, node);
-    ec_with_on_x(child, (ec_unwind_f)cjson_free) {
-      cjson_array_append(node, child);
-    }
-    go = go_root_next;
-    goto l_loop;
+  scan_ungetc(s, current);
+  if ((valid & CJSON_BOOLEAN) == 0) {
+    ec_throw_str_static(CJSONX_PARSE, "Found a boolean, but it is not a valid type for a bare item.");
+  }
+  child = boolean_scan(s, parent);
+  goto l_separator;
 
 l_null:
-    ecx_ungetc(current, stream);
-    if (valid & CJSON_NULL == 0) {
-      ec_throw_str_static(CJSONX_PARSE, "Found a null, but it is not a valid type for a bare item.");
-    }
-    child = cjson_null_fscan(stream, node);
-    ec_with_on_x(child, (ec_unwind_f)cjson_free) {
-      cjson_array_append(node, child);
-    }
-    go = go_root_next;
-    goto l_loop;
+  scan_ungetc(s, current);
+  if ((valid & CJSON_NULL) == 0) {
+    ec_throw_str_static(CJSONX_PARSE, "Found a null, but it is not a valid type for a bare item.");
+  }
+  child = null_scan(s, parent);
+  goto l_separator;
 
-l_root_next:
-    if (continuous != 0) {
-      go = go_root;
-      goto l_loop;
+l_separator:
+  /* Documents must be followed by whitespace, a record separator or EOF. */
+  ec_with_on_x(child, (ec_unwind_f)cjson_free) {
+    current = scan_peek(s);
+    if (current != EOF && current != ROOT_RS && !scan_isspace(current)) {
+      scanx_parse_c(s, current, "Expecting a separator after the document.");
     }
-    goto l_root_finish;
+  }
+  child->parent = NULL;
 
-l_root_finish:
-    if (node->hook &&
-        node->hook->valid) {
-      node->hook->valid(node);
-    }
+  return child;
+}
+
+static
+struct cjson_root_iter *
+root_iter_new(enum cjson_type valid, struct cjson_hook *hook)
+{
+  struct cjson_root_iter *iter = ecx_malloc(sizeof(*iter));
+  iter->valid = valid;
+  cjson_init(&iter->root, CJSON_ROOT, NULL);
+  iter->root.hook = hook;
+
+  return iter;
+}
+
+struct cjson_root_iter *
+cjson_root_iter_fscan(FILE *stream, enum cjson_type valid, struct cjson_hook *hook)
+{
+  struct cjson_root_iter *iter = root_iter_new(valid, hook);
+
+  /* The iterator reads until EOF, so it can always read ahead. */
+  scan_fopen(&iter->scan, stream, iter->block, sizeof(iter->block), 1);
+
+  return iter;
+}
+
+struct cjson_root_iter *
+cjson_root_iter_parse(const char *buf, size_t length, enum cjson_type valid, struct cjson_hook *hook)
+{
+  struct cjson_root_iter *iter = root_iter_new(valid, hook);
+  scan_mopen(&iter->scan, buf, length);
+
+  return iter;
+}
+
+struct cjson *
+cjson_root_iter_next(struct cjson_root_iter *iter)
+{
+  return root_scan_item(&iter->scan, iter->valid, &iter->root);
+}
+
+void
+cjson_root_iter_free(struct cjson_root_iter *iter)
+{
+  if (iter == NULL) {
+    return;
   }
 
-  return node;
+  ec_with(iter, free) {
+    scan_fclose(&iter->scan);
+  }
 }
 
 void
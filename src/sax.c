@@ -0,0 +1,622 @@
+/*** cjson SAX parser ***/
+
+/* The SAX parser runs the JSON grammar as a single loop over an explicit
+ * stack of open containers instead of recursing through the node parsers.
+ * Strings, keys and numbers are read into one buffer that is reused for every
+ * token, so no memory is allocated once the buffer and stack have grown to fit
+ * the input.
+ */
+
+/* The kinds of open containers. */
+#define SAX_ARRAY  0
+#define SAX_OBJECT 1
+
+/* The depth of the stack that doesn't need to be allocated. */
+#define SAX_STACK 64
+
+struct sax {
+  const struct cjson_sax *sax;
+  void *data;
+
+  struct scan_buffer buffer;    /* The current string, key or number. */
+  unsigned int decode_keys;     /* Keys are UTF-8 rather than JSON encoded strings (jestr). */
+
+  uint8_t *stack;               /* The kind of each open container. */
+  size_t depth;                 /* The number of open containers. */
+  size_t size;                  /* The capacity of the stack. */
+  uint8_t storage[SAX_STACK];
+
+  void **go;                    /* The state to resume from (or NULL to start). */
+  unsigned int partial;         /* More input may follow the end of the scan. */
+  unsigned int more;            /* The scan ended before the input was complete. */
+  const uint8_t *mark;          /* The start of the incomplete token. */
+};
+
+static
+void
+sax_init(struct sax *x, const struct cjson_sax *sax, void *data)
+{
+  x->sax = sax;
+  x->data = data;
+
+  x->buffer = (struct scan_buffer)SCAN_BUFFER_INIT(NULL);
+  x->decode_keys = 1;
+
+  x->stack = x->storage;
+  x->depth = 0;
+  x->size = sizeof(x->storage);
+
+  x->go = NULL;
+  x->partial = 0;
+  x->more = 0;
+  x->mark = NULL;
+}
+
+static
+void
+sax_free(struct sax *x)
+{
+  scan_buffer_free(&x->buffer);
+
+  if (x->stack != x->storage) {
+    free(x->stack);
+  }
+  x->stack = x->storage;
+  x->size = sizeof(x->storage);
+}
+
+static inline
+void
+sax_push(struct sax *x, uint8_t kind)
+{
+  if (x->depth == x->size) {
+    uint8_t *stack = ecx_malloc(x->size * 2);
+    memcpy(stack, x->stack, x->depth);
+    if (x->stack != x->storage) {
+      free(x->stack);
+    }
+    x->stack = stack;
+    x->size *= 2;
+  }
+
+  x->stack[x->depth++] = kind;
+}
+
+/* Return true if the token that began with current (the byte before the
+ * cursor) ends within the scan's region. Numbers and literals must also be
+ * followed by another byte, since they end only where something else begins.
+ */
+static
+int
+sax_complete(struct scan *s, int current)
+{
+  const uint8_t *p = s->cursor;
+
+  if (current != '"') {
+    while (p != s->end && ((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || *p == '-' || *p == '+' || *p == '.')) {
+      p++;
+    }
+    return p != s->end;
+  }
+
+  for (;;) {
+    const uint8_t *quote = memchr(p, '"', s->end - p);
+    if (quote == NULL) {
+      return 0;
+    }
+
+    /* The quote is escaped if it follows an odd run of backslashes. */
+    const uint8_t *q = quote;
+    while (q != s->cursor && q[-1] == '\\') {
+      q--;
+    }
+    if ((quote - q) % 2 == 0) {
+      return 1;
+    }
+
+    p = quote + 1;
+  }
+}
+
+/* Call the event's callback (if any). Stop parsing if it returns non-zero. */
+#define sax_call(x,f,...) \
+  if ((x)->sax->f != NULL && \
+      (status = (x)->sax->f((x)->data, ##__VA_ARGS__)) != 0) { \
+    return status; \
+  } \
+
+/* Bare items (those not in a container) must be one of the valid types. */
+#define sax_valid(x,t,m) \
+  if ((x)->depth == 0 && (valid & (t)) == 0) { \
+    ec_throw_str_static(CJSONX_PARSE, m); \
+  } \
+
+/* Run the parser over the scan. Return zero once the input has been parsed or
+ * the non-zero value returned by a callback that stopped it early.
+ *
+ * If the scan is partial, the parser stops at the first token that does not
+ * end within the scan (or at the end of the scan) and sets more and mark. The
+ * parser resumes from the same state with the next scan.
+ */
+static
+int
+sax_scan(struct sax *x, struct scan *s, enum cjson_type valid, unsigned int continuous)
+{
+  int status = 0;
+  int current = 0;
+
+  static void *go_value[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    ['['] = &&l_array,
+
+    ['-']       = &&l_number,
+    [48 ... 57] = &&l_number,
+
+    ['{'] = &&l_object,
+
+    ['"'] = &&l_string,
+
+    ['t'] = &&l_boolean,
+    ['f'] = &&l_boolean,
+    ['n'] = &&l_null,
+  };
+
+  static void *go_root_next[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_root_next,
+    ['\n'] = &&l_root_next,
+  };
+
+  static void *go_array_first[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    ['['] = &&l_array,
+
+    ['-']       = &&l_number,
+    [48 ... 57] = &&l_number,
+
+    ['{'] = &&l_object,
+
+    ['"'] = &&l_string,
+
+    ['t'] = &&l_boolean,
+    ['f'] = &&l_boolean,
+    ['n'] = &&l_null,
+
+    [']'] = &&l_array_end,
+  };
+
+  static void *go_array_next[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    [','] = &&l_array_next,
+    [']'] = &&l_array_end,
+  };
+
+  static void *go_object_first[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    ['"'] = &&l_key,
+    ['}'] = &&l_object_end,
+  };
+
+  static void *go_object_key[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    ['"'] = &&l_key,
+  };
+
+  static void *go_object_colon[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    [':'] = &&l_object_colon,
+  };
+
+  static void *go_object_next[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['\t'] = &&l_whitespace,
+    [' ']  = &&l_whitespace,
+    ['\r'] = &&l_whitespace,
+    ['\n'] = &&l_whitespace,
+
+    [','] = &&l_object_next,
+    ['}'] = &&l_object_end,
+  };
+
+  if (x->go == NULL) {
+    x->go = go_value;
+  }
+
+  current = scan_getc(s);
+  for (; current != EOF; current = scan_getc(s)) {
+    goto *x->go[current];
+l_loop:;
+  }
+
+  if (x->partial) {
+    x->more = 1;
+    x->mark = s->cursor;
+    goto l_finish;
+  }
+
+  if (x->depth != 0) {
+    ec_throw_strf(CJSONX_PARSE, "Expecting more data at %ld; Failed to find end of %s.", scan_tell(s), x->stack[x->depth - 1] == SAX_ARRAY ? "array" : "object");
+  }
+
+  goto l_finish;
+
+l_invalid:
+  scanx_parse_c(s, current, "Expecting to find a JSON type to parse.");
+
+l_whitespace:
+  /* Line breaks separate bare items, so they are only skipped inside them. */
+  if (x->go != go_root_next) {
+    scan_skip_whitespace(s);
+  }
+  goto l_loop;
+
+l_array:
+  sax_valid(x, CJSON_ARRAY, "Found an array, but it is not a valid type for a bare item.");
+  sax_push(x, SAX_ARRAY);
+  sax_call(x, on_array_begin);
+  x->go = go_array_first;
+  goto l_loop;
+
+l_array_next:
+  x->go = go_value;
+  goto l_loop;
+
+l_array_end:
+  x->depth--;
+  sax_call(x, on_array_end);
+  goto l_value_end;
+
+l_object:
+  sax_valid(x, CJSON_OBJECT, "Found an object, but it is not a valid type for a bare item.");
+  sax_push(x, SAX_OBJECT);
+  sax_call(x, on_object_begin);
+  x->go = go_object_first;
+  goto l_loop;
+
+l_key:
+  if (x->partial && !sax_complete(s, current)) {
+    goto l_more;
+  }
+  scan_ungetc(s, current);
+  x->buffer.length = 0;
+  jestr_scanb(s, &x->buffer, x->decode_keys);
+  sax_call(x, on_key, x->buffer.bytes, x->buffer.length);
+  x->go = go_object_colon;
+  goto l_loop;
+
+l_object_colon:
+  x->go = go_value;
+  goto l_loop;
+
+l_object_next:
+  x->go = go_object_key;
+  goto l_loop;
+
+l_object_end:
+  x->depth--;
+  sax_call(x, on_object_end);
+  goto l_value_end;
+
+l_string:
+  sax_valid(x, CJSON_STRING, "Found a string, but it is not a valid type for a bare item.");
+  if (x->partial && !sax_complete(s, current)) {
+    goto l_more;
+  }
+  scan_ungetc(s, current);
+  x->buffer.length = 0;
+  jestr_scanb(s, &x->buffer, 1);
+  sax_call(x, on_string, x->buffer.bytes, x->buffer.length);
+  goto l_value_end;
+
+l_number:
+  sax_valid(x, CJSON_NUMBER, "Found a number, but it is not a valid type for a bare item.");
+  if (x->partial && !sax_complete(s, current)) {
+    goto l_more;
+  }
+  scan_ungetc(s, current);
+  x->buffer.length = 0;
+  number_scanb(s, &x->buffer);
+  sax_call(x, on_number, x->buffer.bytes, x->buffer.length);
+  goto l_value_end;
+
+l_boolean:
+  sax_valid(x, CJSON_BOOLEAN, "Found a boolean, but it is not a valid type for a bare item.");
+  if (x->partial && !sax_complete(s, current)) {
+    goto l_more;
+  }
+  scan_ungetc(s, current);
+  {
+    unsigned int boolean = boolean_scan_token(s);
+    sax_call(x, on_boolean, boolean);
+  }
+  goto l_value_end;
+
+l_null:
+  sax_valid(x, CJSON_NULL, "Found a null, but it is not a valid type for a bare item.");
+  if (x->partial && !sax_complete(s, current)) {
+    goto l_more;
+  }
+  scan_ungetc(s, current);
+  null_scan_token(s);
+  sax_call(x, on_null);
+  goto l_value_end;
+
+l_value_end:
+  if (x->depth == 0) {
+    x->go = go_root_next;
+  }
+  else if (x->stack[x->depth - 1] == SAX_ARRAY) {
+    x->go = go_array_next;
+  }
+  else {
+    x->go = go_object_next;
+  }
+  goto l_loop;
+
+l_root_next:
+  if (continuous != 0) {
+    x->go = go_value;
+    goto l_loop;
+  }
+  goto l_finish;
+
+l_more:
+  scan_ungetc(s, current);
+  x->more = 1;
+  x->mark = s->cursor;
+  goto l_finish;
+
+l_finish:
+  return 0;
+}
+
+int
+cjson_sax_fscan(FILE *stream, enum cjson_type valid, unsigned int continuous, const struct cjson_sax *sax, void *data)
+{
+  int status = 0;
+  uint8_t block[SCAN_BLOCK];
+  struct scan scan, *s = &scan;
+  scan_fopen(s, stream, block, sizeof(block), continuous);
+  ec_with(s, (ec_unwind_f)scan_fclose) {
+    struct sax state, *x = &state;
+    sax_init(x, sax, data);
+    ec_with(x, (ec_unwind_f)sax_free) {
+      status = sax_scan(x, s, valid, continuous);
+    }
+  }
+
+  return status;
+}
+
+int
+cjson_sax_parse(const char *buf, size_t length, enum cjson_type valid, unsigned int continuous, const struct cjson_sax *sax, void *data)
+{
+  int status = 0;
+  struct scan scan, *s = &scan;
+  scan_mopen(s, buf, length);
+
+  struct sax state, *x = &state;
+  sax_init(x, sax, data);
+  ec_with(x, (ec_unwind_f)sax_free) {
+    status = sax_scan(x, s, valid, continuous);
+  }
+
+  return status;
+}
+
+/*** cjson push parser ***/
+
+/* The push parser runs the SAX parser over each buffer as it is fed. When a
+ * buffer ends inside a token, the bytes of the token are kept and only as
+ * many bytes of the next buffer as are needed to finish it are appended to
+ * them. The rest of each buffer is parsed where it is.
+ */
+struct cjson_parser {
+  struct sax sax;
+  enum cjson_type valid;
+  unsigned int continuous;
+
+  struct scan_buffer tail;    /* The start of an incomplete token. */
+  long tail_offset;           /* The position of the tail in the input. */
+  long offset;                /* The amount of input fed so far. */
+
+  int status;                 /* The value returned by a callback that stopped parsing. */
+  unsigned int done;          /* The input has been parsed. */
+};
+
+struct cjson_parser *
+cjson_parser_new(enum cjson_type valid, unsigned int continuous, const struct cjson_sax *sax, void *data)
+{
+  struct cjson_parser *p = ecx_malloc(sizeof(*p));
+  sax_init(&p->sax, sax, data);
+  p->valid = valid;
+  p->continuous = continuous;
+
+  p->tail = (struct scan_buffer)SCAN_BUFFER_INIT(NULL);
+  p->tail_offset = 0;
+  p->offset = 0;
+
+  p->status = 0;
+  p->done = 0;
+
+  return p;
+}
+
+void
+cjson_parser_free(struct cjson_parser *p)
+{
+  if (p == NULL) {
+    return;
+  }
+
+  sax_free(&p->sax);
+  scan_buffer_free(&p->tail);
+  free(p);
+}
+
+/* Run the parser over the bytes found at the given position in the input.
+ * Return the bytes of an incomplete token at the end (if any).
+ */
+static
+const uint8_t *
+parser_run(struct cjson_parser *p, const uint8_t *bytes, size_t length, long offset)
+{
+  struct scan scan, *s = &scan;
+  scan_mopen(s, bytes, length);
+  s->offset = offset;
+
+  p->sax.more = 0;
+  p->sax.mark = bytes + length;
+  p->status = sax_scan(&p->sax, s, p->valid, p->continuous);
+  if (p->status == 0 && !p->sax.more) {
+    p->done = 1;
+  }
+
+  return p->sax.mark;
+}
+
+/* Return how many bytes of the buffer finish the token in the tail (including
+ * the byte after a number or literal) or zero if they do not finish it.
+ */
+static
+size_t
+parser_token_end(struct cjson_parser *p, const uint8_t *bytes, size_t length)
+{
+  const uint8_t *tail = (const uint8_t *)p->tail.bytes;
+
+  if (tail[0] == '"') {
+    unsigned int escaped = 0;
+    for (size_t i = p->tail.length; i > 1 && tail[i - 1] == '\\'; i--) {
+      escaped ^= 1;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+      if (escaped) {
+        escaped = 0;
+      }
+      else if (bytes[i] == '\\') {
+        escaped = 1;
+      }
+      else if (bytes[i] == '"') {
+        return i + 1;
+      }
+    }
+
+    return 0;
+  }
+
+  for (size_t i = 0; i < length; i++) {
+    uint8_t c = bytes[i];
+    if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '+' || c == '.')) {
+      return i + 1;
+    }
+  }
+
+  return 0;
+}
+
+int
+cjson_parser_feed(struct cjson_parser *p, const char *buf, size_t length)
+{
+  const uint8_t *bytes = (const uint8_t *)buf;
+  const uint8_t *mark = NULL;
+  size_t used = 0;
+
+  if (p->status != 0 || p->done) {
+    return p->status;
+  }
+
+  p->sax.partial = 1;
+
+  /* Finish the incomplete token first. */
+  while (p->tail.length != 0 && used < length) {
+    size_t count = parser_token_end(p, bytes + used, length - used);
+    if (count == 0) {
+      scan_buffer_append(&p->tail, bytes + used, length - used);
+      p->offset += length;
+      return 0;
+    }
+
+    scan_buffer_append(&p->tail, bytes + used, count);
+    used += count;
+
+    mark = parser_run(p, (const uint8_t *)p->tail.bytes, p->tail.length, p->tail_offset);
+    if (p->status != 0 || p->done) {
+      return p->status;
+    }
+
+    size_t skip = mark - (const uint8_t *)p->tail.bytes;
+    memmove(p->tail.bytes, mark, p->tail.length - skip);
+    p->tail.length -= skip;
+    p->tail_offset += skip;
+  }
+
+  if (used < length) {
+    mark = parser_run(p, bytes + used, length - used, p->offset + used);
+    if (p->status != 0 || p->done) {
+      return p->status;
+    }
+
+    p->tail_offset = p->offset + (mark - bytes);
+    scan_buffer_append(&p->tail, mark, bytes + length - mark);
+  }
+
+  p->offset += length;
+
+  return 0;
+}
+
+int
+cjson_parser_finish(struct cjson_parser *p)
+{
+  if (p->status != 0 || p->done) {
+    return p->status;
+  }
+
+  p->sax.partial = 0;
+  parser_run(p, (const uint8_t *)p->tail.bytes, p->tail.length, p->tail_offset);
+  p->tail.length = 0;
+  p->done = 1;
+
+  return p->status;
+}
@@ -0,0 +1,680 @@
+/*** cjson scanner ***/
+
+/* A scan is a cursor over a contiguous region of input bytes. Memory scans
+ * cover the entire input up front. Stream scans refill the region from the
+ * stream whenever the cursor reaches the end of it.
+ */
+struct scan {
+  const uint8_t *cursor;      /* The next byte to read. */
+  const uint8_t *end;         /* One past the last byte available. */
+  const uint8_t *base;        /* The start of the input (memory scans only). */
+  long offset;                /* The position of base in the whole input. */
+  unsigned int mapped;        /* The input is a file mapped into memory. */
+  unsigned int allocated;     /* The input is a file read into memory from the heap. */
+
+  FILE *stream;               /* The stream to refill from (or NULL). */
+  uint8_t byte;               /* Storage for the byte read from the stream. */
+  uint8_t *block;             /* Storage for blocks read from the stream (or NULL). */
+  size_t size;                /* The size of the block storage. */
+  unsigned int seekable;      /* Unconsumed bytes can be returned with fseek. */
+
+  struct index *index;        /* The structural index of the input (or NULL). */
+  struct cjson_error *error;  /* Where parse errors are recorded instead of formatted (or NULL). */
+  size_t depth;               /* The containers open in the recursive parsers (see scan_enter). */
+};
+
+/* The size of the blocks read by the stream scanners. */
+#define SCAN_BLOCK 16384
+
+static void scan_error(struct scan *s, enum cjson_error_code code, int64_t c, const char *reason) __attribute__ ((noreturn));
+
+/* Parse errors are formatted when they are thrown, unless the scan records
+ * them in a cjson_error (see scan_error).
+ */
+#define scanx_parse_c(s,c,m,...) \
+  ((s)->error != NULL ? scan_error((s), CJSON_ERROR_SYNTAX, (c), m) : \
+   ec_throw_strf(CJSONX_PARSE, "Invalid character at %ld: %x '%c': " m, scan_tell(s), (c), (c), ##__VA_ARGS__)); \
+
+/* Like scanx_parse_c, but for invalid encodings (e.g. UTF-8 or escapes). */
+#define scanx_parse_e(s,c,m,...) \
+  ((s)->error != NULL ? scan_error((s), CJSON_ERROR_ENCODING, (c), m) : \
+   ec_throw_strf(CJSONX_PARSE, "Invalid character at %ld: %x '%c': " m, scan_tell(s), (c), (c), ##__VA_ARGS__)); \
+
+#define scanx_parse_u(s,u,m,...) \
+  ((s)->error != NULL ? scan_error((s), CJSON_ERROR_ENCODING, (u), m) : \
+   ec_throw_strf(CJSONX_PARSE, "Invalid character at %ld: %" PRIx64 ": " m, scan_tell(s), (u), ##__VA_ARGS__)); \
+
+#define scanx_parse_more(s,m) \
+  ((s)->error != NULL ? scan_error((s), CJSON_ERROR_TRUNCATED, EOF, m) : \
+   ec_throw_strf(CJSONX_PARSE, "Expecting more data at %ld; " m, scan_tell(s))); \
+
+/* Begin scanning the provided buffer. */
+static
+void
+scan_mopen(struct scan *s, const void *buf, size_t length)
+{
+  s->base = buf;
+  s->cursor = s->base;
+  s->end = s->base + length;
+  s->offset = 0;
+  s->mapped = 0;
+  s->allocated = 0;
+  s->stream = NULL;
+  s->index = NULL;
+  s->error = NULL;
+  s->depth = 0;
+}
+
+/* Index the input of a memory scan. The index must remain valid for the
+ * duration of the scan.
+ */
+static
+void
+scan_index(struct scan *s, struct index *x)
+{
+  index_init(x, s->base, s->end);
+  s->index = x;
+}
+
+/* Read the rest of the open file into memory for scan_mmap. The file is
+ * closed.
+ */
+static
+void
+scan_read(struct scan *s, int fd, const char *path)
+{
+  size_t size = SCAN_BLOCK;
+  size_t length = 0;
+  uint8_t *buf = malloc(size);
+
+  while (buf != NULL) {
+    if (length == size) {
+      uint8_t *larger = realloc(buf, size * 2);
+      if (larger == NULL) {
+        free(buf);
+        buf = NULL;
+        break;
+      }
+      buf = larger;
+      size *= 2;
+    }
+
+    ssize_t count = read(fd, buf + length, size - length);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count < 0) {
+      int error = errno;
+      free(buf);
+      close(fd);
+      ec_throw_strf(ECX_EC, "Failed to read '%s': %s.", path, strerror(error));
+    }
+    if (count == 0) {
+      break;
+    }
+    length += count;
+  }
+  close(fd);
+
+  if (buf == NULL) {
+    ec_throw_strf(ECX_EC, "Failed to allocate memory to read '%s'.", path);
+  }
+
+  scan_mopen(s, buf, length);
+  s->allocated = 1;
+}
+
+/* Begin scanning the file at the provided path by mapping it into memory.
+ * Files that can't be mapped because they report no size (e.g. pipes, /proc
+ * files and /dev/stdin) are read into memory instead. The scan must be
+ * finished with scan_munmap.
+ */
+static
+void
+scan_mmap(struct scan *s, const char *path)
+{
+  struct stat st;
+  void *map = NULL;
+
+  scan_mopen(s, NULL, 0);
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    ec_throw_strf(ECX_EC, "Failed to open '%s': %s.", path, strerror(errno));
+  }
+
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    ec_throw_strf(ECX_EC, "Failed to stat '%s': %s.", path, strerror(error));
+  }
+
+  if (!S_ISREG(st.st_mode) ||
+      st.st_size == 0) {
+    scan_read(s, fd, path);
+    errno = 0;
+    return;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    int error = errno;
+    close(fd);
+    ec_throw_strf(ECX_EC, "Failed to map '%s': %s.", path, strerror(error));
+  }
+
+  /* The parsers only ever move forward through the input. */
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  scan_mopen(s, map, st.st_size);
+  s->mapped = 1;
+
+  close(fd);
+  errno = 0;
+}
+
+/* Finish scanning a mapped (or read) file. */
+static
+void
+scan_munmap(struct scan *s)
+{
+  if (s->mapped) {
+    munmap((void *)s->base, s->end - s->base);
+    s->mapped = 0;
+  }
+
+  if (s->allocated) {
+    free((void *)s->base);
+    s->allocated = 0;
+  }
+}
+
+/* Begin scanning the provided stream.
+ *
+ * If block storage is provided, the stream is read a block at a time instead
+ * of a byte at a time. Reading ahead is only done when the bytes read, but not
+ * consumed, can be returned to the stream when the scan is finished (the
+ * stream is seekable) or when drain is set (the caller will read the stream
+ * until EOF).
+ */
+static
+void
+scan_fopen(struct scan *s, FILE *stream, uint8_t *block, size_t size, unsigned int drain)
+{
+  s->base = NULL;
+  s->offset = 0;
+  s->mapped = 0;
+  s->allocated = 0;
+  s->depth = 0;
+  s->cursor = &s->byte;
+  s->end = &s->byte;
+  s->stream = stream;
+  s->index = NULL;
+  s->error = NULL;
+  s->block = NULL;
+  s->size = 0;
+  s->seekable = 0;
+
+  if (block != NULL) {
+    s->seekable = ftell(stream) >= 0;
+    errno = 0;
+
+    if (s->seekable || drain) {
+      s->block = block;
+      s->size = size;
+    }
+  }
+}
+
+/* Finish scanning the stream. Any bytes read from the stream, but not
+ * consumed, are returned to it. A draining scan that stops early (e.g. on a
+ * parse error) cannot return them and they are discarded.
+ */
+static
+void
+scan_fclose(struct scan *s)
+{
+  long count = s->end - s->cursor;
+  if (s->stream == NULL || count == 0) {
+    return;
+  }
+
+  if (s->block == NULL) {
+    ecx_ungetc(*s->cursor, s->stream);
+  }
+  else if (s->seekable) {
+    ecx_fseek(s->stream, -count, SEEK_CUR);
+  }
+
+  s->cursor = s->end;
+}
+
+/* Return the position of the cursor in the input. */
+static
+long
+scan_tell(struct scan *s)
+{
+  if (s->stream == NULL) {
+    return s->offset + (s->cursor - s->base);
+  }
+
+  long position = ftell(s->stream);
+  if (position < 0) {
+    return position;
+  }
+
+  return position - (s->end - s->cursor);
+}
+
+/* Record a parse error in the scan's error and throw it with the reason
+ * (a static string) as its message. The line and column (of the last byte
+ * read) are only known for memory scans.
+ */
+static
+void
+scan_error(struct scan *s, enum cjson_error_code code, int64_t c, const char *reason)
+{
+  struct cjson_error *error = s->error;
+
+  if (c == EOF && (code == CJSON_ERROR_SYNTAX || code == CJSON_ERROR_ENCODING)) {
+    code = CJSON_ERROR_TRUNCATED;
+  }
+
+  error->code = code;
+  error->offset = scan_tell(s);
+  error->character = c;
+  error->reason = reason;
+  error->line = 0;
+  error->column = 0;
+
+  if (s->stream == NULL) {
+    /* The position of the last byte read. */
+    const uint8_t *at = s->cursor > s->base ? s->cursor - 1 : s->cursor;
+    const uint8_t *line = s->base;
+    error->line = 1;
+    for (const uint8_t *p = s->base; (p = memchr(p, '\n', at - p)) != NULL; p++) {
+      line = p + 1;
+      error->line++;
+    }
+    error->column = at - line + 1;
+  }
+
+  ec_throw_str_static(CJSONX_PARSE, reason);
+}
+
+/* Return the nesting depth accepted with the hook. */
+static inline
+size_t
+scan_max_depth(struct cjson_hook *hook)
+{
+  return hook != NULL && hook->max_depth != 0 ? hook->max_depth : CJSON_MAX_DEPTH;
+}
+
+static
+void
+scan_depth_error(struct scan *s, size_t max_depth, int c) __attribute__ ((noreturn));
+
+/* Throw the error for a container (opened by c) nested deeper than
+ * max_depth.
+ */
+static
+void
+scan_depth_error(struct scan *s, size_t max_depth, int c)
+{
+  if (s->error != NULL) {
+    scan_error(s, CJSON_ERROR_DEPTH, c, "Exceeded the maximum depth.");
+  }
+  ec_throw_strf(CJSONX_PARSE, "Exceeded the maximum depth (%zu) at %ld.", max_depth, scan_tell(s));
+}
+
+/* Count a container (opened by c) entered by one of the recursive parsers
+ * and check it against the depth limit of the hook. Each call is paired with
+ * scan_leave when the container is complete (a scan that threw is not
+ * reused).
+ */
+static inline
+void
+scan_enter(struct scan *s, struct cjson_hook *hook, int c)
+{
+  size_t max_depth = scan_max_depth(hook);
+  if (s->depth >= max_depth) {
+    scan_depth_error(s, max_depth, c);
+  }
+  s->depth++;
+}
+
+static inline
+void
+scan_leave(struct scan *s)
+{
+  s->depth--;
+}
+
+/* Refill the region from the stream. Return zero if no more input is
+ * available.
+ */
+static
+int
+scan_fill(struct scan *s)
+{
+  if (s->stream == NULL) {
+    return 0;
+  }
+
+  errno = 0;
+
+  if (s->block != NULL) {
+    size_t count = ecx_fread(s->block, 1, s->size, s->stream);
+    if (count == 0) {
+      return 0;
+    }
+
+    s->cursor = s->block;
+    s->end = s->block + count;
+
+    return 1;
+  }
+
+  int current = ecx_fgetc(s->stream);
+  if (current == EOF) {
+    return 0;
+  }
+
+  s->byte = current;
+  s->cursor = &s->byte;
+  s->end = &s->byte + 1;
+
+  return 1;
+}
+
+static inline
+int
+scan_getc(struct scan *s)
+{
+  if (s->cursor == s->end && scan_fill(s) == 0) {
+    return EOF;
+  }
+
+  return *s->cursor++;
+}
+
+/* Return the byte read by the immediately preceding scan_getc. */
+static inline
+void
+scan_ungetc(struct scan *s, int current)
+{
+  if (current != EOF) {
+    s->cursor--;
+  }
+}
+
+static inline
+int
+scan_peek(struct scan *s)
+{
+  int current = scan_getc(s);
+  scan_ungetc(s, current);
+  return current;
+}
+
+static inline
+int
+scan_isspace(int current)
+{
+  return current == ' ' || current == '\n' || current == '\r' || current == '\t';
+}
+
+/* Return the position of the first byte in [p, end) that isn't whitespace or
+ * end if there is none.
+ */
+static inline
+const uint8_t *
+scan_span_whitespace(const uint8_t *p, const uint8_t *end)
+{
+  /* Most runs are a single space between tokens. */
+  if (p == end || !scan_isspace(*p)) {
+    return p;
+  }
+
+#if defined(__x86_64__)
+  for (; end - p >= 16; p += 16) {
+    __m128i in = _mm_loadu_si128((const __m128i *)p);
+    __m128i ws = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(in, _mm_set1_epi8('\t'))),
+      _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(in, _mm_set1_epi8('\n'))));
+
+    unsigned int other = ~_mm_movemask_epi8(ws) & 0xFFFF;
+    if (other != 0) {
+      return p + __builtin_ctz(other);
+    }
+  }
+#endif
+
+  while (p != end && scan_isspace(*p)) {
+    p++;
+  }
+
+  return p;
+}
+
+/* Advance the cursor past any whitespace. Stream scans are refilled until a
+ * byte that isn't whitespace is found.
+ */
+static inline
+void
+scan_skip_whitespace(struct scan *s)
+{
+  if (s->index != NULL) {
+    s->cursor = index_next(s->index, s->cursor);
+    return;
+  }
+
+  for (;;) {
+    s->cursor = scan_span_whitespace(s->cursor, s->end);
+    if (s->cursor != s->end || scan_fill(s) == 0) {
+      return;
+    }
+  }
+}
+
+/* Return the position of the first byte in [p, end) that may not be copied
+ * directly from the body of a string ('"', '\\', a control character or a
+ * byte that isn't ASCII) or end if there is none.
+ */
+static inline
+const uint8_t *
+scan_span_string(const uint8_t *p, const uint8_t *end)
+{
+#if defined(__x86_64__)
+  for (; end - p >= 16; p += 16) {
+    __m128i in = _mm_loadu_si128((const __m128i *)p);
+
+    /* Bytes that aren't ASCII are negative, so they compare less than ' '. */
+    __m128i stop = _mm_or_si128(
+      _mm_cmplt_epi8(in, _mm_set1_epi8(' ')),
+      _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('"')), _mm_cmpeq_epi8(in, _mm_set1_epi8('\\'))));
+
+    unsigned int mask = _mm_movemask_epi8(stop);
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+#endif
+
+  while (p != end && *p >= ' ' && *p < 0x80 && *p != '"' && *p != '\\') {
+    p++;
+  }
+
+  return p;
+}
+
+/* A growable buffer for the bytes produced by a scan. The bytes are always
+ * null terminated. A discarding buffer only counts the bytes (bytes stays
+ * NULL), so the scan is checked without allocating anything.
+ */
+struct scan_buffer {
+  char *bytes;
+  size_t length;
+  size_t size;
+  unsigned int discard;
+  struct cjson_allocator *allocator;  /* Allocates the bytes (or NULL for the heap). */
+};
+
+/* An empty (not discarding) scan_buffer whose bytes are allocated with the
+ * allocator (or NULL for the heap).
+ */
+#define SCAN_BUFFER_INIT(a) { \
+  .bytes = NULL, \
+  .length = 0, \
+  .size = 0, \
+  .discard = 0, \
+  .allocator = (a), \
+}
+
+static
+void
+scan_buffer_append(struct scan_buffer *b, const void *bytes, size_t length)
+{
+  if (b->discard) {
+    b->length += length;
+    return;
+  }
+
+  if (b->length + length + 1 > b->size) {
+    /* The first append is sized exactly, since most tokens are read in one. */
+    size_t size = b->size * 2;
+    if (size < b->length + length + 1) {
+      size = b->length + length + 1;
+    }
+
+    b->bytes = allocator_realloc(b->allocator, b->bytes, size);
+    b->size = size;
+  }
+
+  memcpy(b->bytes + b->length, bytes, length);
+  b->length += length;
+  b->bytes[b->length] = '\0';
+}
+
+/* Return the bytes in the buffer for the node to own. A node in an arena (or
+ * with another allocator than the buffer) gets a copy, so the buffer can be
+ * reused. Otherwise the bytes are taken from the buffer.
+ */
+static
+char *
+scan_buffer_take(struct scan_buffer *b, struct cjson *node)
+{
+  char *bytes = NULL;
+
+  if ((node->hook != NULL &&
+       node->hook->arena != NULL) ||
+      hook_allocator(node->hook) != b->allocator) {
+    bytes = node_malloc(node, b->length + 1);
+    if (b->bytes != NULL) {
+      memcpy(bytes, b->bytes, b->length + 1);
+    }
+    else {
+      bytes[0] = '\0';
+    }
+    b->length = 0;
+    return bytes;
+  }
+
+  bytes = b->bytes;
+  b->bytes = NULL;
+  b->length = 0;
+  b->size = 0;
+  return bytes;
+}
+
+/* Allocate a CJSON_NUMBER, CJSON_PAIR or CJSON_STRING holding the text in the
+ * buffer (as its number, key or bytes) into the slot. Keys and short strings
+ * are shared through the hook's intern table when it has one. Otherwise text
+ * that fits in NODE_INLINE_MAX is stored right after the node instead of in
+ * memory of its own.
+ *
+ * The node is stored in the slot as soon as it is allocated, and no unwind
+ * handler is set up: if taking the text throws, freeing the slot is left to
+ * the caller (e.g. the builder frees its pending node when unwinding).
+ */
+static
+struct cjson *
+scan_buffer_node_into(struct scan_buffer *b, enum cjson_type type, struct cjson *parent, struct cjson **slot)
+{
+  struct cjson_hook *hook = parent != NULL ? parent->hook : NULL;
+  struct cjson *node = NULL;
+  size_t length = b->length;
+  char *text = NULL;
+
+  if (hook != NULL &&
+      hook->intern != NULL &&
+      (type == CJSON_PAIR ||
+       (type == CJSON_STRING &&
+        length <= hook->intern->max_length &&
+        (length == 0 || memchr(b->bytes, '\0', length) == NULL)))) {
+    node = *slot = node_alloc(type, parent, hook, sizeof(*node));
+    text = intern_take(hook->intern, b->bytes != NULL ? b->bytes : "", length);
+    node->flags |= NODE_INTERN;
+    b->length = 0;
+  }
+  else if (length < NODE_INLINE_MAX &&
+      (hook == NULL || hook->cjson_malloc == NULL)) {
+    node = *slot = node_alloc(type, parent, hook, sizeof(*node) + length + 1);
+    node->flags |= NODE_INLINE;
+    text = node_text(node);
+    if (b->bytes != NULL) {
+      memcpy(text, b->bytes, length + 1);
+    }
+    else {
+      text[0] = '\0';
+    }
+    b->length = 0;
+  }
+  else {
+    node = *slot = node_alloc(type, parent, hook, sizeof(*node));
+    text = scan_buffer_take(b, node);
+  }
+
+  switch (type) {
+    case CJSON_NUMBER:
+      node->value.number = text;
+      break;
+    case CJSON_PAIR:
+      node->value.pair.key = text;
+      break;
+    case CJSON_STRING:
+      node->value.string.length = length;
+      node->value.string.bytes = text;
+      break;
+    default:
+      break;
+  }
+
+  return node;
+}
+
+/* Allocate a node holding the text in the buffer (see scan_buffer_node_into).
+ * The node is freed if taking the text throws.
+ */
+static
+struct cjson *
+scan_buffer_node(struct scan_buffer *b, enum cjson_type type, struct cjson *parent)
+{
+  struct cjson *node = NULL;
+
+  ec_with_on_x(node, (ec_unwind_f)cjson_free) {
+    scan_buffer_node_into(b, type, parent, &node);
+  }
+
+  return node;
+}
+
+static
+void
+scan_buffer_free(struct scan_buffer *b)
+{
+  allocator_free(b->allocator, b->bytes);
+  b->bytes = NULL;
+  b->length = 0;
+  b->size = 0;
+}
@@ -0,0 +1,355 @@
+/*** cjson slab ***/
+
+/* Nodes that aren't allocated by a hook come from slabs of SLAB_BATCH slots.
+ * A node only takes as much of a slot as its type uses (see node_size) plus
+ * any inline text, so the slots come in a few size classes, each with its own
+ * slabs. Each thread keeps a cache of free slots per class, so allocating and
+ * freeing a node is usually a pointer swap without locking. When a cache runs
+ * dry it takes a batch of free slots from the shared pool of the class (or
+ * allocates a new slab), and when it grows past SLAB_CACHE it gives a batch
+ * back. A node freed by another thread than the one that allocated it simply
+ * joins the freeing thread's cache. The caches of finished threads are
+ * returned to the pools. Slabs whose slots are all in a pool are returned to
+ * the heap by cjson_slab_trim, and when a thread finishes with many slots
+ * pooled.
+ */
+
+/* The number of slots in a slab and in each batch moved to or from a pool. */
+#define SLAB_BATCH 64
+
+/* The most free slots of a class a thread keeps. */
+#define SLAB_CACHE (SLAB_BATCH * 4)
+
+/* The number of pooled slots of a class above which a finishing thread trims
+ * the pool (see slab_cache_release).
+ */
+#define SLAB_POOL_MAX (SLAB_CACHE * 16)
+
+/* The slot sizes are multiples of SLAB_UNIT. */
+#define SLAB_UNIT 8
+
+/* The slot size of each class (in units). The largest holds a whole node and
+ * NODE_INLINE_MAX bytes of text.
+ */
+static const size_t slab_units[] = {3, 4, 5, 6, 8};
+
+#define SLAB_CLASSES (sizeof(slab_units) / sizeof(slab_units[0]))
+
+/* The smallest class for each size (in units). */
+static const unsigned int slab_classes[] = {0, 0, 0, 0, 1, 2, 3, 4, 4};
+
+struct slab_slot {
+  struct slab_slot *next;     /* The next free slot in the batch (or cache). */
+  struct slab_slot *batch;    /* The next batch in the pool (first slot of a batch only). */
+  size_t count;               /* The number of slots in the batch (first slot of a batch only). */
+};
+
+/* The header of a slab, followed by its SLAB_BATCH slots. */
+struct slab {
+  struct slab *next;          /* The next slab of the class. */
+  size_t free;                /* The number of its slots in the pool (only counted by slab_trim). */
+};
+
+struct slab_cache {
+  struct slab_slot *head;
+  size_t count;
+};
+
+static __thread struct slab_cache slab_caches[SLAB_CLASSES];
+static __thread unsigned int slab_registered;
+
+static pthread_mutex_t slab_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct slab_slot *slab_pools[SLAB_CLASSES];
+static size_t slab_pool_counts[SLAB_CLASSES];   /* The number of slots in each pool. */
+static size_t slab_trimmed[SLAB_CLASSES];       /* The number of slots left in each pool by slab_trim. */
+static struct slab *slab_slabs[SLAB_CLASSES];
+static size_t slab_counts[SLAB_CLASSES];        /* The number of slabs of each class. */
+static pthread_key_t slab_key;
+static pthread_once_t slab_once = PTHREAD_ONCE_INIT;
+
+/* Add the batch of count slots to the pool of the class (with the lock
+ * held).
+ */
+static inline
+void
+slab_pool_push(unsigned int class, struct slab_slot *batch, size_t count)
+{
+  batch->batch = slab_pools[class];
+  batch->count = count;
+  slab_pools[class] = batch;
+  slab_pool_counts[class] += count;
+}
+
+static
+int
+slab_compare(const void *a, const void *b)
+{
+  uintptr_t x = (uintptr_t)*(struct slab * const *)a;
+  uintptr_t y = (uintptr_t)*(struct slab * const *)b;
+  return (x > y) - (x < y);
+}
+
+/* Return the slab (of those sorted by address) holding the slot. */
+static
+struct slab *
+slab_find(struct slab **slabs, size_t count, struct slab_slot *slot)
+{
+  size_t low = 0, high = count;
+  while (high - low > 1) {
+    size_t middle = low + (high - low) / 2;
+    if ((uintptr_t)slabs[middle] <= (uintptr_t)slot) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+
+  return slabs[low];
+}
+
+/* Return the slabs of the class whose slots are all in its pool to the heap
+ * (with the lock held). The slots cached by threads keep their slabs.
+ */
+static
+void
+slab_trim(unsigned int class)
+{
+  size_t count = slab_counts[class];
+  if (slab_pool_counts[class] < SLAB_BATCH) {
+    return;
+  }
+
+  /* Trimming only saves memory, so it is skipped if it needs more. */
+  struct slab **slabs = malloc(count * sizeof(*slabs));
+  if (slabs == NULL) {
+    return;
+  }
+
+  size_t i = 0;
+  for (struct slab *slab = slab_slabs[class]; slab != NULL; slab = slab->next) {
+    slab->free = 0;
+    slabs[i++] = slab;
+  }
+  qsort(slabs, count, sizeof(*slabs), slab_compare);
+
+  for (struct slab_slot *batch = slab_pools[class]; batch != NULL; batch = batch->batch) {
+    for (struct slab_slot *n = batch; n != NULL; n = n->next) {
+      slab_find(slabs, count, n)->free++;
+    }
+  }
+
+  /* Pool the slots of the slabs still in use again. */
+  struct slab_slot *pool = slab_pools[class];
+  slab_pools[class] = NULL;
+  slab_pool_counts[class] = 0;
+
+  struct slab_slot *batch = NULL;
+  size_t length = 0;
+  while (pool != NULL) {
+    struct slab_slot *n = pool;
+    pool = pool->batch;
+
+    while (n != NULL) {
+      struct slab_slot *next = n->next;
+      if (slab_find(slabs, count, n)->free != SLAB_BATCH) {
+        n->next = batch;
+        batch = n;
+        length++;
+
+        if (length == SLAB_BATCH) {
+          slab_pool_push(class, batch, length);
+          batch = NULL;
+          length = 0;
+        }
+      }
+      n = next;
+    }
+  }
+  if (batch != NULL) {
+    slab_pool_push(class, batch, length);
+  }
+
+  slab_slabs[class] = NULL;
+  slab_counts[class] = 0;
+  for (i = 0; i < count; i++) {
+    if (slabs[i]->free == SLAB_BATCH) {
+      free(slabs[i]);
+    } else {
+      slabs[i]->next = slab_slabs[class];
+      slab_slabs[class] = slabs[i];
+      slab_counts[class]++;
+    }
+  }
+  free(slabs);
+
+  slab_trimmed[class] = slab_pool_counts[class];
+}
+
+/* Return the slots in each cache to the pools as one batch per class. */
+static
+void
+slab_cache_return(struct slab_cache *caches)
+{
+  pthread_mutex_lock(&slab_lock);
+  for (unsigned int class = 0; class < SLAB_CLASSES; class++) {
+    struct slab_cache *cache = &caches[class];
+    if (cache->head != NULL) {
+      slab_pool_push(class, cache->head, cache->count);
+      cache->head = NULL;
+      cache->count = 0;
+    }
+  }
+  pthread_mutex_unlock(&slab_lock);
+}
+
+/* Return the caches of a finishing thread, and trim the pools that have grown
+ * large since they were last trimmed.
+ */
+static
+void
+slab_cache_release(void *arg)
+{
+  slab_cache_return(arg);
+
+  pthread_mutex_lock(&slab_lock);
+  for (unsigned int class = 0; class < SLAB_CLASSES; class++) {
+    if (slab_pool_counts[class] > SLAB_POOL_MAX &&
+        slab_pool_counts[class] > slab_trimmed[class] * 2) {
+      slab_trim(class);
+    }
+  }
+  pthread_mutex_unlock(&slab_lock);
+}
+
+void
+cjson_slab_trim(void)
+{
+  slab_cache_return(slab_caches);
+
+  pthread_mutex_lock(&slab_lock);
+  for (unsigned int class = 0; class < SLAB_CLASSES; class++) {
+    slab_trim(class);
+  }
+  pthread_mutex_unlock(&slab_lock);
+}
+
+static
+void
+slab_init(void)
+{
+  pthread_key_create(&slab_key, slab_cache_release);
+}
+
+/* Arrange for the caches to be returned to the pools when the thread exits. */
+static inline
+void
+slab_register(void)
+{
+  if (!slab_registered) {
+    pthread_once(&slab_once, slab_init);
+    pthread_setspecific(slab_key, slab_caches);
+    slab_registered = 1;
+  }
+}
+
+/* Return the class of the smallest slot that holds size bytes. */
+static inline
+unsigned int
+slab_class(size_t size)
+{
+  return slab_classes[(size + SLAB_UNIT - 1) / SLAB_UNIT];
+}
+
+/* Fill the (empty) cache with a batch from the pool or a new slab. */
+static
+void
+slab_refill(struct slab_cache *cache, unsigned int class)
+{
+  slab_register();
+
+  pthread_mutex_lock(&slab_lock);
+  struct slab_slot *batch = slab_pools[class];
+  if (batch != NULL) {
+    slab_pools[class] = batch->batch;
+    slab_pool_counts[class] -= batch->count;
+    if (slab_trimmed[class] > slab_pool_counts[class]) {
+      slab_trimmed[class] = slab_pool_counts[class];
+    }
+  }
+  pthread_mutex_unlock(&slab_lock);
+
+  if (batch != NULL) {
+    cache->head = batch;
+    cache->count = batch->count;
+    return;
+  }
+
+  size_t size = slab_units[class] * SLAB_UNIT;
+  struct slab *slab = ecx_malloc(sizeof(*slab) + SLAB_BATCH * size);
+  uint8_t *slots = (uint8_t *)(slab + 1);
+  for (size_t i = 0; i + 1 < SLAB_BATCH; i++) {
+    ((struct slab_slot *)(slots + i * size))->next = (struct slab_slot *)(slots + (i + 1) * size);
+  }
+  ((struct slab_slot *)(slots + (SLAB_BATCH - 1) * size))->next = NULL;
+
+  pthread_mutex_lock(&slab_lock);
+  slab->next = slab_slabs[class];
+  slab_slabs[class] = slab;
+  slab_counts[class]++;
+  pthread_mutex_unlock(&slab_lock);
+
+  cache->head = (struct slab_slot *)slots;
+  cache->count = SLAB_BATCH;
+}
+
+/* Allocate a slot of the class. The caller records the class in the node's
+ * flags for slab_free.
+ */
+static
+struct cjson *
+slab_malloc(unsigned int class)
+{
+  struct slab_cache *cache = &slab_caches[class];
+  if (cache->head == NULL) {
+    slab_refill(cache, class);
+  }
+
+  struct slab_slot *n = cache->head;
+  cache->head = n->next;
+  cache->count--;
+
+  return (struct cjson *)n;
+}
+
+static
+void
+slab_free(struct cjson *node)
+{
+  unsigned int class = (node->flags & NODE_CLASS_MASK) >> NODE_CLASS_SHIFT;
+  struct slab_cache *cache = &slab_caches[class];
+  struct slab_slot *n = (struct slab_slot *)node;
+
+  slab_register();
+  n->next = cache->head;
+  cache->head = n;
+  cache->count++;
+
+  if (cache->count < SLAB_CACHE) {
+    return;
+  }
+
+  /* Give the first batch of the cache back to the pool. */
+  struct slab_slot *last = cache->head;
+  for (size_t i = 1; i < SLAB_BATCH; i++) {
+    last = last->next;
+  }
+
+  struct slab_slot *batch = cache->head;
+  cache->head = last->next;
+  cache->count -= SLAB_BATCH;
+  last->next = NULL;
+
+  pthread_mutex_lock(&slab_lock);
+  slab_pool_push(class, batch, SLAB_BATCH);
+  pthread_mutex_unlock(&slab_lock);
+}
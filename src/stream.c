@@ -0,0 +1,208 @@
+/*** cjson array streaming ***/
+
+/* An array iterator reads one array (the whole document or the value at a
+ * path in it) an element at a time. The values before the array are read by
+ * project_skip without building nodes, so only the current element is ever
+ * held in memory.
+ */
+
+struct cjson_array_iter {
+  struct cjson root;          /* Holds the hook for the elements (never has children). */
+  struct scan scan;
+  struct scan_buffer buffer;
+  size_t count;               /* The number of elements returned. */
+  unsigned int done;          /* The end of the array has been read. */
+  uint8_t block[SCAN_BLOCK];
+};
+
+/* Read up to the value at the path segment in the container that begins with
+ * current.
+ */
+static
+void
+stream_segment(struct scan *s, struct scan_buffer *b, const char *segment, int current, struct cjson_hook *hook)
+{
+  if (current == '{') {
+    current = project_getc(s);
+    for (; current != '}'; current = project_getc(s)) {
+      if (current != '"') {
+        scanx_parse_c(s, current, "Expecting to find a JSON key/value pair to parse.");
+      }
+      scan_ungetc(s, current);
+      b->length = 0;
+      jestr_scanb(s, b, 0);
+
+      unsigned int found = strcmp(b->bytes, segment) == 0;
+
+      current = project_getc(s);
+      if (current != ':') {
+        scanx_parse_c(s, current, "Expecting ':'.");
+      }
+
+      if (found) {
+        return;
+      }
+      project_skip(s, b, hook);
+
+      current = project_getc(s);
+      if (current == '}') {
+        break;
+      }
+      if (current != ',') {
+        scanx_parse_c(s, current, "Expecting ',' or '}'.");
+      }
+      current = project_getc(s);
+      if (current == '}') {
+        scanx_parse_c(s, current, "Expecting to find a JSON key/value pair to parse.");
+      }
+      scan_ungetc(s, current);
+    }
+  }
+  else if (current == '[') {
+    size_t index = 0;
+    char extra = 0;
+    if (sscanf(segment, "%zu%c", &index, &extra) == 1) {
+      current = project_getc(s);
+      if (current != ']') {
+        scan_ungetc(s, current);
+
+        for (size_t i = 0;; i++) {
+          if (i == index) {
+            return;
+          }
+          project_skip(s, b, hook);
+
+          current = project_getc(s);
+          if (current == ']') {
+            break;
+          }
+          if (current != ',') {
+            scanx_parse_c(s, current, "Expecting ',' or ']'.");
+          }
+        }
+      }
+    }
+  }
+  else if (current == EOF) {
+    scanx_parse_more(s, "Value was not specified.");
+  }
+
+  ec_throw_strf(CJSONX_NOT_FOUND, "Failed to find segment: \"%s\".", segment);
+}
+
+/* Read up to the first element of the array at the path. */
+static
+void
+stream_open(struct cjson_array_iter *iter, const char *segments)
+{
+  struct scan *s = &iter->scan;
+  struct scan_buffer *b = &iter->buffer;
+
+  const char *segment = segments != NULL ? segments : "";
+  size_t length = strlen(segment);
+  while (length != 0) {
+    char *normalized = cjson_jestr_normalize(segment);
+    ec_with(normalized, free) {
+      stream_segment(s, b, normalized, project_getc(s), iter->root.hook);
+    }
+
+    segment = segment + length + 1;
+    length = strlen(segment);
+  }
+
+  int current = project_getc(s);
+  if (current == EOF) {
+    scanx_parse_more(s, "Value was not specified.");
+  }
+  if (current != '[') {
+    ec_throw_strf(CJSONX_TYPE, "Invalid value at %ld: '%c'. Requires an array.", scan_tell(s), current);
+  }
+}
+
+static
+struct cjson_array_iter *
+stream_new(struct cjson_hook *hook)
+{
+  struct cjson_array_iter *iter = ecx_malloc(sizeof(*iter));
+  cjson_init(&iter->root, CJSON_ROOT, NULL);
+  iter->root.hook = hook;
+  iter->buffer = (struct scan_buffer)SCAN_BUFFER_INIT(hook_allocator(hook));
+  iter->count = 0;
+  iter->done = 0;
+
+  return iter;
+}
+
+struct cjson_array_iter *
+cjson_array_iter_fscan(FILE *stream, const char *segments, struct cjson_hook *hook)
+{
+  struct cjson_array_iter *iter = stream_new(hook);
+
+  /* The iterator only reads within the array, so it can always read ahead. */
+  scan_fopen(&iter->scan, stream, iter->block, sizeof(iter->block), 1);
+  ec_with_on_x(iter, (ec_unwind_f)cjson_array_iter_free) {
+    stream_open(iter, segments);
+  }
+
+  return iter;
+}
+
+struct cjson_array_iter *
+cjson_array_iter_parse(const char *buf, size_t length, const char *segments, struct cjson_hook *hook)
+{
+  struct cjson_array_iter *iter = stream_new(hook);
+  scan_mopen(&iter->scan, buf, length);
+  ec_with_on_x(iter, (ec_unwind_f)cjson_array_iter_free) {
+    stream_open(iter, segments);
+  }
+
+  return iter;
+}
+
+struct cjson *
+cjson_array_iter_next(struct cjson_array_iter *iter)
+{
+  if (iter->done) {
+    return NULL;
+  }
+
+  struct scan *s = &iter->scan;
+  int current = project_getc(s);
+
+  if (current == ']') {
+    iter->done = 1;
+    return NULL;
+  }
+
+  if (iter->count != 0) {
+    if (current != ',') {
+      if (current == EOF) {
+        scanx_parse_more(s, "Failed to find end of array.");
+      }
+      scanx_parse_c(s, current, "Expecting ',' or ']'.");
+    }
+    current = project_getc(s);
+  }
+
+  scan_ungetc(s, current);
+  struct cjson *child = project_whole(s, &iter->root, current);
+  child->parent = NULL;
+  iter->count++;
+
+  return child;
+}
+
+void
+cjson_array_iter_free(struct cjson_array_iter *iter)
+{
+  if (iter == NULL) {
+    return;
+  }
+
+  struct scan_buffer *b = &iter->buffer;
+  ec_with(iter, free) {
+    ec_with(b, (ec_unwind_f)scan_buffer_free) {
+      scan_fclose(&iter->scan);
+    }
+  }
+}
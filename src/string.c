@@ -1,35 +1,17 @@
 /*** cjson string ***/
 
+static
 struct cjson *
-cjson_string_fscan(FILE *stream, struct cjson *parent)
+string_scan(struct scan *s, struct cjson *parent)
 {
-  struct cjson *node = cjson_malloc(CJSON_STRING, parent);
-  ec_with_on_x(node, (ec_unwind_f)cjson_free) {
-    FILE *out = ecx_ccstreams_fmemopen(&node->value.string.bytes, &node->value.string.length, "w+");
-    ec_with(out, (ec_unwind_f)ecx_fclose) {
-      int64_t current = cjson_jestr_fgetu(stream);
-      if (current == EOF) {
-        cjsonx_parse_u(stream, current, "Expecting more data; Failed to find string to parse.");
-      }
-      else if (current != '"') {
-        cjsonx_parse_u(stream, current, "Failed to find string to parse; Expecting '\"'.");
-      }
-
-      int peek = ecx_getc(stream);
-      ecx_ungetc(peek, stream);
-      current = cjson_jestr_fgetu(stream);
-
-      for (;; peek = ecx_getc(stream), ecx_ungetc(peek, stream), current = cjson_jestr_fgetu(stream)) {
-        if (current == EOF) {
-          cjsonx_parse_u(stream, current, "Expecting more data; Failed to find end of string.");
-        }
-        else if (current == '"' && peek != '\\') {
-          break;
-        }
-        cjson_u8_fputu(current, out);
-      }
-    }
+  struct cjson *node = NULL;
+  struct scan_buffer buffer = SCAN_BUFFER_INIT(hook_allocator(parent != NULL ? parent->hook : NULL)), *b = &buffer;
+  ec_with(b, (ec_unwind_f)scan_buffer_free) {
+    jestr_scanb(s, b, 1);
+    node = scan_buffer_node(b, CJSON_STRING, parent);
+  }
 
+  ec_with_on_x(node, (ec_unwind_f)cjson_free) {
     if (node->hook &&
         node->hook->valid) {
       node->hook->valid(node);
@@ -39,6 +21,28 @@ cjson_string_fscan(FILE *stream, struct cjson *parent)
   return node;
 }
 
+struct cjson *
+cjson_string_fscan(FILE *stream, struct cjson *parent)
+{
+  struct cjson *node = NULL;
+  uint8_t block[SCAN_BLOCK];
+  struct scan scan, *s = &scan;
+  scan_fopen(s, stream, block, sizeof(block), 0);
+  ec_with(s, (ec_unwind_f)scan_fclose) {
+    node = string_scan(s, parent);
+  }
+
+  return node;
+}
+
+struct cjson *
+cjson_string_parse(const char *buf, size_t length, struct cjson *parent)
+{
+  struct scan scan, *s = &scan;
+  scan_mopen(s, buf, length);
+  return string_scan(s, parent);
+}
+
 void
 cjson_string_fprint(FILE *stream, struct cjson *node)
 {
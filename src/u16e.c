@@ -31,7 +31,7 @@ cjson_u16e_fputu(const uint32_t u, FILE *stream)
 
 static
 uint16_t
-fget_uint16(FILE *stream)
+scan_uint16(struct scan *s)
 {
   char *message = NULL;
 
@@ -75,19 +75,19 @@ fget_uint16(FILE *stream)
 
   void **go = go_u16;
 
-  int current = ecx_fgetc(stream);
+  int current = scan_getc(s);
 
-  for (; current != EOF; errno = 0, current = ecx_fgetc(stream)) {
+  for (; current != EOF; current = scan_getc(s)) {
     goto *go[current];
 l_loop:;
   }
 
   if (current == EOF) {
-    cjsonx_parse_c(stream, current, "Expecting more data (4 bytes); Failed to find UTF-16 escape sequence.");
+    scanx_parse_e(s, current, "Expecting more data (4 bytes); Failed to find UTF-16 escape sequence.");
   }
 
 l_invalid:
-  cjsonx_parse_c(stream, current, "Expecting a hex character.");
+  scanx_parse_e(s, current, "Expecting a hex character.");
 
 l_nibble:
   bytes[count] = lookup[current];
@@ -103,57 +103,58 @@ l_nibble:
   goto l_loop;
 }
 
-/* Read the unicode code point from a UTF-8 encoded stream as a UTF-16 escape
+/* Read the unicode code point from a UTF-8 encoded scan as a UTF-16 escape
  * sequence. The leading backslash is assumed to be consumed already so a
  * surrogate pair will look like: uD834\uDD1E.
  */
+static
 int64_t
-cjson_u16e_fgetu(FILE *stream)
+u16e_scanu(struct scan *s)
 {
   char *message = NULL;
 
   uint16_t uhex[2] = {0, 0};
   uint32_t u = 0;
 
-  int current = ecx_fgetc(stream);
+  int current = scan_getc(s);
   if (current == EOF) {
     return EOF;
   }
 
   if (current != 'u') {
-    cjsonx_parse_c(stream, current, "Failed to find UTF-16 escape sequence; Expecting 'u'.");
+    scanx_parse_e(s, current, "Failed to find UTF-16 escape sequence; Expecting 'u'.");
   }
 
   /* Read the leading character. */
-  uhex[0] = fget_uint16(stream);
+  uhex[0] = scan_uint16(s);
   if (uhex[0] >= 0xd800 && uhex[0] <= 0xdfff) {
     if (uhex[0] <= 0xdbff) {
       u = (uhex[0] - 0xd800) << 10;
 
       /* Read the trailing character. */
-      current = ecx_fgetc(stream);
+      current = scan_getc(s);
       if (current != '\\') {
-        cjsonx_parse_c(stream, current, "Failed to find trailing UTF-16 escape sequence; Expecting '\\'.");
+        scanx_parse_e(s, current, "Failed to find trailing UTF-16 escape sequence; Expecting '\\'.");
       }
 
-      current = ecx_fgetc(stream);
+      current = scan_getc(s);
       if (current != 'u') {
-        cjsonx_parse_c(stream, current, "Failed to find trailing UTF-16 escape sequence; Expecting 'u'.");
+        scanx_parse_e(s, current, "Failed to find trailing UTF-16 escape sequence; Expecting 'u'.");
       }
 
-      uhex[1] = fget_uint16(stream);
+      uhex[1] = scan_uint16(s);
       if (uhex[1] >= 0xdc00 && uhex[1] <= 0xdfff) {
         u += uhex[1] - 0xdc00;
         u += 0x10000;
       }
       else {
         uint64_t u16 = uhex[1];
-        cjsonx_parse_u(stream, u16, "Invalid trailing UTF-16 surrogate.");
+        scanx_parse_u(s, u16, "Invalid trailing UTF-16 surrogate.");
       }
     }
     else {
       uint64_t u16 = uhex[0];
-      cjsonx_parse_u(stream, u16, "Invalid leading UTF-16 surrogate.");
+      scanx_parse_u(s, u16, "Invalid leading UTF-16 surrogate.");
     }
   }
   else {
@@ -162,3 +163,20 @@ cjson_u16e_fgetu(FILE *stream)
 
   return u;
 }
+
+/* Read the unicode code point from a UTF-8 encoded stream as a UTF-16 escape
+ * sequence. The leading backslash is assumed to be consumed already so a
+ * surrogate pair will look like: uD834\uDD1E.
+ */
+int64_t
+cjson_u16e_fgetu(FILE *stream)
+{
+  int64_t u = 0;
+  struct scan scan, *s = &scan;
+  scan_fopen(s, stream, NULL, 0, 0);
+  ec_with(s, (ec_unwind_f)scan_fclose) {
+    u = u16e_scanu(s);
+  }
+
+  return u;
+}
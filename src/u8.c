@@ -1,43 +1,96 @@
 /*** UTF-8 IO ***/
 
-/* Write the unicode code point to a UTF-8 encoded stream. */
-void
-cjson_u8_fputu(const uint32_t u, FILE *stream)
+/* Encode the unicode code point as UTF-8. Return the number of bytes used or
+ * zero if the code point is not a valid character.
+ */
+static
+size_t
+u8_encode(const uint32_t u, uint8_t bytes[4])
 {
-  uint8_t bytes[] = {0, 0, 0, 0};
-
   if ((u >= 0xD800 && u <= 0xDFFF) || /* Reserved for UTF-16 parsing. */
       (u >= 0xFFFE && u <= 0xFFFF)) {
-    uint64_t u32 = u;
-    cjsonx_parse_u(stream, u32, "Invalid unicode character.");
+    return 0;
   }
 
   if (u <= 0x7F) {
     bytes[0] = u;
-    ecx_fwrite(bytes, 1, 1, stream);
+    return 1;
   }
   else if (u <= 0x7FF) {
     bytes[0] = 0xC0 | ((u >> 6) & 0x1F);
     bytes[1] = 0x80 | (u & 0x3F);
-    ecx_fwrite(bytes, 1, 2, stream);
+    return 2;
   }
   else if (u <= 0xFFFF) {
     bytes[0] = 0xE0 | ((u >> 12) & 0xF);
     bytes[1] = 0x80 | ((u >> 6) & 0x3F);
     bytes[2] = 0x80 | (u & 0x3F);
-    ecx_fwrite(bytes, 1, 3, stream);
+    return 3;
   }
   else if (u <= 0x10FFFF) {
     bytes[0] = 0xF0 | ((u >> 18) & 0x7);
     bytes[1] = 0x80 | ((u >> 12) & 0x3F);
     bytes[2] = 0x80 | ((u >> 6) & 0x3F);
     bytes[3] = 0x80 | (u & 0x3F);
-    ecx_fwrite(bytes, 1, 4, stream);
+    return 4;
   }
-  else {
+
+  return 0;
+}
+
+/* Write the unicode code point to a UTF-8 encoded stream. */
+void
+cjson_u8_fputu(const uint32_t u, FILE *stream)
+{
+  uint8_t bytes[] = {0, 0, 0, 0};
+
+  size_t length = u8_encode(u, bytes);
+  if (length == 0) {
     uint64_t u32 = u;
     cjsonx_parse_u(stream, u32, "Invalid unicode character.");
   }
+
+  ecx_fwrite(bytes, 1, length, stream);
+}
+
+/* Return the length of the UTF-8 sequence at p if it is complete (it ends
+ * before end), is not overlong and encodes a valid character. Otherwise
+ * return zero.
+ */
+static inline
+size_t
+u8_valid(const uint8_t *p, const uint8_t *end)
+{
+  size_t available = end - p;
+
+  if (p[0] >= 0xC2 && p[0] <= 0xDF) {
+    if (available >= 2 &&
+        (p[1] & 0xC0) == 0x80) {
+      return 2;
+    }
+  }
+  else if (p[0] >= 0xE0 && p[0] <= 0xEF) {
+    if (available >= 3 &&
+        (p[1] & 0xC0) == 0x80 &&
+        (p[2] & 0xC0) == 0x80 &&
+        (p[0] != 0xE0 || p[1] >= 0xA0) &&                    /* Overlong. */
+        (p[0] != 0xED || p[1] <= 0x9F) &&                    /* U+D800 to U+DFFF. */
+        (p[0] != 0xEF || p[1] != 0xBF || p[2] < 0xBE)) {     /* U+FFFE and U+FFFF. */
+      return 3;
+    }
+  }
+  else if (p[0] >= 0xF0 && p[0] <= 0xF4) {
+    if (available >= 4 &&
+        (p[1] & 0xC0) == 0x80 &&
+        (p[2] & 0xC0) == 0x80 &&
+        (p[3] & 0xC0) == 0x80 &&
+        (p[0] != 0xF0 || p[1] >= 0x90) &&                    /* Overlong. */
+        (p[0] != 0xF4 || p[1] <= 0x8F)) {                    /* Above U+10FFFF. */
+      return 4;
+    }
+  }
+
+  return 0;
 }
 
 static
@@ -61,9 +114,26 @@ u8_overlong(uint8_t bytes[4]) {
   return 0;
 }
 
-/* Read the unicode code point from a UTF-8 encoded stream. */
+/* Read a continuation byte of a UTF-8 sequence. */
+static inline
+uint8_t
+u8_scan_continuation(struct scan *s)
+{
+  int current = scan_getc(s);
+  if (current == EOF) {
+    scanx_parse_e(s, current, "Expecting more data to finish UTF-8 sequence.");
+  }
+  else if ((current & 0xC0) != 0x80) {
+    scanx_parse_e(s, current, "Expecting a UTF-8 continuation byte.");
+  }
+
+  return current;
+}
+
+/* Read the unicode code point from a UTF-8 encoded scan. */
+static
 int64_t
-cjson_u8_fgetu(FILE *stream)
+u8_scanu(struct scan *s)
 {
   char *message = NULL;
 
@@ -81,7 +151,7 @@ cjson_u8_fgetu(FILE *stream)
 
   void **go = go_u8;
 
-  int current = ecx_fgetc(stream);
+  int current = scan_getc(s);
   if (current != EOF) {
     goto *go[current];
   }
@@ -90,29 +160,29 @@ cjson_u8_fgetu(FILE *stream)
   }
 
 l_invalid:
-  cjsonx_parse_c(stream, current, "Expecting a UTF-8 character.");
+  scanx_parse_e(s, current, "Expecting a UTF-8 character.");
 
 l_utf8_1:
   return current;
 
 l_utf8_2:
   bytes[0] = current;
-  bytes[1] = ecx_fgetc(stream);
+  bytes[1] = u8_scan_continuation(s);
 
   u  = (bytes[0] & 0x1F) << 6;
   u |= (bytes[1] & 0x3F);
 
   if (u8_overlong(bytes)) {
     int64_t u32 = u;
-    cjsonx_parse_u(stream, u32, "Overlong 2-byte UTF-8 encoding.");
+    scanx_parse_u(s, u32, "Overlong 2-byte UTF-8 encoding.");
   }
 
   return u;
 
 l_utf8_3:
   bytes[0] = current;
-  bytes[1] = ecx_fgetc(stream);
-  bytes[2] = ecx_fgetc(stream);
+  bytes[1] = u8_scan_continuation(s);
+  bytes[2] = u8_scan_continuation(s);
 
   u  = (bytes[0] & 0x0F) << 12;
   u |= (bytes[1] & 0x3F) << 6;
@@ -120,16 +190,16 @@ l_utf8_3:
 
   if (u8_overlong(bytes)) {
     int64_t u32 = u;
-    cjsonx_parse_u(stream, u32, "Overlong 3-byte UTF-8 encoding.");
+    scanx_parse_u(s, u32, "Overlong 3-byte UTF-8 encoding.");
   }
 
   return u;
 
 l_utf8_4:
   bytes[0] = current;
-  bytes[1] = ecx_fgetc(stream);
-  bytes[2] = ecx_fgetc(stream);
-  bytes[3] = ecx_fgetc(stream);
+  bytes[1] = u8_scan_continuation(s);
+  bytes[2] = u8_scan_continuation(s);
+  bytes[3] = u8_scan_continuation(s);
 
   u  = (bytes[0] & 0x07) << 18;
   u |= (bytes[1] & 0x3F) << 12;
@@ -138,7 +208,21 @@ l_utf8_4:
 
   if (u8_overlong(bytes)) {
     int64_t u32 = u;
-    cjsonx_parse_u(stream, u32, "Overlong 4-byte UTF-8 encoding.");
+    scanx_parse_u(s, u32, "Overlong 4-byte UTF-8 encoding.");
+  }
+
+  return u;
+}
+
+/* Read the unicode code point from a UTF-8 encoded stream. */
+int64_t
+cjson_u8_fgetu(FILE *stream)
+{
+  int64_t u = 0;
+  struct scan scan, *s = &scan;
+  scan_fopen(s, stream, NULL, 0, 0);
+  ec_with(s, (ec_unwind_f)scan_fclose) {
+    u = u8_scanu(s);
   }
 
   return u;
@@ -0,0 +1,451 @@
+/*** cjson validation ***/
+
+/* Validation runs the same checks as parsing, but builds nothing. Strings and
+ * numbers are read into a discarding scan buffer, and the keys of the open
+ * objects are remembered by their hash and position in a table on the stack
+ * to find duplicates, so nothing is allocated for most documents.
+ */
+
+/* The number of keys remembered on the stack for finding duplicates. The keys
+ * of an object that don't fit are moved to a hash table of its own.
+ */
+#define VALIDATE_KEYS 1024
+
+struct validate_key {
+  uint64_t hash;
+  const uint8_t *at;          /* The key's opening quote. */
+};
+
+/* The keys of an object that spilled from the stack table, open addressed by
+ * hash. Spilled objects are stacked like the objects themselves, so the
+ * object adding keys always owns the top table.
+ */
+struct validate_spill {
+  struct validate_spill *next;
+  size_t count;
+  size_t mask;
+  struct validate_key keys[];
+};
+
+struct validate {
+  struct scan scan;
+  struct cjson_od_doc doc;    /* The index of the scan, also used to read keys again. */
+  struct scan_buffer buffer;
+  struct cjson_validation *result;
+
+  struct validate_spill *spills;
+  size_t count;               /* The number of keys in the table. */
+  struct validate_key keys[VALIDATE_KEYS];
+};
+
+/* Return the next byte that isn't whitespace. */
+static inline
+int
+validate_getc(struct scan *s)
+{
+  int current = scan_getc(s);
+  if (scan_isspace(current)) {
+    scan_skip_whitespace(s);
+    current = scan_getc(s);
+  }
+
+  return current;
+}
+
+/* Return the hash of the (already validated) key at p in its normalized JSON
+ * encoded string form. Only escape sequences differ from their normalized
+ * form, so everything else is hashed as is.
+ */
+static
+uint64_t
+validate_key_hash(struct validate *x, const uint8_t *p)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  struct scan scan, *s = &scan;
+  scan_mopen(s, x->doc.base, x->doc.end - x->doc.base);
+  s->cursor = p + 1;
+
+  for (;;) {
+    uint8_t current = *s->cursor;
+    if (current == '"') {
+      break;
+    }
+
+    if (current != '\\') {
+      hash = (hash ^ current) * 0x100000001b3ULL;
+      s->cursor++;
+      continue;
+    }
+
+    uint8_t bytes[6];
+    size_t length = jestr_encode(jestr_scanu(s), bytes);
+    for (size_t i = 0; i < length; i++) {
+      hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    }
+  }
+
+  return hash;
+}
+
+/* Return true if the (already validated) keys at a and b are the same. */
+static
+int
+validate_key_equal(struct validate *x, const uint8_t *a, const uint8_t *b)
+{
+  struct scan scan_a, *sa = &scan_a;
+  scan_mopen(sa, x->doc.base, x->doc.end - x->doc.base);
+  sa->cursor = a + 1;
+
+  struct scan scan_b, *sb = &scan_b;
+  scan_mopen(sb, x->doc.base, x->doc.end - x->doc.base);
+  sb->cursor = b + 1;
+
+  for (;;) {
+    if (*sa->cursor == '"' || *sb->cursor == '"') {
+      return *sa->cursor == *sb->cursor;
+    }
+
+    if (jestr_scanu(sa) != jestr_scanu(sb)) {
+      return 0;
+    }
+  }
+}
+
+/* Report the key (which has just been read) as a duplicate. */
+static
+void
+validate_duplicate(struct validate *x, const uint8_t *key)
+{
+  struct scan *s = &x->scan;
+  const uint8_t *close = s->cursor - 1;
+  ec_throw_strf(CJSONX_PARSE, "Invalid duplicate key at %ld: \"%.*s\".", scan_tell(s), (int)(close - key - 1), key + 1);
+}
+
+/* Add the (unique) key to the spilled table. */
+static
+void
+validate_spill_put(struct validate_spill *spill, uint64_t hash, const uint8_t *at)
+{
+  size_t i = hash & spill->mask;
+  while (spill->keys[i].at != NULL) {
+    i = (i + 1) & spill->mask;
+  }
+
+  spill->keys[i].hash = hash;
+  spill->keys[i].at = at;
+  spill->count++;
+}
+
+/* Replace the top spilled table (if any) with one that has room for at least
+ * count keys, keeping the keys it has.
+ */
+static
+void
+validate_spill_grow(struct validate *x, size_t count)
+{
+  size_t size = 64;
+  while (size < count * 2) {
+    size *= 2;
+  }
+
+  struct validate_spill *spill = ecx_malloc(sizeof(*spill) + size * sizeof(spill->keys[0]));
+  spill->count = 0;
+  spill->mask = size - 1;
+  memset(spill->keys, 0, size * sizeof(spill->keys[0]));
+
+  struct validate_spill *top = x->spills;
+  if (top != NULL) {
+    for (size_t i = 0; i <= top->mask; i++) {
+      if (top->keys[i].at != NULL) {
+        validate_spill_put(spill, top->keys[i].hash, top->keys[i].at);
+      }
+    }
+    spill->next = top->next;
+    free(top);
+  } else {
+    spill->next = NULL;
+  }
+  x->spills = spill;
+}
+
+/* Free the top spilled table. */
+static
+void
+validate_spill_pop(struct validate *x)
+{
+  struct validate_spill *top = x->spills;
+  x->spills = top->next;
+  free(top);
+}
+
+/* Free the spilled tables of the objects left open by an error. */
+static
+void
+validate_release(struct validate *x)
+{
+  while (x->spills != NULL) {
+    validate_spill_pop(x);
+  }
+}
+
+/* Check the key (which has just been read) against the earlier keys of the
+ * object. The keys from mark in the table belong to the object, unless it
+ * didn't fit (spilled is set), in which case they are in the top spilled
+ * table.
+ */
+static
+void
+validate_key(struct validate *x, const uint8_t *key, size_t mark, unsigned int *spilled)
+{
+  uint64_t hash = validate_key_hash(x, key);
+
+  if (*spilled) {
+    struct validate_spill *spill = x->spills;
+    for (size_t i = hash & spill->mask; spill->keys[i].at != NULL; i = (i + 1) & spill->mask) {
+      if (spill->keys[i].hash == hash && validate_key_equal(x, spill->keys[i].at, key)) {
+        validate_duplicate(x, key);
+      }
+    }
+
+    if ((spill->count + 1) * 2 > spill->mask + 1) {
+      validate_spill_grow(x, spill->count + 1);
+    }
+    validate_spill_put(x->spills, hash, key);
+    return;
+  }
+
+  for (size_t i = mark; i < x->count; i++) {
+    if (x->keys[i].hash == hash && validate_key_equal(x, x->keys[i].at, key)) {
+      validate_duplicate(x, key);
+    }
+  }
+
+  if (x->count == VALIDATE_KEYS) {
+    /* Move the object's keys out of the way of the objects nested in it. */
+    struct validate_spill *top = x->spills;
+    x->spills = NULL;
+    validate_spill_grow(x, x->count - mark + 1);
+    x->spills->next = top;
+
+    for (size_t i = mark; i < x->count; i++) {
+      validate_spill_put(x->spills, x->keys[i].hash, x->keys[i].at);
+    }
+    validate_spill_put(x->spills, hash, key);
+    x->count = mark;
+    *spilled = 1;
+    return;
+  }
+
+  x->keys[x->count].hash = hash;
+  x->keys[x->count].at = key;
+  x->count++;
+}
+
+static
+void
+validate_value(struct validate *x)
+{
+  struct scan *s = &x->scan;
+  struct scan_buffer *b = &x->buffer;
+
+  static void *go_value[] = {
+    [0 ... 255] = &&l_invalid,
+
+    ['['] = &&l_array,
+
+    ['-']       = &&l_number,
+    [48 ... 57] = &&l_number,
+
+    ['{'] = &&l_object,
+
+    ['"'] = &&l_string,
+
+    ['t'] = &&l_boolean,
+    ['f'] = &&l_boolean,
+    ['n'] = &&l_null,
+  };
+
+  int current = validate_getc(s);
+  if (current == EOF) {
+    ec_throw_strf(CJSONX_PARSE, "Expecting more data at %ld; Value was not specified.", scan_tell(s));
+  }
+
+  x->result->values++;
+  goto *go_value[current];
+
+l_invalid:
+  scanx_parse_c(s, current, "Expecting to find a JSON type to parse.");
+
+l_array:
+  scan_enter(s, NULL, current);
+  if (s->depth > x->result->depth) {
+    x->result->depth = s->depth;
+  }
+
+  current = validate_getc(s);
+  if (current != ']') {
+    scan_ungetc(s, current);
+
+    for (;;) {
+      validate_value(x);
+
+      current = validate_getc(s);
+      if (current == ']') {
+        break;
+      }
+      if (current != ',') {
+        scanx_parse_c(s, current, "Expecting ',' or ']'.");
+      }
+    }
+  }
+
+  scan_leave(s);
+  return;
+
+l_object:
+  scan_enter(s, NULL, current);
+  if (s->depth > x->result->depth) {
+    x->result->depth = s->depth;
+  }
+
+  {
+    size_t mark = x->count;
+    unsigned int spilled = 0;
+
+    current = validate_getc(s);
+    while (current != '}') {
+      if (current != '"') {
+        scanx_parse_c(s, current, "Expecting to find a JSON key/value pair to parse.");
+      }
+      scan_ungetc(s, current);
+
+      const uint8_t *at = s->cursor;
+      b->length = 0;
+      jestr_scanb(s, b, 0);
+      validate_key(x, at, mark, &spilled);
+
+      current = validate_getc(s);
+      if (current != ':') {
+        scanx_parse_c(s, current, "Expecting ':'.");
+      }
+      validate_value(x);
+
+      current = validate_getc(s);
+      if (current == '}') {
+        break;
+      }
+      if (current != ',') {
+        scanx_parse_c(s, current, "Expecting ',' or '}'.");
+      }
+
+      current = validate_getc(s);
+      if (current == '}') {
+        scanx_parse_c(s, current, "Expecting to find a JSON key/value pair to parse.");
+      }
+    }
+
+    x->count = mark;
+    if (spilled) {
+      validate_spill_pop(x);
+    }
+  }
+
+  scan_leave(s);
+  return;
+
+l_string:
+  scan_ungetc(s, current);
+  b->length = 0;
+  jestr_scanb(s, b, 0);
+  return;
+
+l_number:
+  scan_ungetc(s, current);
+  b->length = 0;
+  number_scanb(s, b);
+  return;
+
+l_boolean:
+  scan_ungetc(s, current);
+  boolean_scan_token(s);
+  return;
+
+l_null:
+  scan_ungetc(s, current);
+  null_scan_token(s);
+  return;
+}
+
+static
+void
+validate_root(struct validate *x, enum cjson_type valid)
+{
+  static const uint8_t types[256] = {
+    ['[']         = CJSON_ARRAY,
+    ['t']         = CJSON_BOOLEAN,
+    ['f']         = CJSON_BOOLEAN,
+    ['n']         = CJSON_NULL,
+    ['-']         = CJSON_NUMBER,
+    ['0' ... '9'] = CJSON_NUMBER,
+    ['{']         = CJSON_OBJECT,
+    ['"']         = CJSON_STRING,
+  };
+
+  struct scan *s = &x->scan;
+
+  int current = validate_getc(s);
+  if (current == EOF) {
+    ec_throw_str_static(CJSONX_PARSE, "Expecting more data; Failed to find a document.");
+  }
+  scan_ungetc(s, current);
+
+  if (types[current] != 0 && (valid & types[current]) == 0) {
+    scanx_parse_c(s, current, "Found a value, but it is not a valid type for a bare item.");
+  }
+
+  validate_value(x);
+
+  current = validate_getc(s);
+  if (current != EOF) {
+    scanx_parse_c(s, current, "Expecting the end of the input after the document.");
+  }
+}
+
+int
+cjson_validate(const char *buf, size_t length, enum cjson_type valid, struct cjson_validation *result)
+{
+  struct validate state, *x = &state;
+  x->doc.base = (const uint8_t *)buf;
+  x->doc.end = x->doc.base + length;
+  scan_mopen(&x->scan, buf, length);
+  scan_index(&x->scan, &x->doc.index);
+
+  x->buffer = (struct scan_buffer)SCAN_BUFFER_INIT(NULL);
+  x->buffer.discard = 1;
+
+  x->result = result;
+  x->spills = NULL;
+  x->count = 0;
+
+  result->values = 0;
+  result->depth = 0;
+  result->bytes = 0;
+  result->error[0] = '\0';
+
+  volatile int status = 1;
+  const char * volatile msg = NULL;
+
+  ec_try {
+    ec_with(x, validate_release) {
+      validate_root(x, valid);
+    }
+  } ec_catch_a(CJSONX_PARSE, msg) {
+    snprintf(result->error, sizeof(result->error), "%s", msg);
+    status = 0;
+  }
+
+  result->bytes = x->scan.cursor - x->doc.base;
+
+  return status;
+}
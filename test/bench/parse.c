@@ -0,0 +1,127 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CJSON Library.
+ *
+ * The CJSON Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * The CJSON Library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CJSON Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Time the parsers that build nodes on generated documents. Each result is
+ * the best of several runs in MB/s.
+ *
+ * Usage: parse [records]
+ */
+
+#include <cjson.h>
+#include <ec/ec.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RUNS 25
+
+static
+double
+now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* Write records of typical API output, indented (pretty) or not. */
+static
+char *
+generate(size_t records, int pretty, size_t *length)
+{
+  const char *nl = pretty ? "\n    " : "";
+  const char *sp = pretty ? " " : "";
+  size_t size = records * 256 + 16;
+  char *buf = malloc(size);
+  size_t n = 0;
+
+  n += sprintf(buf + n, "[");
+  for (size_t i = 0; i < records; i++) {
+    n += sprintf(buf + n,
+      "%s%s{%s\"id\":%s%zu,%s\"name\":%s\"user %zu\",%s\"active\":%s%s,%s\"score\":%s%zu.%02zu,"
+      "%s\"tags\":%s[\"a\",%s\"bb\",%s\"ccc\"],%s\"note\":%snull}",
+      i == 0 ? "" : ",", nl, nl, sp, i, nl, sp, i, nl, sp, i % 2 ? "true" : "false", nl, sp, i % 1000, i % 100,
+      nl, sp, sp, sp, nl, sp);
+  }
+  n += sprintf(buf + n, "]");
+
+  *length = n;
+  return buf;
+}
+
+static
+void
+report(const char *name, const char *buf, size_t length, struct cjson *(*parse)(const char *, size_t))
+{
+  double best = 0;
+  for (int run = 0; run < RUNS; run++) {
+    double start = now();
+    struct cjson *node = parse(buf, length);
+    double elapsed = now() - start;
+    cjson_free(node);
+
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+
+  printf("%-24s %8.1f MB/s\n", name, length / best / 1e6);
+}
+
+static
+struct cjson *
+root_parse(const char *buf, size_t length)
+{
+  return cjson_root_parse(buf, length, CJSON_ALL_S, 0, NULL);
+}
+
+static
+struct cjson *
+array_parse(const char *buf, size_t length)
+{
+  return cjson_array_parse(buf, length, NULL);
+}
+
+static
+struct cjson *
+root_try_parse(const char *buf, size_t length)
+{
+  struct cjson_error error;
+  return cjson_root_try_parse(buf, length, CJSON_ALL_S, 0, NULL, &error);
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t records = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+
+  for (int pretty = 0; pretty < 2; pretty++) {
+    size_t length = 0;
+    char *buf = generate(records, pretty, &length);
+    printf("%s (%zu bytes)\n", pretty ? "indented" : "compact", length);
+
+    report("cjson_root_parse", buf, length, root_parse);
+    report("cjson_root_try_parse", buf, length, root_try_parse);
+    report("cjson_array_parse", buf, length, array_parse);
+
+    free(buf);
+  }
+
+  return 0;
+}
@@ -0,0 +1,168 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CJSON Library.
+ *
+ * The CJSON Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * The CJSON Library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CJSON Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ccstreams/ecx_ccstreams.h>
+#include <check.h>
+#include <ec/ec.h>
+#include <ecx_stdio.h>
+#include <ecx_stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cjson.h>
+
+/* Render the node to a string (which must be freed). */
+static
+char *
+render(struct cjson *node)
+{
+  char *buf = NULL;
+  FILE *stream = ecx_ccstreams_fstropen(&buf, "w+");
+  cjson_fprint(stream, node);
+  fclose(stream);
+
+  return buf;
+}
+
+START_TEST(arena_buffer)
+{
+#define IN "{\"a\": [1, \"b\", true, null], \"c\\u0064\": -2.5}"
+  char buf[4096];
+  struct cjson_arena *arena = cjson_arena_new(buf, sizeof(buf));
+  struct cjson_hook hook = {.arena = arena};
+
+  struct cjson *node = cjson_root_parse(IN, sizeof(IN) - 1, CJSON_ALL_S, 0, &hook);
+  struct cjson *exp = cjson_root_parse(IN, sizeof(IN) - 1, CJSON_ALL_S, 0, NULL);
+
+  /* The nodes and their bytes are all in the buffer. */
+  struct cjson *pair = cjson_object_get(cjson_array_get(node, 0), "cd");
+  fail_unless(pair != NULL);
+  fail_unless((char *)arena >= buf && (char *)arena < buf + sizeof(buf));
+  fail_unless((char *)node >= buf && (char *)node < buf + sizeof(buf));
+  fail_unless(pair->value.pair.key >= buf && pair->value.pair.key < buf + sizeof(buf));
+  fail_unless(pair->value.pair.value->value.number >= buf && pair->value.pair.value->value.number < buf + sizeof(buf));
+
+  char *got_buf = render(node);
+  char *exp_buf = render(exp);
+  fail_unless(strcmp(got_buf, exp_buf) == 0, "Got:\n%s\nExp:\n%s", got_buf, exp_buf);
+  free(got_buf);
+  free(exp_buf);
+
+  cjson_free(exp);
+  cjson_free(node);
+  cjson_arena_free(arena);
+#undef IN
+}
+END_TEST
+
+START_TEST(arena_chunks)
+{
+  /* Larger than the buffer, so chunks are allocated. */
+  const size_t count = 2000;
+  char *in = ecx_malloc(count * 16 + 2);
+  size_t length = 0;
+  in[length++] = '[';
+  for (size_t i = 0; i < count; i++) {
+    length += sprintf(in + length, "%s\"s%zu\"", i == 0 ? "" : ",", i);
+  }
+  in[length++] = ']';
+
+  char buf[256];
+  struct cjson_arena *arenas[] = {cjson_arena_new(buf, sizeof(buf)), cjson_arena_new(NULL, 0)};
+
+  for (size_t k = 0; k < 2; k++) {
+    struct cjson_hook hook = {.arena = arenas[k]};
+    struct cjson *node = cjson_root_parse(in, length, CJSON_ALL_S, 0, &hook);
+    struct cjson *array = cjson_array_get(node, 0);
+    fail_unless(cjson_array_length(array) == count);
+
+    for (size_t i = 0; i < count; i += 199) {
+      char exp[16];
+      sprintf(exp, "s%zu", i);
+      struct cjson *string = cjson_array_get(array, i);
+      fail_unless(string->value.string.length == strlen(exp));
+      fail_unless(memcmp(string->value.string.bytes, exp, strlen(exp)) == 0);
+    }
+
+    cjson_free(node);
+    cjson_arena_free(arenas[k]);
+  }
+
+  free(in);
+}
+END_TEST
+
+START_TEST(arena_manipulate)
+{
+  struct cjson_arena *arena = cjson_arena_new(NULL, 0);
+  struct cjson_hook hook = {.arena = arena};
+
+  struct cjson *node = cjson_root_parse("[1]", 3, CJSON_ALL_S, 0, &hook);
+  struct cjson *array = cjson_array_get(node, 0);
+
+  /* New nodes use the arena of their parent. */
+  struct cjson *number = cjson_number_from_int64(42, array);
+  cjson_array_append(array, number);
+  fail_unless(number->hook == &hook);
+  fail_unless(cjson_number_get_int64(cjson_array_get(array, 1)) == 42);
+
+  struct cjson *removed = cjson_array_truncate(array, 1);
+  fail_unless(cjson_array_length(array) == 1);
+  fail_unless(cjson_array_length(removed) == 1);
+  cjson_free(removed);
+
+  struct cjson *string = cjson_string_parse("\"x\"", 3, array);
+  fail_unless(string->hook == &hook);
+  cjson_free(string);
+
+  cjson_free(node);
+  cjson_arena_free(arena);
+}
+END_TEST
+
+static
+Suite *
+suite(void)
+{
+  Suite *suite = suite_create("arena");
+
+  TCase *tcase_arena = tcase_create("arena");
+  tcase_add_test(tcase_arena, arena_buffer);
+  tcase_add_test(tcase_arena, arena_chunks);
+  tcase_add_test(tcase_arena, arena_manipulate);
+  suite_add_tcase(suite, tcase_arena);
+
+  return suite;
+}
+
+int
+main(void)
+{
+  int failed = 0;
+
+  SRunner *srunner = srunner_create(suite());
+
+  srunner_run_all(srunner, CK_NORMAL);
+  failed = srunner_ntests_failed(srunner);
+
+  srunner_free(srunner);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -18,6 +18,7 @@
 
 #include <ccstreams/ecx_ccstreams.h>
 #include <check.h>
+#include <ec/ec.h>
 #include <ecx_stdio.h>
 #include <errno.h>
 #include <inttypes.h>
@@ -228,6 +229,134 @@ START_TEST(manipulate)
 }
 END_TEST
 
+START_TEST(fscan_whitespace)
+{
+  /* Runs of whitespace that cross the blocks read from the stream. */
+  size_t length = 0;
+  char *in = malloc(65536);
+  length += sprintf(in + length, "[");
+  for (int i = 0; i < 400; i++) {
+    length += sprintf(in + length, "%s\n%*s%d%*s", i == 0 ? "" : ",", i % 130, "", i, i % 17, "");
+  }
+  length += sprintf(in + length, "\r\n\t]");
+
+  FILE *stream = fmemopen(in, length, "r");
+  struct cjson *node = cjson_array_fscan(stream, NULL);
+  fclose(stream);
+
+  fail_unless(node != NULL);
+  fail_unless(cjson_array_length(node) == 400);
+
+  char *buf = NULL;
+  stream = ecx_ccstreams_fstropen(&buf, "w+");
+  cjson_fprint(stream, cjson_array_get(node, 399));
+  fclose(stream);
+
+  const char fmt[] = "Failed to scan the last item. Got: %s Exp: %s";
+  fail_unless(strcmp(buf, "399") == 0, fmt, buf, "399");
+
+  cjson_free(node);
+  free(buf);
+  free(in);
+}
+END_TEST
+
+START_TEST(iter_parse)
+{
+#define IN " [1, \"a\", [true], {\"b\": null}] "
+  struct cjson_array_iter *iter = cjson_array_iter_parse(IN, sizeof(IN) - 1, NULL, NULL);
+  enum cjson_type types[] = {CJSON_NUMBER, CJSON_STRING, CJSON_ARRAY, CJSON_OBJECT};
+
+  for (size_t i = 0; i < 4; i++) {
+    struct cjson *node = cjson_array_iter_next(iter);
+    fail_unless(node != NULL);
+    fail_unless(node->type == types[i]);
+    fail_unless(node->parent == NULL);
+    cjson_free(node);
+  }
+  fail_unless(cjson_array_iter_next(iter) == NULL);
+  fail_unless(cjson_array_iter_next(iter) == NULL);
+
+  cjson_array_iter_free(iter);
+#undef IN
+}
+END_TEST
+
+START_TEST(iter_path)
+{
+#define IN "{\"meta\": {\"items\": [0]}, \"data\": [{}, {\"it\\u0065ms\": [{\"id\": 1}, {\"id\": 2}]}], \"after\": 1}"
+  struct cjson_array_iter *iter = cjson_array_iter_parse(IN, sizeof(IN) - 1, "data\0" "1\0" "items\0", NULL);
+
+  for (int64_t i = 1; i <= 2; i++) {
+    struct cjson *node = cjson_array_iter_next(iter);
+    fail_unless(node != NULL);
+    fail_unless(cjson_number_get_int64(cjson_get(node, "id\0")) == i);
+    cjson_free(node);
+  }
+  fail_unless(cjson_array_iter_next(iter) == NULL);
+
+  cjson_array_iter_free(iter);
+#undef IN
+}
+END_TEST
+
+START_TEST(iter_fscan)
+{
+#define IN "{\"data\": {\"items\": []}}"
+  char *buf = IN;
+  FILE *stream = ecx_ccstreams_fstropen(&buf, "r");
+  struct cjson_array_iter *iter = cjson_array_iter_fscan(stream, "data\0" "items\0", NULL);
+
+  fail_unless(cjson_array_iter_next(iter) == NULL);
+
+  cjson_array_iter_free(iter);
+  fclose(stream);
+#undef IN
+}
+END_TEST
+
+START_TEST(iter_invalid)
+{
+  struct {
+    const char *in;
+    const char *path;
+    const char *exception;
+  } error[] = {
+    {"{\"a\": [1]}", "b\0", CJSONX_NOT_FOUND},
+    {"{\"a\": [1]}", "a\0" "1\0", CJSONX_NOT_FOUND},
+    {"{\"a\": 1}", "a\0", CJSONX_TYPE},
+    {"{\"b\": [1,], \"a\": []}", "a\0", CJSONX_PARSE},
+    {"{\"b\": 1,}", "a\0", CJSONX_PARSE},
+    {"[1 2]", "", CJSONX_PARSE},
+    {"[1,]", "", CJSONX_PARSE},
+    {"[1", "", CJSONX_PARSE},
+  };
+
+  for (size_t k = 0; k < sizeof(error) / sizeof(error[0]); k++) {
+    struct cjson_array_iter * volatile iter = NULL;
+    const char * volatile exception = NULL;
+    const char * volatile msg = NULL;
+
+    ec_try {
+      iter = cjson_array_iter_parse(error[k].in, strlen(error[k].in), error[k].path, NULL);
+      for (struct cjson *node = cjson_array_iter_next(iter); node != NULL; node = cjson_array_iter_next(iter)) {
+        cjson_free(node);
+      }
+    } ec_catch_a(CJSONX_PARSE, msg) {
+      exception = CJSONX_PARSE;
+    } ec_catch_a(CJSONX_NOT_FOUND, msg) {
+      exception = CJSONX_NOT_FOUND;
+    } ec_catch_a(CJSONX_TYPE, msg) {
+      exception = CJSONX_TYPE;
+    } ec_catch {
+    }
+    cjson_array_iter_free(iter);
+
+    fail_unless(exception == error[k].exception, "Document %zu.", k);
+  }
+}
+END_TEST
+
 static
 Suite *
 suite(void)
@@ -236,6 +365,7 @@ suite(void)
 
   TCase *tcase_fscan = tcase_create("fscan");
   tcase_add_test(tcase_fscan, fscan);
+  tcase_add_test(tcase_fscan, fscan_whitespace);
   suite_add_tcase(suite, tcase_fscan);
 
   TCase *tcase_fprint = tcase_create("fprint");
@@ -251,6 +381,13 @@ suite(void)
   tcase_add_test(tcase_manipulate, manipulate);
   suite_add_tcase(suite, tcase_manipulate);
 
+  TCase *tcase_iter = tcase_create("iter");
+  tcase_add_test(tcase_iter, iter_parse);
+  tcase_add_test(tcase_iter, iter_path);
+  tcase_add_test(tcase_iter, iter_fscan);
+  tcase_add_test(tcase_iter, iter_invalid);
+  suite_add_tcase(suite, tcase_iter);
+
   return suite;
 }
 
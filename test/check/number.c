@@ -18,9 +18,13 @@
 
 #include <ccstreams/ecx_ccstreams.h>
 #include <check.h>
+#include <ec/ec.h>
 #include <ecx_stdio.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <locale.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -79,6 +83,384 @@ START_TEST(fprint)
 }
 END_TEST
 
+START_TEST(parse)
+{
+#define IN "-0.5e+10,"
+#define EXP "-0.5e+10"
+  struct cjson *node = cjson_number_parse(IN, sizeof(IN) - 1, NULL);
+
+  fail_unless(node != NULL);
+  fail_unless(node->value.number != NULL);
+  {
+    const char fmt[] = "Failed to parse number from buffer. Got: %s Exp: %s";
+    fail_unless(strcmp(node->value.number, EXP) == 0, fmt, node->value.number, EXP);
+  }
+
+  cjson_free(node);
+#undef EXP
+#undef IN
+}
+END_TEST
+
+START_TEST(fscan_remainder)
+{
+#define IN "3.14,x"
+  char *buf = IN;
+  FILE *stream = ecx_ccstreams_fstropen(&buf, "r");
+  struct cjson *node = cjson_number_fscan(stream, NULL);
+
+  fail_unless(strcmp(node->value.number, "3.14") == 0);
+  fail_unless(fgetc(stream) == ',');
+  fail_unless(fgetc(stream) == 'x');
+
+  fclose(stream);
+  cjson_free(node);
+#undef IN
+}
+END_TEST
+
+START_TEST(parse_long)
+{
+#define IN "-1234567890123456789012345678901234567890123456789012345678901234567890" \
+           ".1234567890123456789012345678901234567890e-1234567890]"
+#define EXP "-1234567890123456789012345678901234567890123456789012345678901234567890" \
+            ".1234567890123456789012345678901234567890e-1234567890"
+  struct cjson *node = cjson_number_parse(IN, sizeof(IN) - 1, NULL);
+
+  fail_unless(node != NULL);
+  fail_unless(node->value.number != NULL);
+  {
+    const char fmt[] = "Failed to parse number from buffer. Got: %s Exp: %s";
+    fail_unless(strcmp(node->value.number, EXP) == 0, fmt, node->value.number, EXP);
+  }
+
+  cjson_free(node);
+#undef EXP
+#undef IN
+}
+END_TEST
+
+START_TEST(parse_invalid)
+{
+  const char *in[] = {
+    "",
+    "-",
+    "01",
+    "1.",
+    ".5",
+    "1e",
+    "1e+",
+    "+1",
+    "1.5.2",
+    "12a",
+    "1:",
+  };
+
+  for (size_t i = 0; i < sizeof(in) / sizeof(*in); i++) {
+    const char * volatile msg = NULL;
+    struct cjson * volatile node = NULL;
+
+    ec_try {
+      node = cjson_number_parse(in[i], strlen(in[i]), NULL);
+    } ec_catch_a(CJSONX_PARSE, msg) {
+    } ec_catch {
+    }
+
+    fail_unless(node == NULL, "Parsed invalid number %zu.", i);
+    fail_unless(msg != NULL);
+  }
+}
+END_TEST
+
+START_TEST(get_int64)
+{
+  const char *in[] = {"0", "-9223372036854775808", "9223372036854775807", "1e3", "-12300e-2"};
+  const int64_t exp[] = {0, INT64_MIN, INT64_MAX, 1000, -123};
+
+  for (size_t i = 0; i < sizeof(in) / sizeof(*in); i++) {
+    struct cjson *node = cjson_number_parse(in[i], strlen(in[i]), NULL);
+
+    const char fmt[] = "Failed to get int64 from number. Got: %" PRId64 " Exp: %" PRId64;
+    int64_t got = cjson_number_get_int64(node);
+    fail_unless(got == exp[i], fmt, got, exp[i]);
+
+    /* Again, from the cache. */
+    got = cjson_number_get_int64(node);
+    fail_unless(got == exp[i], fmt, got, exp[i]);
+
+    cjson_free(node);
+  }
+
+  const char *range[] = {"9223372036854775808", "-9223372036854775809", "1.5", "1e-1", "1e400"};
+  for (size_t i = 0; i < sizeof(range) / sizeof(*range); i++) {
+    const char * volatile msg = NULL;
+    struct cjson *node = cjson_number_parse(range[i], strlen(range[i]), NULL);
+
+    ec_try {
+      cjson_number_get_int64(node);
+    } ec_catch_a(CJSONX_RANGE, msg) {
+    } ec_catch {
+    }
+
+    fail_unless(msg != NULL, "Got int64 from out of range number: %s", range[i]);
+    cjson_free(node);
+  }
+}
+END_TEST
+
+START_TEST(get_uint64)
+{
+  const char *in[] = {"0", "-0", "18446744073709551615", "1e19"};
+  const uint64_t exp[] = {0, 0, UINT64_MAX, 10000000000000000000ULL};
+
+  for (size_t i = 0; i < sizeof(in) / sizeof(*in); i++) {
+    struct cjson *node = cjson_number_parse(in[i], strlen(in[i]), NULL);
+
+    const char fmt[] = "Failed to get uint64 from number. Got: %" PRIu64 " Exp: %" PRIu64;
+    uint64_t got = cjson_number_get_uint64(node);
+    fail_unless(got == exp[i], fmt, got, exp[i]);
+
+    cjson_free(node);
+  }
+
+  const char *range[] = {"-1", "18446744073709551616", "0.5"};
+  for (size_t i = 0; i < sizeof(range) / sizeof(*range); i++) {
+    const char * volatile msg = NULL;
+    struct cjson *node = cjson_number_parse(range[i], strlen(range[i]), NULL);
+
+    ec_try {
+      cjson_number_get_uint64(node);
+    } ec_catch_a(CJSONX_RANGE, msg) {
+    } ec_catch {
+    }
+
+    fail_unless(msg != NULL, "Got uint64 from out of range number: %s", range[i]);
+    cjson_free(node);
+  }
+}
+END_TEST
+
+START_TEST(get_double)
+{
+  const char *in[] = {"0.5", "0.1", "-1.25e2", "9007199254740993", "1e23", "2.2250738585072014e-308"};
+  const double exp[] = {0.5, 0.1, -125.0, 9007199254740992.0, 1e23, 2.2250738585072014e-308};
+  const int exp_exact[] = {1, 0, 1, 0, 0, 0};
+
+  for (size_t i = 0; i < sizeof(in) / sizeof(*in); i++) {
+    struct cjson *node = cjson_number_parse(in[i], strlen(in[i]), NULL);
+
+    int exact = -1;
+    double got = cjson_number_get_double(node, &exact);
+    fail_unless(got == exp[i], "Failed to get double from number. Got: %.17g Exp: %.17g", got, exp[i]);
+    fail_unless(exact == exp_exact[i], "Failed to report exactness of %s. Got: %d Exp: %d", in[i], exact, exp_exact[i]);
+
+    cjson_free(node);
+  }
+
+  const char * volatile msg = NULL;
+  struct cjson *node = cjson_number_parse("-1e400", 6, NULL);
+
+  ec_try {
+    cjson_number_get_double(node, NULL);
+  } ec_catch_a(CJSONX_RANGE, msg) {
+  } ec_catch {
+  }
+
+  fail_unless(msg != NULL);
+  cjson_free(node);
+}
+END_TEST
+
+START_TEST(get_alternate)
+{
+  /* Integers and doubles read in turn give the same results each time. */
+  const char *in[] = {"9007199254740993", "-0", "12.5", "1e9223372036854775807", "1e-9223372036854775808"};
+  const double exp[] = {9007199254740992.0, -0.0, 12.5, 0, 0};
+  const int exp_exact[] = {0, 1, 1, 0, 0};
+  const int exp_integer[] = {1, 1, 0, 0, 0};
+  const int exp_real[] = {1, 1, 1, 0, 1};
+
+  for (size_t i = 0; i < sizeof(in) / sizeof(*in); i++) {
+    struct cjson *node = cjson_number_parse(in[i], strlen(in[i]), NULL);
+
+    for (int round = 0; round < 3; round++) {
+      const char * volatile msg = NULL;
+      ec_try {
+        cjson_number_get_int64(node);
+      } ec_catch_a(CJSONX_RANGE, msg) {
+      } ec_catch {
+      }
+      fail_unless((msg == NULL) == exp_integer[i], "Failed to convert %s to int64.", in[i]);
+
+      msg = NULL;
+      int exact = -1;
+      double got = 0;
+      ec_try {
+        got = cjson_number_get_double(node, &exact);
+      } ec_catch_a(CJSONX_RANGE, msg) {
+      } ec_catch {
+      }
+      fail_unless((msg == NULL) == exp_real[i], "Failed to convert %s to double.", in[i]);
+      if (msg == NULL) {
+        fail_unless(got == exp[i] && signbit(got) == signbit(exp[i]), "Failed to get double from %s. Got: %.17g", in[i], got);
+        fail_unless(exact == exp_exact[i], "Failed to report exactness of %s. Got: %d", in[i], exact);
+      }
+    }
+
+    cjson_free(node);
+  }
+}
+END_TEST
+
+START_TEST(get_double_locale)
+{
+  /* Conversions outside the fast path ignore a decimal comma locale. */
+  const char *locales[] = {"de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "fr_FR"};
+  const char *set = NULL;
+  for (size_t i = 0; set == NULL && i < sizeof(locales) / sizeof(*locales); i++) {
+    set = setlocale(LC_NUMERIC, locales[i]);
+  }
+  if (set == NULL) {
+    return;
+  }
+
+  const char *in[] = {"1.5e300", "1267650600228229401496703205376.0", "0.1e-30"};
+  const double exp[] = {1.5e300, 1267650600228229401496703205376.0, 0.1e-30};
+  const int exp_exact[] = {0, 1, 0};
+
+  for (size_t i = 0; i < sizeof(in) / sizeof(*in); i++) {
+    struct cjson *node = cjson_number_parse(in[i], strlen(in[i]), NULL);
+    int exact = -1;
+    double got = cjson_number_get_double(node, &exact);
+    fail_unless(got == exp[i], "Failed to get double from %s. Got: %.17g", in[i], got);
+    fail_unless(exact == exp_exact[i], "Failed to report exactness of %s. Got: %d", in[i], exact);
+    cjson_free(node);
+  }
+
+  setlocale(LC_NUMERIC, "C");
+}
+END_TEST
+
+#define THREADED_COUNT 2000
+
+static
+void *
+get_thread(void *array)
+{
+  /* Half the threads start with the double, so both conversions race for the
+   * cache.
+   */
+  static int started = 0;
+  int first = __atomic_fetch_add(&started, 1, __ATOMIC_RELAXED) % 2;
+
+  for (size_t i = 0; i < THREADED_COUNT; i++) {
+    struct cjson *node = cjson_array_get(array, i);
+    for (int k = 0; k < 2; k++) {
+      if ((k + first) % 2 == 0) {
+        if (cjson_number_get_int64(node) != (int64_t)i * 1000) {
+          return array;
+        }
+      }
+      else {
+        int exact = 0;
+        if (cjson_number_get_double(node, &exact) != (double)i * 1000 || !exact) {
+          return array;
+        }
+      }
+    }
+  }
+  return NULL;
+}
+
+START_TEST(get_threads)
+{
+  char *in = malloc(THREADED_COUNT * 16);
+  size_t length = sprintf(in, "[");
+  for (size_t i = 0; i < THREADED_COUNT; i++) {
+    length += sprintf(in + length, "%s%zue3", i == 0 ? "" : ",", i);
+  }
+  length += sprintf(in + length, "]");
+
+  for (int round = 0; round < 5; round++) {
+    struct cjson *array = cjson_array_parse(in, length, NULL);
+
+    pthread_t threads[4];
+    for (size_t i = 0; i < 4; i++) {
+      fail_unless(pthread_create(&threads[i], NULL, get_thread, array) == 0);
+    }
+    for (size_t i = 0; i < 4; i++) {
+      void *failed = NULL;
+      fail_unless(pthread_join(threads[i], &failed) == 0);
+      fail_unless(failed == NULL, "Got the wrong value.");
+    }
+
+    cjson_free(array);
+  }
+
+  free(in);
+}
+END_TEST
+
+START_TEST(from_int64)
+{
+  const int64_t in[] = {0, 7, -42, 1234567890, INT64_MIN, INT64_MAX};
+  const char *exp[] = {"0", "7", "-42", "1234567890", "-9223372036854775808", "9223372036854775807"};
+
+  for (size_t i = 0; i < sizeof(in) / sizeof(*in); i++) {
+    struct cjson *node = cjson_number_from_int64(in[i], NULL);
+
+    const char fmt[] = "Failed to create number from int64. Got: %s Exp: %s";
+    fail_unless(strcmp(node->value.number, exp[i]) == 0, fmt, node->value.number, exp[i]);
+    fail_unless(cjson_number_get_int64(node) == in[i]);
+
+    cjson_free(node);
+  }
+}
+END_TEST
+
+START_TEST(from_uint64)
+{
+  const uint64_t in[] = {0, 99, 100, UINT64_MAX};
+  const char *exp[] = {"0", "99", "100", "18446744073709551615"};
+
+  for (size_t i = 0; i < sizeof(in) / sizeof(*in); i++) {
+    struct cjson *node = cjson_number_from_uint64(in[i], NULL);
+
+    const char fmt[] = "Failed to create number from uint64. Got: %s Exp: %s";
+    fail_unless(strcmp(node->value.number, exp[i]) == 0, fmt, node->value.number, exp[i]);
+    fail_unless(cjson_number_get_uint64(node) == in[i]);
+
+    cjson_free(node);
+  }
+}
+END_TEST
+
+START_TEST(from_double)
+{
+  const double in[] = {0.0, -0.0, 0.1, 0.3, 100.0, -2.5, 1e21, 1e-6, 1e-7, 5e-324, 1.7976931348623157e308, 9007199254740993.0};
+  const char *exp[] = {"0", "-0", "0.1", "0.3", "100", "-2.5", "1e+21", "0.000001", "1e-7", "5e-324", "1.7976931348623157e+308", "9007199254740992"};
+
+  for (size_t i = 0; i < sizeof(in) / sizeof(*in); i++) {
+    struct cjson *node = cjson_number_from_double(in[i], NULL);
+
+    const char fmt[] = "Failed to create number from double. Got: %s Exp: %s";
+    fail_unless(strcmp(node->value.number, exp[i]) == 0, fmt, node->value.number, exp[i]);
+    fail_unless(strtod(node->value.number, NULL) == in[i]);
+
+    cjson_free(node);
+  }
+
+  const char * volatile msg = NULL;
+  ec_try {
+    cjson_number_from_double(1.0 / 0.0, NULL);
+  } ec_catch_a(CJSONX_RANGE, msg) {
+  } ec_catch {
+  }
+
+  fail_unless(msg != NULL);
+}
+END_TEST
+
 static
 Suite *
 suite(void)
@@ -87,12 +469,34 @@ suite(void)
 
   TCase *tcase_fscan = tcase_create("fscan");
   tcase_add_test(tcase_fscan, fscan);
+  tcase_add_test(tcase_fscan, fscan_remainder);
   suite_add_tcase(suite, tcase_fscan);
 
   TCase *tcase_fprint = tcase_create("fprint");
   tcase_add_test(tcase_fprint, fprint);
   suite_add_tcase(suite, tcase_fprint);
 
+  TCase *tcase_parse = tcase_create("parse");
+  tcase_add_test(tcase_parse, parse);
+  tcase_add_test(tcase_parse, parse_long);
+  tcase_add_test(tcase_parse, parse_invalid);
+  suite_add_tcase(suite, tcase_parse);
+
+  TCase *tcase_get = tcase_create("get");
+  tcase_add_test(tcase_get, get_int64);
+  tcase_add_test(tcase_get, get_uint64);
+  tcase_add_test(tcase_get, get_double);
+  tcase_add_test(tcase_get, get_alternate);
+  tcase_add_test(tcase_get, get_double_locale);
+  tcase_add_test(tcase_get, get_threads);
+  suite_add_tcase(suite, tcase_get);
+
+  TCase *tcase_from = tcase_create("from");
+  tcase_add_test(tcase_from, from_int64);
+  tcase_add_test(tcase_from, from_uint64);
+  tcase_add_test(tcase_from, from_double);
+  suite_add_tcase(suite, tcase_from);
+
   return suite;
 }
 
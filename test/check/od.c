@@ -0,0 +1,199 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CJSON Library.
+ *
+ * The CJSON Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * The CJSON Library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CJSON Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <check.h>
+#include <ec/ec.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cjson.h>
+static const char doc_json[] =
+  " {\"skip\": {\"a\": [1, {\"b\": \"]}\\\"\"}, [[]]], \"c\": \"}\"},"
+  "  \"n\\u0061me\": \"caf\\u00e9\","
+  "  \"items\": [1, -2, 3.5e1, true, false, null, \"x\", [], {}],"
+  "  \"big\": 18446744073709551615"
+  " }";
+
+START_TEST(od_find_field)
+{
+  struct cjson_od_doc *doc = cjson_od_doc_new(doc_json, strlen(doc_json));
+  struct cjson_od root = cjson_od_root(doc), value;
+
+  fail_unless(cjson_od_type(&root) == CJSON_OBJECT);
+
+  fail_unless(cjson_od_find_field(&root, "big", &value) == 1);
+  fail_unless(cjson_od_get_uint64(&value) == UINT64_MAX);
+
+  /* Keys are compared in their normalized form. */
+  fail_unless(cjson_od_find_field(&root, "name", &value) == 1);
+  size_t length = 0;
+  char *name = cjson_od_get_string(&value, &length);
+  fail_unless(length == 5 && strcmp(name, "caf\xc3\xa9") == 0, "Got: %s", name);
+  free(name);
+
+  fail_unless(cjson_od_find_field(&root, "missing", &value) == 0);
+  fail_unless(cjson_od_find_field(&root, "b", &value) == 0);
+
+  struct cjson_od skip, c;
+  fail_unless(cjson_od_find_field(&root, "skip", &skip) == 1);
+  fail_unless(cjson_od_find_field(&skip, "c", &c) == 1);
+  char *s = cjson_od_get_string(&c, NULL);
+  fail_unless(strcmp(s, "}") == 0);
+  free(s);
+
+  cjson_od_doc_free(doc);
+}
+END_TEST
+
+START_TEST(od_array_next)
+{
+  struct cjson_od_doc *doc = cjson_od_doc_new(doc_json, strlen(doc_json));
+  struct cjson_od root = cjson_od_root(doc), items, value;
+  struct cjson_od_iter iter;
+
+  fail_unless(cjson_od_find_field(&root, "items", &items) == 1);
+  cjson_od_iter(&items, &iter);
+
+  enum cjson_type types[] = {
+    CJSON_NUMBER, CJSON_NUMBER, CJSON_NUMBER, CJSON_BOOLEAN, CJSON_BOOLEAN,
+    CJSON_NULL, CJSON_STRING, CJSON_ARRAY, CJSON_OBJECT,
+  };
+
+  size_t count = 0;
+  while (cjson_od_array_next(&iter, &value)) {
+    fail_unless(count < sizeof(types) / sizeof(types[0]));
+    fail_unless(cjson_od_type(&value) == types[count], "Element %zu.", count);
+    count++;
+  }
+  fail_unless(count == 9, "Got: %zu", count);
+
+  cjson_od_iter(&items, &iter);
+  fail_unless(cjson_od_array_next(&iter, &value) == 1);
+  fail_unless(cjson_od_get_int64(&value) == 1);
+  fail_unless(cjson_od_array_next(&iter, &value) == 1);
+  fail_unless(cjson_od_get_int64(&value) == -2);
+  fail_unless(cjson_od_array_next(&iter, &value) == 1);
+  int exact = 0;
+  fail_unless(cjson_od_get_double(&value, &exact) == 35.0 && exact);
+  fail_unless(cjson_od_array_next(&iter, &value) == 1);
+  fail_unless(cjson_od_get_boolean(&value) == 1);
+
+  cjson_od_doc_free(doc);
+}
+END_TEST
+
+START_TEST(od_object_next)
+{
+  struct cjson_od_doc *doc = cjson_od_doc_new(doc_json, strlen(doc_json));
+  struct cjson_od root = cjson_od_root(doc), key, value;
+  struct cjson_od_iter iter;
+
+  const char *keys[] = {"skip", "name", "items", "big"};
+
+  size_t count = 0;
+  cjson_od_iter(&root, &iter);
+  while (cjson_od_object_next(&iter, &key, &value)) {
+    char *k = cjson_od_get_string(&key, NULL);
+    fail_unless(count < 4 && strcmp(k, keys[count]) == 0, "Got: %s", k);
+    free(k);
+    count++;
+  }
+  fail_unless(count == 4, "Got: %zu", count);
+
+  cjson_od_doc_free(doc);
+}
+END_TEST
+
+START_TEST(od_get_node)
+{
+  struct cjson_od_doc *doc = cjson_od_doc_new(doc_json, strlen(doc_json));
+  struct cjson_od root = cjson_od_root(doc), skip;
+
+  fail_unless(cjson_od_find_field(&root, "skip", &skip) == 1);
+
+  struct cjson *node = cjson_od_get_node(&skip, NULL);
+  fail_unless(node->type == CJSON_OBJECT);
+  fail_unless(cjson_get(node, "a\0" "1\0" "b\0")->type == CJSON_STRING);
+  cjson_free(node);
+
+  cjson_od_doc_free(doc);
+}
+END_TEST
+
+START_TEST(od_invalid)
+{
+  const char *json = "{\"a\": 1 \"b\": 2}";
+  struct cjson_od_doc *doc = cjson_od_doc_new(json, strlen(json));
+  struct cjson_od root = cjson_od_root(doc), value;
+  const char * volatile msg = NULL;
+
+  fail_unless(cjson_od_find_field(&root, "a", &value) == 1);
+
+  ec_try {
+    cjson_od_find_field(&root, "b", &value);
+  } ec_catch_a(CJSONX_PARSE, msg) {
+  } ec_catch {
+  }
+  fail_unless(msg != NULL, "Failed to find the missing ','.");
+
+  msg = NULL;
+  ec_try {
+    cjson_od_get_string(&value, NULL);
+  } ec_catch_a(CJSONX_TYPE, msg) {
+  } ec_catch {
+  }
+  fail_unless(msg != NULL, "Failed to reject the number.");
+
+  cjson_od_doc_free(doc);
+}
+END_TEST
+
+static
+Suite *
+suite(void)
+{
+  Suite *suite = suite_create("od");
+
+  TCase *tcase_od = tcase_create("od");
+  tcase_add_test(tcase_od, od_find_field);
+  tcase_add_test(tcase_od, od_array_next);
+  tcase_add_test(tcase_od, od_object_next);
+  tcase_add_test(tcase_od, od_get_node);
+  tcase_add_test(tcase_od, od_invalid);
+  suite_add_tcase(suite, tcase_od);
+
+  return suite;
+}
+
+int
+main(void)
+{
+  int failed = 0;
+
+  SRunner *srunner = srunner_create(suite());
+
+  srunner_run_all(srunner, CK_NORMAL);
+  failed = srunner_ntests_failed(srunner);
+
+  srunner_free(srunner);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
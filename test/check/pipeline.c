@@ -0,0 +1,207 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CJSON Library.
+ *
+ * The CJSON Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * The CJSON Library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CJSON Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <check.h>
+#include <ec/ec.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cjson.h>
+
+/* Write count documents of the form {"i": <index>, "s": "..."} (one per line)
+ * and return the buffer. Every step'th document is invalid (if step is not
+ * zero).
+ */
+static
+char *
+documents(size_t count, size_t step, size_t *length)
+{
+  size_t size = count * 64 + 1;
+  char *buf = malloc(size);
+
+  *length = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (step != 0 && i == step) {
+      *length += sprintf(buf + *length, "{\"i\": %zu,}\n", i);
+    }
+    else {
+      *length += sprintf(buf + *length, "{\"i\": %zu, \"s\": \"%*s\"}\n", i, (int)(i % 31), "x");
+    }
+  }
+
+  return buf;
+}
+
+struct consumer {
+  int64_t next;               /* The next expected index (or -1 for any). */
+  int64_t count;
+  int64_t sum;
+  int64_t stop;               /* Stop after this many documents (or 0). */
+};
+
+static
+int
+consume(void *data, struct cjson *node)
+{
+  struct consumer *c = data;
+  int64_t i = cjson_number_get_int64(cjson_get(node, "i\0"));
+  cjson_free(node);
+
+  if (c->next >= 0) {
+    fail_unless(i == c->next, "Consumed out of order. Got: %" PRId64 " Exp: %" PRId64, i, c->next);
+    c->next++;
+  }
+
+  c->count++;
+  c->sum += i;
+
+  return c->count == c->stop ? 7 : 0;
+}
+
+START_TEST(fscan_ordered)
+{
+  size_t length = 0;
+  char *in = documents(200000, 0, &length);
+  FILE *stream = fmemopen(in, length, "r");
+  struct consumer c = {.next = 0, .count = 0, .sum = 0, .stop = 0};
+
+  int status = cjson_pipeline_fscan(stream, CJSON_OBJECT, 4, 1, consume, &c, NULL);
+
+  fail_unless(status == 0);
+  fail_unless(c.count == 200000, "Consumed %" PRId64 " documents.", c.count);
+
+  fclose(stream);
+  free(in);
+}
+END_TEST
+
+START_TEST(fscan_unordered)
+{
+  size_t length = 0;
+  char *in = documents(200000, 0, &length);
+  FILE *stream = fmemopen(in, length, "r");
+  struct consumer c = {.next = -1, .count = 0, .sum = 0, .stop = 0};
+
+  int status = cjson_pipeline_fscan(stream, CJSON_OBJECT, 0, 0, consume, &c, NULL);
+
+  fail_unless(status == 0);
+  fail_unless(c.count == 200000, "Consumed %" PRId64 " documents.", c.count);
+  fail_unless(c.sum == (int64_t)200000 * 199999 / 2);
+
+  fclose(stream);
+  free(in);
+}
+END_TEST
+
+START_TEST(fscan_stop)
+{
+  size_t length = 0;
+  char *in = documents(200000, 0, &length);
+  FILE *stream = fmemopen(in, length, "r");
+  struct consumer c = {.next = 0, .count = 0, .sum = 0, .stop = 1000};
+
+  int status = cjson_pipeline_fscan(stream, CJSON_OBJECT, 4, 1, consume, &c, NULL);
+
+  fail_unless(status == 7, "Failed to stop. Got: %d Exp: 7", status);
+  fail_unless(c.count == 1000, "Consumed %" PRId64 " documents.", c.count);
+
+  fclose(stream);
+  free(in);
+}
+END_TEST
+
+START_TEST(fscan_invalid)
+{
+  size_t length = 0;
+  char *in = documents(200000, 150000, &length);
+  FILE *stream = fmemopen(in, length, "r");
+  struct consumer c = {.next = 0, .count = 0, .sum = 0, .stop = 0};
+  const char * volatile msg = NULL;
+
+  ec_try {
+    cjson_pipeline_fscan(stream, CJSON_OBJECT, 4, 1, consume, &c, NULL);
+  } ec_catch_a(CJSONX_PARSE, msg) {
+  } ec_catch {
+  }
+
+  fail_unless(msg != NULL, "Failed to find the invalid document.");
+  fail_unless(c.count == 150000, "Consumed %" PRId64 " documents.", c.count);
+
+  fclose(stream);
+  free(in);
+}
+END_TEST
+
+START_TEST(fscan_long)
+{
+  /* A line longer than a batch. */
+  size_t length = 3 * 1024 * 1024;
+  char *in = malloc(length + 64);
+  length = sprintf(in, "{\"i\": 0}\n{\"i\": 1, \"s\": \"");
+  memset(in + length, 'x', 3 * 1024 * 1024);
+  length += 3 * 1024 * 1024;
+  length += sprintf(in + length, "\"}\n{\"i\": 2}");
+
+  FILE *stream = fmemopen(in, length, "r");
+  struct consumer c = {.next = 0, .count = 0, .sum = 0, .stop = 0};
+
+  int status = cjson_pipeline_fscan(stream, CJSON_OBJECT, 2, 1, consume, &c, NULL);
+
+  fail_unless(status == 0);
+  fail_unless(c.count == 3, "Consumed %" PRId64 " documents.", c.count);
+
+  fclose(stream);
+  free(in);
+}
+END_TEST
+
+static
+Suite *
+suite(void)
+{
+  Suite *suite = suite_create("pipeline");
+
+  TCase *tcase_fscan = tcase_create("fscan");
+  tcase_set_timeout(tcase_fscan, 30);
+  tcase_add_test(tcase_fscan, fscan_ordered);
+  tcase_add_test(tcase_fscan, fscan_unordered);
+  tcase_add_test(tcase_fscan, fscan_stop);
+  tcase_add_test(tcase_fscan, fscan_invalid);
+  tcase_add_test(tcase_fscan, fscan_long);
+  suite_add_tcase(suite, tcase_fscan);
+
+  return suite;
+}
+
+int
+main(void)
+{
+  int failed = 0;
+
+  SRunner *srunner = srunner_create(suite());
+
+  srunner_run_all(srunner, CK_NORMAL);
+  failed = srunner_ntests_failed(srunner);
+
+  srunner_free(srunner);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
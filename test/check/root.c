@@ -23,8 +23,11 @@
 #include <ecx_stdlib.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <cjson.h>
 
@@ -460,6 +463,1055 @@ START_TEST(validate)
 }
 END_TEST
 
+START_TEST(parse)
+{
+#define IN "\n0\n[0,\n\"\"]\n[[0, \"\", true, null]]\n{\"a\": [false]}"
+#define EXP "0\n" \
+            "[\n" \
+            "  0,\n" \
+            "  \"\"\n" \
+            "]\n" \
+            "[\n" \
+            "  [\n" \
+            "    0,\n" \
+            "    \"\",\n" \
+            "    true,\n" \
+            "    null\n" \
+            "  ]\n" \
+            "]\n" \
+            "{\n" \
+            "  \"a\": [\n" \
+            "    false\n" \
+            "  ]\n" \
+            "}"
+  char *buf = NULL;
+  FILE *stream = ecx_ccstreams_fstropen(&buf, "w+");
+
+  struct cjson *node = cjson_root_parse(IN, sizeof(IN) - 1, CJSON_ALL_E, 1, NULL);
+
+  cjson_root_fprint(stream, node);
+  fclose(stream);
+
+  fail_unless(buf != NULL);
+
+  const char fmt[] = "Failed to print root to stream. Got:\n%s\nExp:\n%s";
+  fail_unless(strcmp(buf, EXP) == 0, fmt, buf, EXP);
+
+  cjson_free(node);
+  free(buf);
+#undef EXP
+#undef IN
+}
+END_TEST
+
+START_TEST(parse_invalid)
+{
+#define IN "[0, 1"
+  const char * volatile msg = NULL;
+  struct cjson * volatile node = NULL;
+
+  ec_try {
+    node = cjson_root_parse(IN, sizeof(IN) - 1, CJSON_ALL_E, 1, NULL);
+  } ec_catch_a(CJSONX_PARSE, msg) {
+  } ec_catch {
+  }
+
+  fail_unless(node == NULL);
+  fail_unless(msg != NULL);
+#undef IN
+}
+END_TEST
+
+START_TEST(fscan_remainder)
+{
+#define IN "[true]\nnull"
+  char *buf = IN;
+  FILE *stream = ecx_ccstreams_fstropen(&buf, "r");
+  struct cjson *node = cjson_root_fscan(stream, CJSON_ALL_E, 0, NULL);
+
+  fail_unless(cjson_array_length(node) == 1);
+  fail_unless(fgetc(stream) == 'n');
+
+  fclose(stream);
+  cjson_free(node);
+#undef IN
+}
+END_TEST
+
+START_TEST(fscan_pipe)
+{
+#define IN "[true]\nnull\n"
+  int fds[2];
+  fail_unless(pipe(fds) == 0);
+  fail_unless(write(fds[1], IN, sizeof(IN) - 1) == sizeof(IN) - 1);
+  close(fds[1]);
+
+  FILE *stream = fdopen(fds[0], "r");
+  struct cjson *node = cjson_root_fscan(stream, CJSON_ALL_E, 1, NULL);
+
+  fail_unless(cjson_array_length(node) == 2);
+  fail_unless(cjson_array_get(node, 1)->type == CJSON_NULL);
+
+  fclose(stream);
+  cjson_free(node);
+#undef IN
+}
+END_TEST
+
+START_TEST(parse_file)
+{
+#define IN "[true]\n{\"a\": null}\n"
+#define EXP "[\n" \
+            "  true\n" \
+            "]\n" \
+            "{\n" \
+            "  \"a\": null\n" \
+            "}"
+  char path[] = "/tmp/cjson-check-XXXXXX";
+  int fd = mkstemp(path);
+  fail_unless(fd >= 0);
+  fail_unless(write(fd, IN, sizeof(IN) - 1) == sizeof(IN) - 1);
+  close(fd);
+
+  char *buf = NULL;
+  FILE *stream = ecx_ccstreams_fstropen(&buf, "w+");
+
+  struct cjson *node = cjson_root_parse_file(path, CJSON_ALL_E, 1, NULL);
+  unlink(path);
+
+  cjson_root_fprint(stream, node);
+  fclose(stream);
+
+  const char fmt[] = "Failed to print root to stream. Got:\n%s\nExp:\n%s";
+  fail_unless(strcmp(buf, EXP) == 0, fmt, buf, EXP);
+
+  cjson_free(node);
+  free(buf);
+#undef EXP
+#undef IN
+}
+END_TEST
+
+static
+void *
+write_fifo(void *path)
+{
+  FILE *stream = fopen(path, "w");
+  fputs("[true]\n{\"a\": null}\n", stream);
+  fclose(stream);
+  return NULL;
+}
+
+START_TEST(parse_file_fifo)
+{
+  /* A pipe reports no size, but its contents are still parsed. */
+  char dir[] = "/tmp/cjson-check-XXXXXX";
+  fail_unless(mkdtemp(dir) != NULL);
+  char path[sizeof(dir) + 5];
+  sprintf(path, "%s/fifo", dir);
+  fail_unless(mkfifo(path, 0600) == 0);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, write_fifo, path);
+
+  struct cjson *node = cjson_root_parse_file(path, CJSON_ALL_E, 1, NULL);
+  pthread_join(thread, NULL);
+  unlink(path);
+  rmdir(dir);
+
+  fail_unless(cjson_array_length(node) == 2);
+  fail_unless(cjson_array_get(node, 0)->type == CJSON_ARRAY);
+  fail_unless(cjson_array_get(node, 1)->type == CJSON_OBJECT);
+
+  cjson_free(node);
+}
+END_TEST
+
+START_TEST(parse_windows)
+{
+  /* Whitespace and strings that cross the windows of the structural index. */
+  size_t length = 0;
+  char *in = malloc(4 * 65536);
+  for (int i = 0; length < 3 * 65536; i++) {
+    length += sprintf(in + length, "{\"a\\\\\": [%d, \"%*s\\\"\", \"%*s\"], \"b\": true}%*s\n", i, i % 97, "x", i % 89, "y", i % 61, "");
+  }
+
+  char *exp = NULL;
+  FILE *stream = ecx_ccstreams_fstropen(&exp, "w+");
+  FILE *source = fmemopen(in, length, "r");
+  struct cjson *node = cjson_root_fscan(source, CJSON_ALL_E, 1, NULL);
+  fclose(source);
+  cjson_root_fprint(stream, node);
+  fclose(stream);
+  cjson_free(node);
+
+  char *buf = NULL;
+  stream = ecx_ccstreams_fstropen(&buf, "w+");
+  node = cjson_root_parse(in, length, CJSON_ALL_E, 1, NULL);
+  cjson_root_fprint(stream, node);
+  fclose(stream);
+  cjson_free(node);
+
+  fail_unless(strcmp(buf, exp) == 0, "Failed to parse the same items from memory and a stream.");
+
+  free(buf);
+  free(exp);
+  free(in);
+}
+END_TEST
+
+START_TEST(iter_parse)
+{
+#define IN "{\"a\": 1}\n[2]\r\n\x1e\"c\"\n\x1e" "4\n true  null\t\x1e\x1e{}"
+  const enum cjson_type exp[] = {CJSON_OBJECT, CJSON_ARRAY, CJSON_STRING, CJSON_NUMBER, CJSON_BOOLEAN, CJSON_NULL, CJSON_OBJECT};
+  struct cjson_root_iter *iter = cjson_root_iter_parse(IN, strlen(IN), CJSON_ALL_E, NULL);
+
+  size_t count = 0;
+  struct cjson *node = NULL;
+  while ((node = cjson_root_iter_next(iter)) != NULL) {
+    fail_unless(count < sizeof(exp) / sizeof(exp[0]), "Found too many documents.");
+    fail_unless(node->parent == NULL);
+
+    const char fmt[] = "Failed to iterate over document %zu. Got: 0x%2x Exp: 0x%2x";
+    fail_unless(node->type == exp[count], fmt, count, node->type, exp[count]);
+
+    cjson_free(node);
+    count++;
+  }
+
+  fail_unless(count == sizeof(exp) / sizeof(exp[0]), "Found %zu documents.", count);
+
+  cjson_root_iter_free(iter);
+#undef IN
+}
+END_TEST
+
+START_TEST(iter_fscan)
+{
+  /* More documents than fit in a single read from the stream. */
+  size_t length = 0;
+  char *in = malloc(65536);
+  for (int i = 0; length < 60000; i++) {
+    length += sprintf(in + length, "\x1e{\"i\": %d, \"s\": \"%*s\"}\n", i, i % 37, "x");
+  }
+
+  FILE *source = fmemopen(in, length, "r");
+  struct cjson_root_iter *iter = cjson_root_iter_fscan(source, CJSON_OBJECT, NULL);
+
+  int64_t count = 0;
+  struct cjson *node = NULL;
+  while ((node = cjson_root_iter_next(iter)) != NULL) {
+    int64_t i = cjson_number_get_int64(cjson_get(node, "i\0"));
+    fail_unless(i == count, "Failed to iterate in order. Got: %" PRId64 " Exp: %" PRId64, i, count);
+
+    cjson_free(node);
+    count++;
+  }
+
+  fail_unless(count > 1000);
+
+  cjson_root_iter_free(iter);
+  fclose(source);
+  free(in);
+}
+END_TEST
+
+START_TEST(iter_invalid)
+{
+  const char *in[] = {"{}{}", "[1] x", "[1, 2", "1\n\"s\""};
+
+  for (size_t i = 0; i < sizeof(in) / sizeof(in[0]); i++) {
+    const char * volatile msg = NULL;
+    struct cjson_root_iter *iter = cjson_root_iter_parse(in[i], strlen(in[i]), CJSON_ALL_S | CJSON_NUMBER, NULL);
+
+    ec_try {
+      struct cjson *node = NULL;
+      while ((node = cjson_root_iter_next(iter)) != NULL) {
+        cjson_free(node);
+      }
+    } ec_catch_a(CJSONX_PARSE, msg) {
+    } ec_catch {
+    }
+
+    fail_unless(msg != NULL, "Iterated over invalid input: %s", in[i]);
+    cjson_root_iter_free(iter);
+  }
+}
+END_TEST
+
+START_TEST(parse_parallel)
+{
+  /* Strings with brackets, commas and escaped quotes cross the chunks. */
+  const char *open[] = {"[", " {"};
+  const char *close[] = {"]\n", "} "};
+
+  for (size_t k = 0; k < 2; k++) {
+    char *in = malloc(8 * 1024 * 1024);
+    size_t length = sprintf(in, "%s", open[k]);
+    for (int i = 0; length < 6 * 1024 * 1024; i++) {
+      if (i != 0) {
+        length += sprintf(in + length, ",\n");
+      }
+      if (k == 1) {
+        length += sprintf(in + length, "\"k%d\": ", i);
+      }
+      length += sprintf(in + length, "{\"a\": [%d, \"]},[\\\"%*s\\\\\"], \"b\": {\"c\": [[], {}, null, true, -1.5e3]}}", i, i % 53, "x");
+    }
+    length += sprintf(in + length, "%s", close[k]);
+
+    char *exp = NULL;
+    FILE *stream = ecx_ccstreams_fstropen(&exp, "w+");
+    struct cjson *node = cjson_root_parse(in, length, CJSON_ALL_S, 0, NULL);
+    cjson_root_fprint(stream, node);
+    fclose(stream);
+    cjson_free(node);
+
+    char *buf = NULL;
+    stream = ecx_ccstreams_fstropen(&buf, "w+");
+    node = cjson_root_parse_parallel(in, length, CJSON_ALL_S, 4, NULL);
+    cjson_root_fprint(stream, node);
+    fclose(stream);
+    cjson_free(node);
+
+    fail_unless(strcmp(buf, exp) == 0, "Failed to parse the same document in parallel.");
+
+    free(buf);
+    free(exp);
+    free(in);
+  }
+}
+END_TEST
+
+START_TEST(parse_parallel_invalid)
+{
+  /* Each is a large array (or object) with one error far from the start. */
+  const char *error[] = {"1,,2", "1 2", "1]", "[1", "\"k0\": 1", "{\"a\": 1}, x"};
+  const size_t object[] = {0, 0, 0, 0, 1, 0};
+
+  for (size_t k = 0; k < sizeof(error) / sizeof(error[0]); k++) {
+    const char * volatile msg = NULL;
+    char *in = malloc(4 * 1024 * 1024);
+    size_t length = sprintf(in, "%s", object[k] ? "{" : "[");
+    for (int i = 0; length < 3 * 1024 * 1024; i++) {
+      if (i == 20000) {
+        length += sprintf(in + length, "%s,", error[k]);
+      }
+      if (object[k]) {
+        length += sprintf(in + length, "\"k%d\": ", i);
+      }
+      length += sprintf(in + length, "{\"a\": [%d, \"%*s\"]},\n", i, i % 53, "x");
+    }
+    length += sprintf(in + length, "%s", object[k] ? "\"end\": 0}" : "0]");
+
+    ec_try {
+      struct cjson *node = cjson_root_parse_parallel(in, length, CJSON_ALL_S, 4, NULL);
+      cjson_free(node);
+    } ec_catch_a(CJSONX_PARSE, msg) {
+    } ec_catch {
+    }
+
+    fail_unless(msg != NULL, "Parsed invalid document %zu in parallel.", k);
+    free(in);
+  }
+}
+END_TEST
+
+START_TEST(parse_project)
+{
+  const char *in =
+    "{\"id\": 1, \"wide\": {\"x\": [1, 2]}, \"a\": [{\"b\": 1, \"c\": 2}, {\"b\": \"\\u0031\"}, 3], \"s\": \"v\"}\n"
+    "{\"id\": 2, \"a\": {\"1\": {\"b\": true}}}\n"
+    "[{\"id\": 3}, {\"id\": 4}]\n"
+    "\"bare\"\n";
+  const char *paths[] = {"id\0", "a\0" "1\0" "b\0", "s\0", "1\0"};
+  const char *exp[] = {
+    "{\"a\": [null, {\"b\": \"1\"}], \"id\": 1, \"s\": \"v\"}",
+    "{\"a\": {\"1\": {\"b\": true}}, \"id\": 2}",
+    "[null, {\"id\": 4}]",
+    "\"bare\"",
+  };
+
+  struct cjson *node = cjson_root_parse_project(in, strlen(in), CJSON_ALL_E, 1, paths, 4, NULL);
+  fail_unless(cjson_array_length(node) == 4);
+
+  for (size_t i = 0; i < 4; i++) {
+    char *buf = NULL;
+    FILE *stream = ecx_ccstreams_fstropen(&buf, "w+");
+    cjson_fprint(stream, cjson_array_get(node, i));
+    fclose(stream);
+
+    /* Compare without the layout. */
+    size_t k = 0;
+    for (size_t j = 0; buf[j] != '\0'; j++) {
+      if (buf[j] != ' ' && buf[j] != '\n') {
+        buf[k++] = buf[j];
+      }
+    }
+    buf[k] = '\0';
+
+    char *want = strdup(exp[i]);
+    k = 0;
+    for (size_t j = 0; want[j] != '\0'; j++) {
+      if (want[j] != ' ') {
+        want[k++] = want[j];
+      }
+    }
+    want[k] = '\0';
+
+    fail_unless(strcmp(buf, want) == 0, "Document %zu. Got: %s Exp: %s", i, buf, want);
+    free(want);
+    free(buf);
+  }
+
+  fail_unless(cjson_get(node, "0\0" "a\0" "1\0" "b\0")->type == CJSON_STRING);
+  fail_unless(cjson_get(node, "0\0" "wide\0") == NULL);
+
+  cjson_free(node);
+}
+END_TEST
+
+START_TEST(parse_project_invalid)
+{
+  /* The errors are all in values that are skipped. */
+  const char *error[] = {
+    "{\"id\": 1, \"x\": [1,, 2]}",
+    "{\"id\": 1, \"x\": {\"y\" 2}}",
+    "{\"id\": 1, \"x\": \"\\q\"}",
+    "{\"id\": 1, \"x\": tru}",
+    "{\"id\": 1, \"x\": [1}",
+    "{\"id\": 1, \"x\": 1,}",
+    "{\"id\": 1, \"x\": -}",
+  };
+  const char *paths[] = {"id\0"};
+
+  for (size_t k = 0; k < sizeof(error) / sizeof(error[0]); k++) {
+    const char * volatile msg = NULL;
+
+    ec_try {
+      struct cjson *node = cjson_root_parse_project(error[k], strlen(error[k]), CJSON_ALL_S, 0, paths, 1, NULL);
+      cjson_free(node);
+    } ec_catch_a(CJSONX_PARSE, msg) {
+    } ec_catch {
+    }
+
+    fail_unless(msg != NULL, "Parsed invalid document %zu.", k);
+  }
+}
+END_TEST
+
+START_TEST(fscan_project)
+{
+  const char *in = "{\"a\": {\"b\": [1, 2], \"c\": 3}, \"d\": 4}";
+  const char *paths[] = {"a\0" "b\0", ""};
+
+  /* An empty path selects the whole document. */
+  for (size_t count = 1; count <= 2; count++) {
+    FILE *stream = fmemopen((void *)in, strlen(in), "r");
+    struct cjson *node = cjson_root_fscan_project(stream, CJSON_ALL_S, 0, paths, count, NULL);
+
+    fail_unless(cjson_array_length(cjson_get(node, "0\0" "a\0" "b\0")) == 2);
+    fail_unless((cjson_get(node, "0\0" "d\0") != NULL) == (count == 2));
+    fail_unless((cjson_get(node, "0\0" "a\0" "c\0") != NULL) == (count == 2));
+
+    cjson_free(node);
+    fclose(stream);
+  }
+}
+END_TEST
+
+START_TEST(try_parse)
+{
+#define IN "\n0\n[0,\n\"\"]\n[[0, \"\", true, null]]\n{\"a\": [false], \"b\": {\"c\": \"\\u00e9\"}}"
+  struct cjson_error error;
+  struct cjson *exp = cjson_root_parse(IN, sizeof(IN) - 1, CJSON_ALL_E, 1, NULL);
+  struct cjson *node = cjson_root_try_parse(IN, sizeof(IN) - 1, CJSON_ALL_E, 1, NULL, &error);
+
+  fail_unless(node != NULL);
+  fail_unless(error.code == CJSON_ERROR_NONE);
+
+  char *got_buf = NULL;
+  FILE *got_stream = ecx_ccstreams_fstropen(&got_buf, "w+");
+  cjson_root_fprint(got_stream, node);
+  fclose(got_stream);
+
+  char *exp_buf = NULL;
+  FILE *exp_stream = ecx_ccstreams_fstropen(&exp_buf, "w+");
+  cjson_root_fprint(exp_stream, exp);
+  fclose(exp_stream);
+
+  const char fmt[] = "Failed to build the same root. Got:\n%s\nExp:\n%s";
+  fail_unless(strcmp(got_buf, exp_buf) == 0, fmt, got_buf, exp_buf);
+
+  cjson_free(exp);
+  cjson_free(node);
+  free(exp_buf);
+  free(got_buf);
+#undef IN
+}
+END_TEST
+
+START_TEST(try_parse_invalid)
+{
+  struct {
+    const char *in;
+    enum cjson_error_code code;
+    long offset;
+    long line;
+    long column;
+    unsigned int expected;
+  } error[] = {
+    {"[0,]", CJSON_ERROR_SYNTAX, 4, 1, 4, CJSON_EXPECT_VALUE},
+    {"{\"a\" 1}", CJSON_ERROR_SYNTAX, 6, 1, 6, CJSON_EXPECT_COLON},
+    {"{\"a\": 1,}", CJSON_ERROR_SYNTAX, 9, 1, 9, CJSON_EXPECT_KEY},
+    {"[0,\n 1", CJSON_ERROR_TRUNCATED, 6, 2, 2, CJSON_EXPECT_COMMA | CJSON_EXPECT_ARRAY_END},
+    {"[\"a", CJSON_ERROR_TRUNCATED, 3, 1, 3, 0},
+    {"[\"\\q\"]", CJSON_ERROR_ENCODING, 4, 1, 4, 0},
+    {"[\"\xff\"]", CJSON_ERROR_ENCODING, 3, 1, 3, 0},
+    {"{\"a\": 1,\n \"a\": 2}", CJSON_ERROR_DUPLICATE, 13, 2, 4, 0},
+    {"1", CJSON_ERROR_TYPE, 1, 1, 1, CJSON_EXPECT_VALUE},
+    {"[1] 2", CJSON_ERROR_SYNTAX, 5, 1, 5, CJSON_EXPECT_END},
+  };
+
+  for (size_t k = 0; k < sizeof(error) / sizeof(error[0]); k++) {
+    struct cjson_error e;
+    struct cjson *node = cjson_root_try_parse(error[k].in, strlen(error[k].in), CJSON_ALL_S, 0, NULL, &e);
+
+    fail_unless(node == NULL, "Parsed invalid document %zu.", k);
+    fail_unless(e.code == error[k].code, "Document %zu. Got code: %d Exp: %d", k, e.code, error[k].code);
+    fail_unless(e.offset == error[k].offset, "Document %zu. Got offset: %ld Exp: %ld", k, e.offset, error[k].offset);
+    fail_unless(e.line == error[k].line, "Document %zu. Got line: %ld Exp: %ld", k, e.line, error[k].line);
+    fail_unless(e.column == error[k].column, "Document %zu. Got column: %ld Exp: %ld", k, e.column, error[k].column);
+    fail_unless(e.expected == error[k].expected, "Document %zu. Got expected: %x Exp: %x", k, e.expected, error[k].expected);
+    fail_unless(e.reason != NULL);
+  }
+}
+END_TEST
+
+START_TEST(try_fscan)
+{
+#define IN "[true]\n{\"a\": [1,\n 2}"
+  char *buf = IN;
+  FILE *stream = ecx_ccstreams_fstropen(&buf, "r");
+  struct cjson_error error;
+  struct cjson *node = cjson_root_try_fscan(stream, CJSON_ALL_S, 1, NULL, &error);
+
+  fail_unless(node == NULL);
+  fail_unless(error.code == CJSON_ERROR_SYNTAX);
+  fail_unless(error.offset == 20);
+  fail_unless(error.line == 0);
+  fail_unless(error.expected == (CJSON_EXPECT_COMMA | CJSON_EXPECT_ARRAY_END));
+
+  char msg[256];
+  const char exp[] = "Invalid character at 20: 7d '}': Expecting to find a JSON type to parse. Expecting ',' or ']'.";
+  int length = cjson_error_format(&error, msg, sizeof(msg));
+  fail_unless(strcmp(msg, exp) == 0, "Got: %s Exp: %s", msg, exp);
+  fail_unless(length == sizeof(exp) - 1);
+
+  /* The message is truncated to fit. */
+  fail_unless(cjson_error_format(&error, msg, 8) == length);
+  fail_unless(strcmp(msg, "Invalid") == 0);
+
+  fclose(stream);
+#undef IN
+}
+END_TEST
+
+START_TEST(parse_deep)
+{
+  const size_t depth = 10000;
+  char *in = ecx_malloc(depth * 2);
+  memset(in, '[', depth);
+  memset(in + depth, ']', depth);
+
+  /* Deeper than CJSON_MAX_DEPTH only with a hook that allows it. */
+  const char * volatile msg = NULL;
+  ec_try {
+    cjson_free(cjson_root_parse(in, depth * 2, CJSON_ALL_S, 0, NULL));
+  } ec_catch_a(CJSONX_PARSE, msg) {
+  } ec_catch {
+  }
+  fail_unless(msg != NULL);
+
+  struct cjson_hook hook = {.max_depth = depth};
+  struct cjson *node = cjson_root_parse(in, depth * 2, CJSON_ALL_S, 0, &hook);
+  fail_unless(cjson_array_length(node) == 1);
+
+  struct cjson *child = cjson_array_get(node, 0);
+  for (size_t i = 1; i < depth; i++) {
+    fail_unless(cjson_array_length(child) == 1);
+    child = cjson_array_get(child, 0);
+  }
+  fail_unless(cjson_array_length(child) == 0);
+
+  cjson_free(node);
+  free(in);
+}
+END_TEST
+
+START_TEST(parse_max_depth)
+{
+#define IN "{\"a\": [[1]]}"
+#define DEEP "{\"a\": [[[1]]]}"
+  struct cjson_hook hook = {.max_depth = 3};
+  struct cjson *node = cjson_root_parse(IN, sizeof(IN) - 1, CJSON_ALL_S, 0, &hook);
+  fail_unless(cjson_array_length(node) == 1);
+  cjson_free(node);
+
+  const char * volatile msg = NULL;
+  ec_try {
+    node = cjson_root_parse(DEEP, sizeof(DEEP) - 1, CJSON_ALL_S, 0, &hook);
+    cjson_free(node);
+  } ec_catch_a(CJSONX_PARSE, msg) {
+  } ec_catch {
+  }
+  fail_unless(msg != NULL);
+
+  struct cjson_error error;
+  node = cjson_root_try_parse(DEEP, sizeof(DEEP) - 1, CJSON_ALL_S, 0, &hook, &error);
+  fail_unless(node == NULL);
+  fail_unless(error.code == CJSON_ERROR_DEPTH);
+  fail_unless(error.offset == 9);
+#undef DEEP
+#undef IN
+}
+END_TEST
+
+START_TEST(parse_max_depth_paths)
+{
+  /* The recursive parsers have the same limit as the builder. */
+  const size_t depth = CJSON_MAX_DEPTH + 1;
+  char *in = ecx_malloc(depth * 2);
+  memset(in, '[', depth);
+  memset(in + depth, ']', depth);
+
+  struct cjson *node = cjson_array_parse(in + 1, (depth - 1) * 2, NULL);
+  cjson_free(node);
+
+  const char * volatile msg = NULL;
+  ec_try {
+    cjson_free(cjson_array_parse(in, depth * 2, NULL));
+  } ec_catch_a(CJSONX_PARSE, msg) {
+  } ec_catch {
+  }
+  fail_unless(msg != NULL);
+
+  struct cjson_root_iter *iter = cjson_root_iter_parse(in, depth * 2, CJSON_ALL_S, NULL);
+  msg = NULL;
+  ec_try {
+    cjson_free(cjson_root_iter_next(iter));
+  } ec_catch_a(CJSONX_PARSE, msg) {
+  } ec_catch {
+  }
+  fail_unless(msg != NULL);
+  cjson_root_iter_free(iter);
+
+  struct cjson_od_doc *doc = cjson_od_doc_new(in, depth * 2);
+  struct cjson_od root = cjson_od_root(doc);
+  msg = NULL;
+  ec_try {
+    cjson_free(cjson_od_get_node(&root, NULL));
+  } ec_catch_a(CJSONX_PARSE, msg) {
+  } ec_catch {
+  }
+  fail_unless(msg != NULL);
+  cjson_od_doc_free(doc);
+
+  /* Values that a projection skips are bounded too. */
+  char *skip = ecx_malloc(depth * 2 + 7);
+  memcpy(skip, "{\"y\": ", 6);
+  memcpy(skip + 6, in, depth * 2);
+  skip[depth * 2 + 6] = '}';
+  const char *paths[] = {"x\0"};
+  msg = NULL;
+  ec_try {
+    cjson_free(cjson_root_parse_project(skip, depth * 2 + 7, CJSON_ALL_S, 0, paths, 1, NULL));
+  } ec_catch_a(CJSONX_PARSE, msg) {
+  } ec_catch {
+  }
+  fail_unless(msg != NULL);
+
+  /* The hook of the parent sets the limit. */
+  struct cjson_hook hook = {.max_depth = 2};
+  struct cjson *parent = cjson_root_parse("", 0, CJSON_ALL_S, 1, &hook);
+  msg = NULL;
+  ec_try {
+    cjson_free(cjson_array_parse("[[[]]]", 6, parent));
+  } ec_catch_a(CJSONX_PARSE, msg) {
+  } ec_catch {
+  }
+  fail_unless(msg != NULL);
+  cjson_free(parent);
+
+  free(skip);
+  free(in);
+}
+END_TEST
+
+/* An allocator that counts the allocations it has outstanding. */
+static
+void *
+count_malloc(void *context, size_t size)
+{
+  (*(size_t *)context)++;
+  return malloc(size);
+}
+
+static
+void *
+count_realloc(void *context, void *p, size_t size)
+{
+  if (p == NULL) {
+    (*(size_t *)context)++;
+  }
+  return realloc(p, size);
+}
+
+static
+void
+count_free(void *context, void *p)
+{
+  (*(size_t *)context)--;
+  free(p);
+}
+
+START_TEST(parse_allocator)
+{
+#define IN "{\"a\": [1, \"b\", {\"c\": null}], \"d\": \"e\"}\n[\"f\"]"
+  size_t outstanding = 0;
+  struct cjson_allocator allocator = {count_malloc, count_realloc, count_free, &outstanding};
+  struct cjson_hook hook = {.allocator = &allocator};
+
+  struct cjson *node = cjson_root_parse(IN, sizeof(IN) - 1, CJSON_ALL_S, 1, &hook);
+  fail_unless(cjson_array_length(node) == 2);
+  fail_unless(outstanding > 0);
+
+  /* New nodes use the allocator of their parent. */
+  struct cjson *number = cjson_number_from_int64(1, cjson_array_get(node, 1));
+  cjson_array_append(cjson_array_get(node, 1), number);
+
+  cjson_free(node);
+  fail_unless(outstanding == 0, "Outstanding: %zu", outstanding);
+
+  struct cjson_error error;
+  node = cjson_root_try_parse(IN "x", sizeof(IN), CJSON_ALL_S, 1, &hook, &error);
+  fail_unless(node == NULL);
+  fail_unless(outstanding == 0, "Outstanding: %zu", outstanding);
+#undef IN
+}
+END_TEST
+
+/* Node hooks that count the nodes they have outstanding. */
+static size_t mixed_nodes;
+
+static
+struct cjson *
+mixed_malloc(enum cjson_type type, struct cjson *parent)
+{
+  mixed_nodes++;
+  return ecx_malloc(sizeof(struct cjson));
+}
+
+static
+void
+mixed_free(struct cjson *self)
+{
+  mixed_nodes--;
+  free(self);
+}
+
+START_TEST(parse_allocator_mixed)
+{
+#define IN "{\"a\": [1, \"b\", {\"c\": null}], \"d\": \"e\"}"
+  size_t outstanding = 0;
+  struct cjson_allocator allocator = {count_malloc, count_realloc, count_free, &outstanding};
+
+  /* The nodes are from cjson_malloc (and released with free), the rest is
+   * from the allocator.
+   */
+  struct cjson_hook hook = {.cjson_malloc = mixed_malloc, .allocator = &allocator};
+  mixed_nodes = 0;
+  struct cjson *node = cjson_root_parse(IN, sizeof(IN) - 1, CJSON_ALL_S, 0, &hook);
+  fail_unless(mixed_nodes > 0);
+  fail_unless(outstanding > 0);
+  cjson_free(node);
+  fail_unless(outstanding == 0, "Outstanding: %zu", outstanding);
+
+  /* The nodes are from the allocator, so cjson_free isn't called for them. */
+  hook = (struct cjson_hook){.cjson_free = mixed_free, .allocator = &allocator};
+  mixed_nodes = 0;
+  node = cjson_root_parse(IN, sizeof(IN) - 1, CJSON_ALL_S, 0, &hook);
+  fail_unless(outstanding > 0);
+  cjson_free(node);
+  fail_unless(outstanding == 0, "Outstanding: %zu", outstanding);
+  fail_unless(mixed_nodes == 0, "Nodes: %zu", mixed_nodes);
+
+  /* Nodes allocated by the caller are released with free. */
+  node = ecx_malloc(sizeof(*node));
+  cjson_init(node, CJSON_NULL, NULL);
+  cjson_free(node);
+#undef IN
+}
+END_TEST
+
+static
+void *
+free_thread(void *node)
+{
+  cjson_free(node);
+  return NULL;
+}
+
+START_TEST(free_threads)
+{
+  /* Enough nodes to move batches through the shared pool. */
+  const size_t count = 2000;
+  char *in = ecx_malloc(count * 4 + 2);
+  size_t length = 0;
+  in[length++] = '[';
+  for (size_t i = 0; i < count; i++) {
+    length += sprintf(in + length, "%s[%zu]", i == 0 ? "" : ",", i % 10);
+  }
+  in[length++] = ']';
+
+  for (size_t k = 0; k < 3; k++) {
+    struct cjson *node = cjson_root_parse(in, length, CJSON_ALL_S, 0, NULL);
+    fail_unless(cjson_array_length(cjson_array_get(node, 0)) == count);
+
+    /* Nodes freed on another thread are reused here. */
+    pthread_t thread;
+    fail_unless(pthread_create(&thread, NULL, free_thread, node) == 0);
+    fail_unless(pthread_join(thread, NULL) == 0);
+  }
+
+  struct cjson *node = cjson_root_parse(in, length, CJSON_ALL_S, 0, NULL);
+  struct cjson *array = cjson_array_get(node, 0);
+  for (size_t i = 0; i < count; i += 97) {
+    fail_unless(cjson_number_get_uint64(cjson_array_get(cjson_array_get(array, i), 0)) == i % 10);
+  }
+  cjson_free(node);
+
+  free(in);
+}
+END_TEST
+
+static
+void *
+parse_thread(void *in)
+{
+  /* Enough freed nodes for the thread to trim the pools as it finishes. */
+  for (size_t k = 0; k < 2; k++) {
+    struct cjson *node = cjson_root_parse(in, strlen(in), CJSON_ALL_S, 0, NULL);
+    cjson_free(node);
+  }
+  return NULL;
+}
+
+START_TEST(slab_trim)
+{
+  const size_t count = 20000;
+  char *in = ecx_malloc(count * 8 + 2);
+  size_t length = 0;
+  in[length++] = '[';
+  for (size_t i = 0; i < count; i++) {
+    length += sprintf(in + length, "%s[%zu]", i == 0 ? "" : ",", i % 10);
+  }
+  in[length++] = ']';
+  in[length] = '\0';
+
+  for (size_t k = 0; k < 3; k++) {
+    /* Some nodes stay allocated across the trim. */
+    struct cjson *kept = cjson_root_parse(in, length, CJSON_ALL_S, 0, NULL);
+    struct cjson *node = cjson_root_parse(in, length, CJSON_ALL_S, 0, NULL);
+    cjson_free(node);
+    cjson_slab_trim();
+
+    pthread_t thread;
+    fail_unless(pthread_create(&thread, NULL, parse_thread, in) == 0);
+    fail_unless(pthread_join(thread, NULL) == 0);
+
+    node = cjson_root_parse(in, length, CJSON_ALL_S, 0, NULL);
+    struct cjson *array = cjson_array_get(kept, 0);
+    for (size_t i = 0; i < count; i += 97) {
+      fail_unless(cjson_number_get_uint64(cjson_array_get(cjson_array_get(array, i), 0)) == i % 10);
+    }
+    cjson_free(kept);
+    cjson_free(node);
+  }
+  cjson_slab_trim();
+
+  free(in);
+}
+END_TEST
+
+START_TEST(parse_inline)
+{
+  /* Keys, strings and numbers on both sides of the inline limit. */
+  size_t outstanding = 0;
+  struct cjson_allocator allocator = {count_malloc, count_realloc, count_free, &outstanding};
+  struct cjson_hook hook = {.allocator = &allocator};
+  struct cjson_hook *hooks[] = {NULL, &hook};
+
+  for (size_t h = 0; h < sizeof(hooks) / sizeof(hooks[0]); h++) {
+    for (size_t n = 1; n < 40; n++) {
+      char text[40] = {0}, digits[40] = {0}, in[160];
+      memset(text, 'a', n);
+      memset(digits, '1', n);
+      int length = snprintf(in, sizeof(in), "{\"%s\": [\"%s\", %s, \"\"]}", text, text, digits);
+
+      struct cjson *node = cjson_root_parse(in, length, CJSON_ALL_S, 0, hooks[h]);
+      struct cjson *array = cjson_object_get(cjson_array_get(node, 0), text);
+      fail_unless(array != NULL, "Missing key: %s", text);
+      array = array->value.pair.value;
+
+      struct cjson *string = cjson_array_get(array, 0);
+      fail_unless(string->value.string.length == n);
+      fail_unless(memcmp(string->value.string.bytes, text, n) == 0);
+      fail_unless(strcmp(cjson_array_get(array, 1)->value.number, digits) == 0);
+      fail_unless(cjson_array_get(array, 2)->value.string.length == 0);
+
+      cjson_free(node);
+    }
+  }
+
+  fail_unless(outstanding == 0, "Outstanding: %zu", outstanding);
+}
+END_TEST
+
+START_TEST(parse_intern)
+{
+#define IN "{\"status\": \"ok\", \"message\": \"a longer message\"}"
+  struct cjson_intern *intern = cjson_intern_new(8, NULL);
+  struct cjson_hook hook = {.intern = intern};
+
+  /* Two documents (e.g. records of a stream) share the table. */
+  struct cjson *nodes[2];
+  for (size_t i = 0; i < 2; i++) {
+    nodes[i] = cjson_root_parse(IN, sizeof(IN) - 1, CJSON_ALL_S, 0, &hook);
+  }
+
+  const char *status = cjson_intern_find(intern, "status");
+  const char *ok = cjson_intern_find(intern, "ok");
+  fail_unless(status != NULL);
+  fail_unless(ok != NULL);
+  fail_unless(cjson_intern_find(intern, "a longer message") == NULL);
+
+  struct cjson *messages[2];
+  for (size_t i = 0; i < 2; i++) {
+    struct cjson *object = cjson_array_get(nodes[i], 0);
+    struct cjson *pair = cjson_object_get(object, "status");
+    fail_unless(pair->value.pair.key == status);
+    fail_unless(pair->value.pair.value->value.string.bytes == ok);
+    fail_unless(pair->value.pair.value->value.string.length == 2);
+
+    messages[i] = cjson_object_get(object, "message")->value.pair.value;
+  }
+  fail_unless(messages[0]->value.string.bytes != messages[1]->value.string.bytes);
+
+  /* The strings are released with the last node using them. */
+  cjson_free(nodes[0]);
+  fail_unless(cjson_intern_find(intern, "status") == status);
+
+  struct cjson *pair = cjson_object_get(cjson_array_get(nodes[1], 0), "status");
+  cjson_free(cjson_object_remove(cjson_array_get(nodes[1], 0), pair));
+  fail_unless(cjson_intern_find(intern, "status") == NULL);
+  fail_unless(cjson_intern_find(intern, "ok") == NULL);
+  fail_unless(cjson_intern_find(intern, "message") != NULL);
+
+  /* The table outlives its owner while nodes use it. */
+  cjson_intern_free(intern);
+  cjson_free(nodes[1]);
+#undef IN
+}
+END_TEST
+
+/* An allocator that fails while its context is set (and otherwise uses the
+ * heap).
+ */
+static
+void *
+failing_malloc(void *context, size_t size)
+{
+  return *(int *)context ? NULL : malloc(size);
+}
+
+static
+void *
+failing_realloc(void *context, void *p, size_t size)
+{
+  return *(int *)context ? NULL : realloc(p, size);
+}
+
+static
+void
+failing_free(void *context, void *p)
+{
+  free(p);
+}
+
+static
+void *
+intern_thread(void *hook)
+{
+  const char *in = "[{\"status\": \"ok\", \"a\": \"b\"}, {\"status\": \"no\", \"c\": \"a\"}]";
+  for (size_t k = 0; k < 200; k++) {
+    cjson_free(cjson_root_parse(in, strlen(in), CJSON_ALL_S, 0, hook));
+  }
+  return NULL;
+}
+
+START_TEST(parse_intern_allocator)
+{
+  /* Threads share the table. */
+  struct cjson_intern *intern = cjson_intern_new(8, NULL);
+  struct cjson_hook hook = {.intern = intern};
+  pthread_t threads[4];
+  for (size_t i = 0; i < 4; i++) {
+    fail_unless(pthread_create(&threads[i], NULL, intern_thread, &hook) == 0);
+  }
+  for (size_t i = 0; i < 4; i++) {
+    fail_unless(pthread_join(threads[i], NULL) == 0);
+  }
+  fail_unless(cjson_intern_find(intern, "status") == NULL);
+  cjson_intern_free(intern);
+
+  /* The table and its copies are allocated with its allocator. */
+  size_t outstanding = 0;
+  struct cjson_allocator allocator = {count_malloc, count_realloc, count_free, &outstanding};
+  intern = cjson_intern_new(8, &allocator);
+  hook.intern = intern;
+  fail_unless(outstanding == 1);
+
+  intern_thread(&hook);
+  fail_unless(outstanding == 1, "Outstanding: %zu", outstanding);
+  struct cjson *node = cjson_root_parse("{\"a\": 1}", 8, CJSON_ALL_S, 0, &hook);
+  fail_unless(outstanding == 2, "Outstanding: %zu", outstanding);
+  cjson_intern_free(intern);
+  cjson_free(node);
+  fail_unless(outstanding == 0, "Outstanding: %zu", outstanding);
+
+  /* A copy that can't be allocated leaves the table usable. */
+  int fail = 0;
+  struct cjson_allocator failing = {failing_malloc, failing_realloc, failing_free, &fail};
+  intern = cjson_intern_new(8, &failing);
+  hook.intern = intern;
+
+  fail = 1;
+  const char * volatile msg = NULL;
+  ec_try {
+    cjson_free(cjson_root_parse("{\"a\": 1}", 8, CJSON_ALL_S, 0, &hook));
+  } ec_catch_a(ECX_EC, msg) {
+  } ec_catch {
+  }
+  fail_unless(msg != NULL);
+
+  fail = 0;
+  node = cjson_root_parse("{\"a\": 1}", 8, CJSON_ALL_S, 0, &hook);
+  fail_unless(cjson_intern_find(intern, "a") != NULL);
+  cjson_free(node);
+  cjson_intern_free(intern);
+}
+END_TEST
+
 static
 Suite *
 suite(void)
@@ -468,6 +1520,8 @@ suite(void)
 
   TCase *tcase_fscan = tcase_create("fscan");
   tcase_add_test(tcase_fscan, fscan);
+  tcase_add_test(tcase_fscan, fscan_remainder);
+  tcase_add_test(tcase_fscan, fscan_pipe);
   suite_add_tcase(suite, tcase_fscan);
 
   TCase *tcase_fprint = tcase_create("fprint");
@@ -491,6 +1545,56 @@ suite(void)
   tcase_add_test(tcase_validate, validate);
   suite_add_tcase(suite, tcase_validate);
 
+  TCase *tcase_parse = tcase_create("parse");
+  tcase_add_test(tcase_parse, parse);
+  tcase_add_test(tcase_parse, parse_invalid);
+  tcase_add_test(tcase_parse, parse_file);
+  tcase_add_test(tcase_parse, parse_file_fifo);
+  tcase_add_test(tcase_parse, parse_windows);
+  tcase_add_test(tcase_parse, parse_parallel);
+  tcase_add_test(tcase_parse, parse_parallel_invalid);
+  suite_add_tcase(suite, tcase_parse);
+
+  TCase *tcase_iter = tcase_create("iter");
+  tcase_add_test(tcase_iter, iter_parse);
+  tcase_add_test(tcase_iter, iter_fscan);
+  tcase_add_test(tcase_iter, iter_invalid);
+  suite_add_tcase(suite, tcase_iter);
+
+  TCase *tcase_project = tcase_create("project");
+  tcase_add_test(tcase_project, parse_project);
+  tcase_add_test(tcase_project, parse_project_invalid);
+  tcase_add_test(tcase_project, fscan_project);
+  suite_add_tcase(suite, tcase_project);
+
+  TCase *tcase_try = tcase_create("try");
+  tcase_add_test(tcase_try, try_parse);
+  tcase_add_test(tcase_try, try_parse_invalid);
+  tcase_add_test(tcase_try, try_fscan);
+  suite_add_tcase(suite, tcase_try);
+
+  TCase *tcase_depth = tcase_create("depth");
+  tcase_add_test(tcase_depth, parse_deep);
+  tcase_add_test(tcase_depth, parse_max_depth);
+  tcase_add_test(tcase_depth, parse_max_depth_paths);
+  suite_add_tcase(suite, tcase_depth);
+
+  TCase *tcase_allocator = tcase_create("allocator");
+  tcase_add_test(tcase_allocator, parse_allocator);
+  tcase_add_test(tcase_allocator, parse_allocator_mixed);
+  suite_add_tcase(suite, tcase_allocator);
+
+  TCase *tcase_slab = tcase_create("slab");
+  tcase_add_test(tcase_slab, free_threads);
+  tcase_add_test(tcase_slab, parse_inline);
+  tcase_add_test(tcase_slab, slab_trim);
+  suite_add_tcase(suite, tcase_slab);
+
+  TCase *tcase_intern = tcase_create("intern");
+  tcase_add_test(tcase_intern, parse_intern);
+  tcase_add_test(tcase_intern, parse_intern_allocator);
+  suite_add_tcase(suite, tcase_intern);
+
  return suite;
 }
 
@@ -0,0 +1,284 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CJSON Library.
+ *
+ * The CJSON Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * The CJSON Library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CJSON Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ccstreams/ecx_ccstreams.h>
+#include <check.h>
+#include <ec/ec.h>
+#include <ecx_stdio.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cjson.h>
+
+/* Record each event as a short string so the order can be compared. */
+struct trace {
+  char events[1024];
+  size_t length;
+  size_t stop;
+  size_t count;
+};
+
+static
+int
+trace_add(struct trace *t, const char *event, const char *bytes, size_t length)
+{
+  int written = snprintf(t->events + t->length, sizeof(t->events) - t->length, "%s%.*s ", event, (int)length, bytes);
+  t->length += written;
+  t->count++;
+
+  return t->count == t->stop ? -1 : 0;
+}
+
+static int on_array_begin(void *data) { return trace_add(data, "[", "", 0); }
+static int on_array_end(void *data) { return trace_add(data, "]", "", 0); }
+static int on_object_begin(void *data) { return trace_add(data, "{", "", 0); }
+static int on_object_end(void *data) { return trace_add(data, "}", "", 0); }
+static int on_key(void *data, const char *key, size_t length) { return trace_add(data, "k:", key, length); }
+static int on_string(void *data, const char *bytes, size_t length) { return trace_add(data, "s:", bytes, length); }
+static int on_number(void *data, const char *number, size_t length) { return trace_add(data, "n:", number, length); }
+static int on_boolean(void *data, unsigned int boolean) { return trace_add(data, boolean ? "true" : "false", "", 0); }
+static int on_null(void *data) { return trace_add(data, "null", "", 0); }
+
+static const struct cjson_sax trace_sax = {
+  .on_array_begin = on_array_begin,
+  .on_array_end = on_array_end,
+  .on_object_begin = on_object_begin,
+  .on_object_end = on_object_end,
+  .on_key = on_key,
+  .on_string = on_string,
+  .on_number = on_number,
+  .on_boolean = on_boolean,
+  .on_null = on_null,
+};
+
+START_TEST(parse)
+{
+#define IN "{\"a\": [1, -2.5e3, \"x\\u00e9\"], \"b\\n\": {\"c\": true, \"d\": null}, \"e\": [[], {}, false]}"
+#define EXP "{ k:a [ n:1 n:-2.5e3 s:x\xc3\xa9 ] k:b\n { k:c true k:d null } k:e [ [ ] { } false ] } "
+  struct trace t = {.length = 0, .stop = 0, .count = 0};
+  t.events[0] = '\0';
+
+  int status = cjson_sax_parse(IN, strlen(IN), CJSON_OBJECT, 0, &trace_sax, &t);
+
+  fail_unless(status == 0);
+  {
+    const char fmt[] = "Failed to parse events. Got: %s Exp: %s";
+    fail_unless(strcmp(t.events, EXP) == 0, fmt, t.events, EXP);
+  }
+#undef EXP
+#undef IN
+}
+END_TEST
+
+START_TEST(parse_stop)
+{
+#define IN "[1, 2, 3, 4]"
+#define EXP "[ n:1 n:2 "
+  struct trace t = {.length = 0, .stop = 3, .count = 0};
+  t.events[0] = '\0';
+
+  int status = cjson_sax_parse(IN, strlen(IN), CJSON_ARRAY, 0, &trace_sax, &t);
+
+  fail_unless(status == -1, "Failed to stop parsing. Got: %d Exp: -1", status);
+  {
+    const char fmt[] = "Failed to stop parsing. Got: %s Exp: %s";
+    fail_unless(strcmp(t.events, EXP) == 0, fmt, t.events, EXP);
+  }
+#undef EXP
+#undef IN
+}
+END_TEST
+
+START_TEST(parse_invalid)
+{
+  const char *in[] = {"[1 2]", "[1,]", "{\"a\" 1}", "{\"a\": 1,}", "[1", "{\"a\": [}]", "\"x\""};
+
+  for (size_t i = 0; i < sizeof(in) / sizeof(in[0]); i++) {
+    const char * volatile msg = NULL;
+    struct trace t = {.length = 0, .stop = 0, .count = 0};
+
+    ec_try {
+      cjson_sax_parse(in[i], strlen(in[i]), CJSON_ARRAY | CJSON_OBJECT, 0, &trace_sax, &t);
+    } ec_catch_a(CJSONX_PARSE, msg) {
+    } ec_catch {
+    }
+
+    fail_unless(msg != NULL, "Parsed invalid input: %s", in[i]);
+  }
+}
+END_TEST
+
+START_TEST(fscan)
+{
+#define IN "{\"a\": [1, \"b\"]}\n[true]\n"
+#define EXP "{ k:a [ n:1 s:b ] } "
+  char *buf = IN;
+  FILE *stream = ecx_ccstreams_fstropen(&buf, "r");
+  struct trace t = {.length = 0, .stop = 0, .count = 0};
+  t.events[0] = '\0';
+
+  int status = cjson_sax_fscan(stream, CJSON_ARRAY | CJSON_OBJECT, 0, &trace_sax, &t);
+
+  fail_unless(status == 0);
+  {
+    const char fmt[] = "Failed to scan events from stream. Got: %s Exp: %s";
+    fail_unless(strcmp(t.events, EXP) == 0, fmt, t.events, EXP);
+  }
+
+  fclose(stream);
+#undef EXP
+#undef IN
+}
+END_TEST
+
+START_TEST(fscan_continuous)
+{
+#define IN "{\"a\": 1}\n[2]\n\"c\"\n"
+#define EXP "{ k:a n:1 } [ n:2 ] s:c "
+  char *buf = IN;
+  FILE *stream = ecx_ccstreams_fstropen(&buf, "r");
+  struct trace t = {.length = 0, .stop = 0, .count = 0};
+  t.events[0] = '\0';
+
+  int status = cjson_sax_fscan(stream, CJSON_ALL_E, 1, &trace_sax, &t);
+
+  fail_unless(status == 0);
+  {
+    const char fmt[] = "Failed to scan continuous events from stream. Got: %s Exp: %s";
+    fail_unless(strcmp(t.events, EXP) == 0, fmt, t.events, EXP);
+  }
+
+  fclose(stream);
+#undef EXP
+#undef IN
+}
+END_TEST
+
+START_TEST(feed_split)
+{
+#define IN "{\"a\\\"b\": [1, -2.5e3, \"x\\u00e9\\\\\"], \"c\": {\"d\": true, \"e\": null}, \"f\": [[], {}, false, 12345]}\n"
+  struct trace exp = {.length = 0, .stop = 0, .count = 0};
+  exp.events[0] = '\0';
+  cjson_sax_parse(IN, strlen(IN), CJSON_OBJECT, 0, &trace_sax, &exp);
+
+  /* Split the input in two at every position and feed it a byte at a time. */
+  for (size_t i = 0; i <= strlen(IN) + 1; i++) {
+    struct trace t = {.length = 0, .stop = 0, .count = 0};
+    t.events[0] = '\0';
+
+    struct cjson_parser *p = cjson_parser_new(CJSON_OBJECT, 0, &trace_sax, &t);
+    if (i <= strlen(IN)) {
+      cjson_parser_feed(p, IN, i);
+      cjson_parser_feed(p, IN + i, strlen(IN) - i);
+    }
+    else {
+      for (size_t j = 0; j < strlen(IN); j++) {
+        cjson_parser_feed(p, IN + j, 1);
+      }
+    }
+    cjson_parser_finish(p);
+    cjson_parser_free(p);
+
+    const char fmt[] = "Failed to parse events fed at %zu. Got: %s Exp: %s";
+    fail_unless(strcmp(t.events, exp.events) == 0, fmt, i, t.events, exp.events);
+  }
+#undef IN
+}
+END_TEST
+
+START_TEST(feed_finish)
+{
+  /* A number at the end of the input is only complete once it is finished. */
+  struct trace t = {.length = 0, .stop = 0, .count = 0};
+  t.events[0] = '\0';
+
+  struct cjson_parser *p = cjson_parser_new(CJSON_ALL_E, 1, &trace_sax, &t);
+  cjson_parser_feed(p, "[1]\n12", 6);
+  fail_unless(strcmp(t.events, "[ n:1 ] ") == 0, "Got: %s", t.events);
+  cjson_parser_feed(p, "3", 1);
+  cjson_parser_finish(p);
+  fail_unless(strcmp(t.events, "[ n:1 ] n:123 ") == 0, "Got: %s", t.events);
+  cjson_parser_free(p);
+}
+END_TEST
+
+START_TEST(feed_invalid)
+{
+  const char *in[] = {"[1, 2", "{\"a\": ", "[1 2]", "\"abc", "tru"};
+
+  for (size_t i = 0; i < sizeof(in) / sizeof(in[0]); i++) {
+    const char * volatile msg = NULL;
+    struct trace t = {.length = 0, .stop = 0, .count = 0};
+    struct cjson_parser *p = cjson_parser_new(CJSON_ALL_E, 0, &trace_sax, &t);
+
+    ec_try {
+      cjson_parser_feed(p, in[i], strlen(in[i]));
+      cjson_parser_finish(p);
+    } ec_catch_a(CJSONX_PARSE, msg) {
+    } ec_catch {
+    }
+
+    fail_unless(msg != NULL, "Parsed invalid input: %s", in[i]);
+    cjson_parser_free(p);
+  }
+}
+END_TEST
+
+static
+Suite *
+suite(void)
+{
+  Suite *suite = suite_create("sax");
+
+  TCase *tcase_parse = tcase_create("parse");
+  tcase_add_test(tcase_parse, parse);
+  tcase_add_test(tcase_parse, parse_stop);
+  tcase_add_test(tcase_parse, parse_invalid);
+  suite_add_tcase(suite, tcase_parse);
+
+  TCase *tcase_fscan = tcase_create("fscan");
+  tcase_add_test(tcase_fscan, fscan);
+  tcase_add_test(tcase_fscan, fscan_continuous);
+  suite_add_tcase(suite, tcase_fscan);
+
+  TCase *tcase_feed = tcase_create("feed");
+  tcase_add_test(tcase_feed, feed_split);
+  tcase_add_test(tcase_feed, feed_finish);
+  tcase_add_test(tcase_feed, feed_invalid);
+  suite_add_tcase(suite, tcase_feed);
+
+  return suite;
+}
+
+int
+main(void)
+{
+  int failed = 0;
+
+  SRunner *srunner = srunner_create(suite());
+
+  srunner_run_all(srunner, CK_NORMAL);
+  failed = srunner_ntests_failed(srunner);
+
+  srunner_free(srunner);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -18,6 +18,7 @@
 
 #include <ccstreams/ecx_ccstreams.h>
 #include <check.h>
+#include <ec/ec.h>
 #include <ecx_stdio.h>
 #include <errno.h>
 #include <inttypes.h>
@@ -79,6 +80,89 @@ START_TEST(fprint)
 }
 END_TEST
 
+START_TEST(parse)
+{
+#define IN "\"ASCII\\u0000\\uD834\\uDD1E\\udBfF\\udFfd\\u0001\\u0002\""
+#define EXP "ASCII\0\xF0\x9D\x84\x9E\xF4\x8F\xBF\xBD\x1\x2"
+  struct cjson *node = cjson_string_parse(IN, sizeof(IN) - 1, NULL);
+
+  fail_unless(node != NULL);
+  fail_unless(node->value.string.bytes != NULL);
+  {
+    const char fmt[] = "Failed to parse string from buffer. Got: %zu Exp: %zu";
+    fail_unless(node->value.string.length == sizeof(EXP) - 1, fmt, node->value.string.length, sizeof(EXP) - 1);
+  }
+  {
+    const char fmt[] = "Failed to parse string from buffer. Got: %s Exp: %s";
+    fail_unless(memcmp(node->value.string.bytes, EXP, sizeof(EXP) - 1) == 0, fmt, node->value.string.bytes, EXP);
+  }
+
+  cjson_free(node);
+#undef EXP
+#undef IN
+}
+END_TEST
+
+START_TEST(parse_invalid)
+{
+  /* Truncated, overlong, surrogate and noncharacter UTF-8 sequences. */
+  const char *in[] = {
+    "\"\xC3\"",
+    "\"\xC3\x28\"",
+    "\"\xC0\xAF\"",
+    "\"\xE0\x80\xAF\"",
+    "\"\xED\xA0\x80\"",
+    "\"\xEF\xBF\xBF\"",
+    "\"\xF4\x90\x80\x80\"",
+    "\"\x01\"",
+    "\"unterminated",
+  };
+
+  for (size_t i = 0; i < sizeof(in) / sizeof(*in); i++) {
+    const char * volatile msg = NULL;
+    struct cjson * volatile node = NULL;
+
+    ec_try {
+      node = cjson_string_parse(in[i], strlen(in[i]), NULL);
+    } ec_catch_a(CJSONX_PARSE, msg) {
+    } ec_catch {
+    }
+
+    fail_unless(node == NULL, "Parsed invalid string %zu.", i);
+    fail_unless(msg != NULL);
+  }
+}
+END_TEST
+
+START_TEST(fscan_long)
+{
+  /* Runs of UTF-8 and escape sequences that cross the blocks read from the stream. */
+  size_t length = 0;
+  char *in = malloc(65536);
+  char *exp = malloc(65536);
+  size_t exp_length = 0;
+
+  length += sprintf(in + length, "\"");
+  for (int i = 0; length < 40000; i++) {
+    length += sprintf(in + length, "%*s\xE2\x82\xAC\\n\\u00e9\xF0\x9F\x98\x80", i % 23, "");
+    exp_length += sprintf(exp + exp_length, "%*s\xE2\x82\xAC\n\xC3\xA9\xF0\x9F\x98\x80", i % 23, "");
+  }
+  length += sprintf(in + length, "\"");
+
+  FILE *stream = fmemopen(in, length, "r");
+  struct cjson *node = cjson_string_fscan(stream, NULL);
+  fclose(stream);
+
+  fail_unless(node != NULL);
+  fail_unless(node->value.string.length == exp_length);
+  fail_unless(memcmp(node->value.string.bytes, exp, exp_length) == 0);
+
+  cjson_free(node);
+  free(exp);
+  free(in);
+}
+END_TEST
+
 static
 Suite *
 suite(void)
@@ -87,12 +171,18 @@ suite(void)
 
   TCase *tcase_fscan = tcase_create("fscan");
   tcase_add_test(tcase_fscan, fscan);
+  tcase_add_test(tcase_fscan, fscan_long);
   suite_add_tcase(suite, tcase_fscan);
 
   TCase *tcase_fprint = tcase_create("fprint");
   tcase_add_test(tcase_fprint, fprint);
   suite_add_tcase(suite, tcase_fprint);
 
+  TCase *tcase_parse = tcase_create("parse");
+  tcase_add_test(tcase_parse, parse);
+  tcase_add_test(tcase_parse, parse_invalid);
+  suite_add_tcase(suite, tcase_parse);
+
   return suite;
 }
 
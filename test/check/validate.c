@@ -0,0 +1,171 @@
+/* Copyright 2013 Caleb Case
+ *
+ * This file is part of the CJSON Library.
+ *
+ * The CJSON Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * The CJSON Library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the CJSON Library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <check.h>
+#include <ec/ec.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cjson.h>
+START_TEST(validate_valid)
+{
+  const char *in = " {\"a\": [1, -2.5e3, \"x\\u00e9\\ud834\\udd1e\", true, false, null], \"b\": {\"c\": {}}, \"d\": []}\n";
+  struct cjson_validation result;
+
+  fail_unless(cjson_validate(in, strlen(in), CJSON_ALL_S, &result) == 1, "Error: %s", result.error);
+  fail_unless(result.values == 11, "Got: %zu", result.values);
+  fail_unless(result.depth == 3, "Got: %zu", result.depth);
+  fail_unless(result.bytes == strlen(in), "Got: %zu", result.bytes);
+  fail_unless(result.error[0] == '\0');
+
+  fail_unless(cjson_validate("1", 1, CJSON_ALL_E, &result) == 1);
+  fail_unless(result.values == 1 && result.depth == 0);
+
+  /* Bare items must be one of the valid types. */
+  fail_unless(cjson_validate("1", 1, CJSON_ALL_S, &result) == 0);
+}
+END_TEST
+
+START_TEST(validate_invalid)
+{
+  const char *error[] = {
+    "",
+    " ",
+    "[1,]",
+    "[1 2]",
+    "{\"a\" 1}",
+    "{\"a\": 1,}",
+    "{\"a\": 1} {}",
+    "[01]",
+    "[1.]",
+    "[tru]",
+    "[\"\\q\"]",
+    "[\"\xc0\xaf\"]",
+    "[\"\\ud834\"]",
+    "[\"\\udd1e\"]",
+    "{\"a\": 1, \"a\": 2}",
+    "{\"a\": 1, \"\\u0061\": 2}",
+    "{\"a\": {\"b\": 1}, \"c\": {\"b\": 2, \"d\": 3, \"b\": 4}}",
+  };
+
+  for (size_t k = 0; k < sizeof(error) / sizeof(error[0]); k++) {
+    struct cjson_validation result;
+    fail_unless(cjson_validate(error[k], strlen(error[k]), CJSON_ALL_S, &result) == 0, "Validated invalid document %zu.", k);
+    fail_unless(result.error[0] != '\0');
+  }
+
+  /* The same keys in different objects are not duplicates. */
+  const char *in = "{\"a\": {\"b\": 1}, \"c\": {\"b\": 2}, \"\\/\": 3, \"/x\": 4}";
+  struct cjson_validation result;
+  fail_unless(cjson_validate(in, strlen(in), CJSON_ALL_S, &result) == 1, "Error: %s", result.error);
+}
+END_TEST
+
+START_TEST(validate_keys)
+{
+  /* More keys than are remembered for finding duplicates. */
+  for (int k = 0; k < 3; k++) {
+    char *in = malloc(64 * 4096);
+    size_t length = sprintf(in, "{");
+    for (int i = 0; i < 3000; i++) {
+      length += sprintf(in + length, "\"k%d\": [{\"k%d\": %d}], ", i, i, i);
+    }
+
+    const char *last[] = {"\"k2999x\"", "\"k2999\"", "\"k\\u0031\""};
+    length += sprintf(in + length, "%s: 0}", last[k]);
+
+    struct cjson_validation result;
+    int status = cjson_validate(in, length, CJSON_ALL_S, &result);
+    fail_unless(status == (k == 0), "Key %d. Error: %s", k, result.error);
+
+    free(in);
+  }
+
+  /* Objects that spill nested in objects that spilled. */
+  for (int k = 0; k < 2; k++) {
+    char *in = malloc(64 * 4096);
+    size_t length = sprintf(in, "{");
+    for (int i = 0; i < 2000; i++) {
+      length += sprintf(in + length, "\"k%d\": %d, ", i, i);
+    }
+    length += sprintf(in + length, "\"o\": {");
+    for (int i = 0; i < 2000; i++) {
+      length += sprintf(in + length, "\"k%d\": %d, ", i, i);
+    }
+    length += sprintf(in + length, "\"%s\": 0}, \"%s\": 0}", k == 0 ? "o" : "k7", k == 0 ? "p" : "o");
+
+    struct cjson_validation result;
+    int status = cjson_validate(in, length, CJSON_ALL_S, &result);
+    fail_unless(status == (k == 0), "Nested %d. Error: %s", k, result.error);
+
+    free(in);
+  }
+}
+END_TEST
+
+START_TEST(validate_depth)
+{
+  const size_t depth = CJSON_MAX_DEPTH + 1;
+  char *in = malloc(depth * 2);
+  memset(in, '[', depth);
+  memset(in + depth, ']', depth);
+
+  struct cjson_validation result;
+  fail_unless(cjson_validate(in + 1, (depth - 1) * 2, CJSON_ALL_S, &result) == 1, "Error: %s", result.error);
+  fail_unless(result.depth == CJSON_MAX_DEPTH);
+
+  fail_unless(cjson_validate(in, depth * 2, CJSON_ALL_S, &result) == 0);
+  fail_unless(strstr(result.error, "depth") != NULL, "Got: %s", result.error);
+
+  free(in);
+}
+END_TEST
+
+static
+Suite *
+suite(void)
+{
+  Suite *suite = suite_create("validate");
+
+  TCase *tcase_validate = tcase_create("validate");
+  tcase_add_test(tcase_validate, validate_valid);
+  tcase_add_test(tcase_validate, validate_invalid);
+  tcase_add_test(tcase_validate, validate_keys);
+  tcase_add_test(tcase_validate, validate_depth);
+  suite_add_tcase(suite, tcase_validate);
+
+  return suite;
+}
+
+int
+main(void)
+{
+  int failed = 0;
+
+  SRunner *srunner = srunner_create(suite());
+
+  srunner_run_all(srunner, CK_NORMAL);
+  failed = srunner_ntests_failed(srunner);
+
+  srunner_free(srunner);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}